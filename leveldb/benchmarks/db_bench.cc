@@ -4,15 +4,21 @@
 
 #include <sys/types.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
 
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/perf_context.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
 #include "util/crc32c.h"
@@ -34,6 +40,8 @@
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
 //      readmissing   -- read N missing keys in random order
+//      multireadrandom -- read N times in random order, --multiget_batch
+//                         keys per DB::MultiGet() call
 //      readhot       -- read N times in random order from 1% section of DB
 //      seekrandom    -- N random seeks
 //      seekordered   -- N ordered seeks
@@ -43,6 +51,8 @@
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
 //      sstables    -- Print sstable info
+//      blockcachestats -- Print block cache hits and misses per block kind
+//      filterstats -- Print table filter counters per level
 //      heapprofile -- Dump a heap profile (if supported by this port)
 static const char* FLAGS_benchmarks =
     "fillseq,"
@@ -55,6 +65,12 @@ static int FLAGS_num = 10000000;
 // Number of read operations to do.  If negative, do FLAGS_num reads.
 static int FLAGS_reads = -1;
 
+// Number of keys per DB::MultiGet() call in multireadrandom.
+static int FLAGS_multiget_batch = 100;
+
+// Number of sstables of a level DB::MultiGet() searches at the same time.
+static int FLAGS_max_parallel_reads = 1;
+
 // Number of concurrent threads to run.
 static int FLAGS_threads = 1;
 
@@ -68,6 +84,11 @@ static double FLAGS_compression_ratio = 1;
 // Print histogram of operation timings
 static bool FLAGS_histogram = false;
 
+// Collect the perf context of every operation (see leveldb/perf_context.h)
+// and print its counters and stage timings: 0 for none, 1 for the counters
+// and 2 for the timings too
+static int FLAGS_perf_level = leveldb::kPerfDisable;
+
 // Count the number of string comparisons performed
 static bool FLAGS_comparisons = false;
 
@@ -75,6 +96,10 @@ static bool FLAGS_comparisons = false;
 // (initialized to default value by "main")
 static int FLAGS_write_buffer_size = 0;
 
+// Size of each memtable's filter as a fraction of write_buffer_size
+// (0 means no memtable filter).
+static double FLAGS_memtable_filter_size_ratio = 0;
+
 // Number of bytes written to each file.
 // (initialized to default value by "main")
 static int FLAGS_max_file_size = 0;
@@ -94,6 +119,43 @@ static int FLAGS_open_files = 0;
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// Filter policy: "none", "bloom:<bits>", "wormhole:<bits>" or
+// "wormhole:<bits>:<fingerprint bits>".  Overrides --bloom_bits.
+static const char* FLAGS_filter = nullptr;
+
+// Filter policies of levels 0, 1, ...: a comma-separated list of --filter
+// values.  Empty entries, and levels past the list, use --filter.
+static const char* FLAGS_level_filters = nullptr;
+
+// If true, table builders build filters on a thread of their own.
+static bool FLAGS_background_filter_build = false;
+
+// If true, tables of the bottommost level get no filter.
+static bool FLAGS_optimize_filters_for_hits = false;
+
+// If true, build one filter per table instead of one per 2KB of data.
+static bool FLAGS_full_filter = false;
+
+// If positive, split full filters into partitions of this many keys.
+static int FLAGS_filter_partition_keys = 0;
+
+// If set, keep every table's filter in its own file in this directory,
+// e.g. on a DAX-mounted persistent memory file system.
+static const char* FLAGS_filter_dir = nullptr;
+
+// Bytes of the filter over all keys of the database (0 means none).
+static int FLAGS_db_filter_size = 0;
+
+// If positive, give tables prefix filters over the first this many bytes
+// of every key, and let seekrandom read with prefix_same_as_start.
+static int FLAGS_prefix_size = 0;
+
+// If true, keep index and filter blocks in the block cache.
+static bool FLAGS_cache_index_and_filter_blocks = false;
+
+// If true, pin the index and filter blocks of level-0 tables in the cache.
+static bool FLAGS_pin_l0_filter_and_index_blocks_in_cache = false;
+
 // Common key prefix length.
 static int FLAGS_key_prefix = 0;
 
@@ -222,6 +284,29 @@ static void AppendWithSpace(std::string* str, Slice msg) {
   str->append(msg.data(), msg.size());
 }
 
+// Counters and stage timings of the perf context, in the order printed
+static const struct {
+  const char* name;
+  uint64_t PerfContext::*metric;
+} kPerfMetrics[] = {
+    {"get_nanos", &PerfContext::get_nanos},
+    {"mutex_wait_nanos", &PerfContext::mutex_wait_nanos},
+    {"memtable_get_nanos", &PerfContext::memtable_get_nanos},
+    {"imm_get_nanos", &PerfContext::imm_get_nanos},
+    {"version_get_nanos", &PerfContext::version_get_nanos},
+    {"find_table_nanos", &PerfContext::find_table_nanos},
+    {"filter_probe_nanos", &PerfContext::filter_probe_nanos},
+    {"index_seek_nanos", &PerfContext::index_seek_nanos},
+    {"block_read_nanos", &PerfContext::block_read_nanos},
+    {"block_seek_nanos", &PerfContext::block_seek_nanos},
+    {"table_lookup_count", &PerfContext::table_lookup_count},
+    {"filter_probe_count", &PerfContext::filter_probe_count},
+    {"block_cache_hit_count", &PerfContext::block_cache_hit_count},
+    {"block_read_count", &PerfContext::block_read_count},
+    {"block_read_bytes", &PerfContext::block_read_bytes},
+};
+static const int kNumPerfMetrics = sizeof(kPerfMetrics) / sizeof(kPerfMetrics[0]);
+
 class Stats {
  private:
   double start_;
@@ -233,6 +318,9 @@ class Stats {
   double last_op_finish_;
   Histogram hist_;
   std::string message_;
+  // Per-op values of kPerfMetrics, over the ops that touched any
+  int perf_ops_;
+  Histogram perf_hist_[kNumPerfMetrics];
 
  public:
   Stats() { Start(); }
@@ -240,6 +328,11 @@ class Stats {
   void Start() {
     next_report_ = 100;
     hist_.Clear();
+    perf_ops_ = 0;
+    for (int i = 0; i < kNumPerfMetrics; i++) {
+      perf_hist_[i].Clear();
+    }
+    GetPerfContext()->Reset();
     done_ = 0;
     bytes_ = 0;
     seconds_ = 0;
@@ -249,6 +342,10 @@ class Stats {
 
   void Merge(const Stats& other) {
     hist_.Merge(other.hist_);
+    perf_ops_ += other.perf_ops_;
+    for (int i = 0; i < kNumPerfMetrics; i++) {
+      perf_hist_[i].Merge(other.perf_hist_[i]);
+    }
     done_ += other.done_;
     bytes_ += other.bytes_;
     seconds_ += other.seconds_;
@@ -277,6 +374,9 @@ class Stats {
       }
       last_op_finish_ = now;
     }
+    if (FLAGS_perf_level > kPerfDisable) {
+      FinishedPerfOp();
+    }
 
     done_++;
     if (done_ >= next_report_) {
@@ -299,6 +399,22 @@ class Stats {
     }
   }
 
+  // Adds the perf context of the op that just finished to perf_hist_.
+  void FinishedPerfOp() {
+    PerfContext* context = GetPerfContext();
+    bool touched = false;
+    for (int i = 0; i < kNumPerfMetrics && !touched; i++) {
+      touched = context->*kPerfMetrics[i].metric != 0;
+    }
+    if (touched) {
+      perf_ops_++;
+      for (int i = 0; i < kNumPerfMetrics; i++) {
+        perf_hist_[i].Add(static_cast<double>(context->*kPerfMetrics[i].metric));
+      }
+      context->Reset();
+    }
+  }
+
   void AddBytes(int64_t n) { bytes_ += n; }
 
   void Report(const Slice& name) {
@@ -325,6 +441,18 @@ class Stats {
       std::fprintf(stdout, "Microseconds per op:\n%s\n",
                    hist_.ToString().c_str());
     }
+    if (perf_ops_ > 0) {
+      std::fprintf(stdout, "Perf context of %d ops:\n", perf_ops_);
+      std::fprintf(stdout, "%-22s %12s %12s %12s %12s\n", "", "Average",
+                   "P50", "P99", "Max");
+      for (int i = 0; i < kNumPerfMetrics; i++) {
+        const Histogram& hist = perf_hist_[i];
+        if (hist.Percentile(100) == 0) continue;
+        std::fprintf(stdout, "%-22s %12.1f %12.1f %12.1f %12.1f\n",
+                     kPerfMetrics[i].name, hist.Average(), hist.Median(),
+                     hist.Percentile(99), hist.Percentile(100));
+      }
+    }
     std::fflush(stdout);
   }
 };
@@ -410,12 +538,59 @@ void Uncompress(
   }
 }
 
+// Returns the filter policy described by "spec", in the format of --filter.
+const FilterPolicy* NewFilterPolicy(const char* spec) {
+  int bits, fingerprint_bits;
+  char junk;
+  if (strcmp(spec, "none") == 0) {
+    return nullptr;
+  } else if (sscanf(spec, "bloom:%d%c", &bits, &junk) == 1) {
+    return NewBloomFilterPolicy(bits);
+  } else if (sscanf(spec, "wormhole:%d:%d%c", &bits, &fingerprint_bits,
+                    &junk) == 2) {
+    return NewWormholeFilterPolicy(bits, fingerprint_bits);
+  } else if (sscanf(spec, "wormhole:%d%c", &bits, &junk) == 1) {
+    return NewWormholeFilterPolicy(bits);
+  }
+  std::fprintf(stderr, "Invalid filter '%s'\n", spec);
+  std::exit(1);
+}
+
+const FilterPolicy* NewFilterPolicy() {
+  if (FLAGS_filter == nullptr) {
+    if (FLAGS_bloom_bits > 0) {
+      return NewBloomFilterPolicy(FLAGS_bloom_bits);
+    }
+    return FLAGS_bloom_bits == 0 ? nullptr : NewWormholeFilterPolicy();
+  }
+  return NewFilterPolicy(FLAGS_filter);
+}
+
+std::vector<const FilterPolicy*> NewLevelFilterPolicies() {
+  std::vector<const FilterPolicy*> policies;
+  if (FLAGS_level_filters == nullptr) {
+    return policies;
+  }
+  Slice specs(FLAGS_level_filters);
+  while (!specs.empty()) {
+    const char* comma =
+        static_cast<const char*>(memchr(specs.data(), ',', specs.size()));
+    const size_t n = comma == nullptr ? specs.size() : comma - specs.data();
+    const std::string spec(specs.data(), n);
+    policies.push_back(spec.empty() ? nullptr : NewFilterPolicy(spec.c_str()));
+    specs.remove_prefix(comma == nullptr ? n : n + 1);
+  }
+  return policies;
+}
+
 }  // namespace
 
 class Benchmark {
  private:
   Cache* cache_;
   const FilterPolicy* filter_policy_;
+  std::vector<const FilterPolicy*> level_filter_policies_;
+  const SliceTransform* prefix_extractor_;
   DB* db_;
   int num_;
   int value_size_;
@@ -506,10 +681,12 @@ class Benchmark {
 
  public:
   Benchmark()
-      : cache_(NewLRUCache(0)),
-        filter_policy_(FLAGS_bloom_bits > 0
-                           ? NewBloomFilterPolicy(FLAGS_bloom_bits)
-                           : (FLAGS_bloom_bits == 0 ? nullptr:NewWormholeFilterPolicy())),
+      : cache_(NewLRUCache(FLAGS_cache_size > 0 ? FLAGS_cache_size : 0)),
+        filter_policy_(NewFilterPolicy()),
+        level_filter_policies_(NewLevelFilterPolicies()),
+        prefix_extractor_(FLAGS_prefix_size > 0
+                              ? NewFixedPrefixTransform(FLAGS_prefix_size)
+                              : nullptr),
         db_(nullptr),
         num_(FLAGS_num),
         value_size_(FLAGS_value_size),
@@ -534,6 +711,10 @@ class Benchmark {
     delete db_;
     delete cache_;
     delete filter_policy_;
+    for (const FilterPolicy* policy : level_filter_policies_) {
+      delete policy;
+    }
+    delete prefix_extractor_;
   }
 
   void Run() {
@@ -596,6 +777,8 @@ class Benchmark {
         method = &Benchmark::ReadReverse;
       } else if (name == Slice("readrandom")) {
         method = &Benchmark::ReadRandom;
+      } else if (name == Slice("multireadrandom")) {
+        method = &Benchmark::MultiReadRandom;
       } else if (name == Slice("readmissing")) {
         method = &Benchmark::ReadMissing;
       } else if (name == Slice("seekrandom")) {
@@ -632,6 +815,10 @@ class Benchmark {
         PrintStats("leveldb.stats");
       } else if (name == Slice("sstables")) {
         PrintStats("leveldb.sstables");
+      } else if (name == Slice("blockcachestats")) {
+        PrintStats("leveldb.block-cache-stats");
+      } else if (name == Slice("filterstats")) {
+        PrintStats("leveldb.filter-stats");
       } else {
         if (!name.empty()) {  // No error message for empty name
           std::fprintf(stderr, "unknown benchmark '%s'\n",
@@ -681,6 +868,7 @@ class Benchmark {
       }
     }
 
+    SetPerfLevel(static_cast<PerfLevel>(FLAGS_perf_level));
     thread->stats.Start();
     (arg->bm->*(arg->method))(thread);
     thread->stats.Stop();
@@ -728,6 +916,7 @@ class Benchmark {
       arg[0].thread->stats.Merge(arg[i].thread->stats);
     }
     arg[0].thread->stats.Report(name);
+    PrintFilterStats();
     if (FLAGS_comparisons) {
       fprintf(stdout, "Comparisons: %zu\n", count_comparator_.comparisons());
       count_comparator_.reset();
@@ -794,6 +983,7 @@ class Benchmark {
     options.block_cache = cache_;
     options.using_direct_io = FLAGS_use_direct_io;
     options.write_buffer_size = FLAGS_write_buffer_size;
+    options.memtable_filter_size_ratio = FLAGS_memtable_filter_size_ratio;
     options.max_file_size = FLAGS_max_file_size;
     options.block_size = FLAGS_block_size;
     if (FLAGS_comparisons) {
@@ -801,6 +991,19 @@ class Benchmark {
     }
     options.max_open_files = FLAGS_open_files;
     options.filter_policy = filter_policy_;
+    options.level_filter_policies = level_filter_policies_;
+    options.optimize_filters_for_hits = FLAGS_optimize_filters_for_hits;
+    options.background_filter_build = FLAGS_background_filter_build;
+    options.full_filter = FLAGS_full_filter;
+    options.filter_partition_keys = FLAGS_filter_partition_keys;
+    if (FLAGS_filter_dir != nullptr) {
+      options.filter_dir = FLAGS_filter_dir;
+    }
+    options.db_filter_size = FLAGS_db_filter_size;
+    options.prefix_extractor = prefix_extractor_;
+    options.cache_index_and_filter_blocks = FLAGS_cache_index_and_filter_blocks;
+    options.pin_l0_filter_and_index_blocks_in_cache =
+        FLAGS_pin_l0_filter_and_index_blocks_in_cache;
     options.reuse_logs = FLAGS_reuse_logs;
     options.compression =
         FLAGS_compression ? kSnappyCompression : kNoCompression;
@@ -897,10 +1100,42 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  void MultiReadRandom(ThreadState* thread) {
+    ReadOptions options;
+    options.max_parallel_reads = FLAGS_max_parallel_reads;
+    const int batch = std::max(FLAGS_multiget_batch, 1);
+    std::vector<std::string> keys(batch);
+    std::vector<Slice> key_slices(batch);
+    std::vector<std::string> values(batch);
+    std::vector<Status> statuses(batch);
+    int found = 0;
+    KeyBuffer key;
+    for (int i = 0; i < reads_; i += batch) {
+      const int n = std::min(batch, reads_ - i);
+      for (int j = 0; j < n; j++) {
+        key.Set(thread->rand.Uniform(FLAGS_num));
+        keys[j] = key.slice().ToString();
+        key_slices[j] = keys[j];
+      }
+      db_->MultiGet(options, key_slices.data(), n, values.data(),
+                    statuses.data());
+      for (int j = 0; j < n; j++) {
+        if (statuses[j].ok()) {
+          found++;
+        }
+        thread->stats.FinishedSingleOp();
+      }
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
+    thread->stats.AddMessage(msg);
+  }
+
   void ReadMissing(ThreadState* thread) {
     ReadOptions options;
     std::string value;
     KeyBuffer key;
+    const uint64_t start_lookups = DataBlockLookups();
     for (int i = 0; i < reads_; i++) {
       const int k = thread->rand.Uniform(FLAGS_num);
       key.Set(k);
@@ -908,6 +1143,22 @@ class Benchmark {
       db_->Get(options, s, &value);
       thread->stats.FinishedSingleOp();
     }
+    // Every data block read for a missing key is wasted.  The counter is
+    // shared, so with several threads this assumes they all run about as
+    // long.
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%.4f wasted block reads per miss)",
+                  static_cast<double>(DataBlockLookups() - start_lookups) /
+                      (static_cast<double>(reads_) * FLAGS_threads));
+    thread->stats.AddMessage(msg);
+  }
+
+  uint64_t DataBlockLookups() {
+    std::string value;
+    if (!db_->GetProperty("leveldb.data-block-lookups", &value)) {
+      return 0;
+    }
+    return std::strtoull(value.c_str(), nullptr, 10);
   }
 
   void ReadHot(ThreadState* thread) {
@@ -925,6 +1176,7 @@ class Benchmark {
 
   void SeekRandom(ThreadState* thread) {
     ReadOptions options;
+    options.prefix_same_as_start = prefix_extractor_ != nullptr;
     int found = 0;
     KeyBuffer key;
     for (int i = 0; i < reads_; i++) {
@@ -1018,6 +1270,18 @@ class Benchmark {
 
   void Compact(ThreadState* thread) { db_->CompactRange(nullptr, nullptr); }
 
+  // Prints the filter counters once a benchmark has probed a filter.
+  // They are kept since the DB was opened, so they include the probes of
+  // earlier benchmarks on the same DB.
+  void PrintFilterStats() {
+    std::string stats;
+    if (db_ == nullptr || !db_->GetProperty("leveldb.filter-stats", &stats) ||
+        std::count(stats.begin(), stats.end(), '\n') <= 2) {
+      return;  // Only the header: no level was probed
+    }
+    std::fprintf(stdout, "%s", stats.c_str());
+  }
+
   void PrintStats(const char* key) {
     std::string stats;
     if (!db_->GetProperty(key, &stats)) {
@@ -1069,6 +1333,9 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--histogram=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_histogram = n;
+    } else if (sscanf(argv[i], "--perf_level=%d%c", &n, &junk) == 1 &&
+               n >= leveldb::kPerfDisable && n <= leveldb::kPerfEnableTime) {
+      FLAGS_perf_level = n;
     } else if (sscanf(argv[i], "--comparisons=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_comparisons = n;
@@ -1085,12 +1352,19 @@ int main(int argc, char** argv) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
       FLAGS_reads = n;
+    } else if (sscanf(argv[i], "--multiget_batch=%d%c", &n, &junk) == 1) {
+      FLAGS_multiget_batch = n;
+    } else if (sscanf(argv[i], "--max_parallel_reads=%d%c", &n, &junk) == 1) {
+      FLAGS_max_parallel_reads = n;
     } else if (sscanf(argv[i], "--threads=%d%c", &n, &junk) == 1) {
       FLAGS_threads = n;
     } else if (sscanf(argv[i], "--value_size=%d%c", &n, &junk) == 1) {
       FLAGS_value_size = n;
     } else if (sscanf(argv[i], "--write_buffer_size=%d%c", &n, &junk) == 1) {
       FLAGS_write_buffer_size = n;
+    } else if (sscanf(argv[i], "--memtable_filter_size_ratio=%lf%c", &d,
+                      &junk) == 1) {
+      FLAGS_memtable_filter_size_ratio = d;
     } else if (sscanf(argv[i], "--max_file_size=%d%c", &n, &junk) == 1) {
       FLAGS_max_file_size = n;
     } else if (sscanf(argv[i], "--block_size=%d%c", &n, &junk) == 1) {
@@ -1101,6 +1375,38 @@ int main(int argc, char** argv) {
       FLAGS_cache_size = n;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (strncmp(argv[i], "--filter=", 9) == 0) {
+      FLAGS_filter = argv[i] + 9;
+    } else if (strncmp(argv[i], "--level_filters=", 16) == 0) {
+      FLAGS_level_filters = argv[i] + 16;
+    } else if (sscanf(argv[i], "--full_filter=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_full_filter = n;
+    } else if (sscanf(argv[i], "--background_filter_build=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_background_filter_build = n;
+    } else if (sscanf(argv[i], "--optimize_filters_for_hits=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_optimize_filters_for_hits = n;
+    } else if (sscanf(argv[i], "--filter_partition_keys=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_filter_partition_keys = n;
+    } else if (strncmp(argv[i], "--filter_dir=", 13) == 0) {
+      FLAGS_filter_dir = argv[i] + 13;
+    } else if (sscanf(argv[i], "--db_filter_size=%d%c", &n, &junk) == 1) {
+      FLAGS_db_filter_size = n;
+    } else if (sscanf(argv[i], "--prefix_size=%d%c", &n, &junk) == 1) {
+      FLAGS_prefix_size = n;
+    } else if (sscanf(argv[i], "--cache_index_and_filter_blocks=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_cache_index_and_filter_blocks = n;
+    } else if (sscanf(argv[i], "--pin_l0_filter_and_index_blocks_in_cache=%d%c",
+                      &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_pin_l0_filter_and_index_blocks_in_cache = n;
     } else if (sscanf(argv[i], "--use_direct_io=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_use_direct_io = n;
@@ -0,0 +1,166 @@
+// Copyright (c) 2019 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Cost and accuracy of the built-in filter policies on keys shaped like the
+// keys of db_bench, without the I/O of a database around them.  Every
+// benchmark takes the policy, the key length and the number of keys n of a
+// filter, and reports:
+//
+//   time/key     time per key to build the filter or to probe it
+//   bits/key     size of the filter built, per key
+//   fpr          share of absent keys the filter let through (negative
+//                probes only)
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+namespace {
+
+struct PolicyEntry {
+  const char* name;
+  const FilterPolicy* policy;
+};
+
+// The policies compared, as indexed by the first benchmark argument
+const std::vector<PolicyEntry>& Policies() {
+  static const std::vector<PolicyEntry>* policies =
+      new std::vector<PolicyEntry>{
+          {"bloom:10", NewBloomFilterPolicy(10)},
+          {"bloom:17", NewBloomFilterPolicy(17)},
+          {"wormhole:17", NewWormholeFilterPolicy(17, 12)},
+          {"wormhole:17:8", NewWormholeFilterPolicy(17, 8)},
+      };
+  return *policies;
+}
+
+// n keys of key_bytes decimal digits, in random order.  Key i holds the
+// number 2 * i if present is true and 2 * i + 1 otherwise, so present and
+// absent keys interleave, as db_bench's readmissing does.
+std::vector<std::string> MakeKeys(int key_bytes, int n, bool present) {
+  std::vector<std::string> keys(n);
+  char buf[100];
+  for (int i = 0; i < n; i++) {
+    const unsigned long long num = 2ull * i + (present ? 0 : 1);
+    std::snprintf(buf, sizeof(buf), "%0*llu", key_bytes, num);
+    keys[i] = buf;
+  }
+  Random rnd(301);
+  for (int i = n - 1; i > 0; i--) {
+    std::swap(keys[i], keys[rnd.Uniform(i + 1)]);
+  }
+  return keys;
+}
+
+// Builds the filter of the benchmark's policy over its present keys.
+class FilterFixture {
+ public:
+  explicit FilterFixture(benchmark::State& state)
+      : entry_(Policies()[state.range(0)]),
+        key_bytes_(static_cast<int>(state.range(1))),
+        n_(static_cast<int>(state.range(2))),
+        keys_(MakeKeys(key_bytes_, n_, true)),
+        slices_(keys_.begin(), keys_.end()) {
+    state.SetLabel(entry_.name);
+  }
+
+  const FilterPolicy* policy() const { return entry_.policy; }
+  int key_bytes() const { return key_bytes_; }
+  int n() const { return n_; }
+  const std::vector<Slice>& keys() const { return slices_; }
+
+  void Build(std::string* filter) const {
+    filter->clear();
+    entry_.policy->CreateFilter(slices_.data(), n_, filter);
+  }
+
+  // Every iteration builds or probes the filter once per key.
+  void SetCounters(benchmark::State& state, const std::string& filter) const {
+    state.counters["time/key"] = benchmark::Counter(
+        n_, benchmark::Counter::kIsIterationInvariantRate |
+                benchmark::Counter::kInvert);
+    state.counters["bits/key"] = 8.0 * filter.size() / n_;
+  }
+
+ private:
+  const PolicyEntry& entry_;
+  const int key_bytes_;
+  const int n_;
+  const std::vector<std::string> keys_;
+  const std::vector<Slice> slices_;
+};
+
+void BM_CreateFilter(benchmark::State& state) {
+  FilterFixture fixture(state);
+  std::string filter;
+  for (auto _ : state) {
+    fixture.Build(&filter);
+    benchmark::DoNotOptimize(filter);
+  }
+  fixture.SetCounters(state, filter);
+}
+
+void BM_PositiveProbe(benchmark::State& state) {
+  FilterFixture fixture(state);
+  std::string filter;
+  fixture.Build(&filter);
+  const Slice filter_slice(filter);
+  const std::vector<Slice>& keys = fixture.keys();
+  for (auto _ : state) {
+    for (const Slice& key : keys) {
+      if (!fixture.policy()->KeyMayMatch(key, filter_slice)) {
+        state.SkipWithError("present key not matched");
+        return;
+      }
+    }
+  }
+  fixture.SetCounters(state, filter);
+}
+
+void BM_NegativeProbe(benchmark::State& state) {
+  FilterFixture fixture(state);
+  std::string filter;
+  fixture.Build(&filter);
+  const Slice filter_slice(filter);
+  const std::vector<std::string> absent =
+      MakeKeys(fixture.key_bytes(), fixture.n(), false);
+  const std::vector<Slice> keys(absent.begin(), absent.end());
+  int64_t matches = 0;
+  for (auto _ : state) {
+    for (const Slice& key : keys) {
+      matches += fixture.policy()->KeyMayMatch(key, filter_slice);
+    }
+  }
+  fixture.SetCounters(state, filter);
+  state.counters["fpr"] = static_cast<double>(matches) /
+                          (static_cast<double>(state.iterations()) * keys.size());
+}
+
+void FilterArgs(benchmark::internal::Benchmark* b) {
+  std::vector<int64_t> policies;
+  for (size_t i = 0; i < Policies().size(); i++) {
+    policies.push_back(i);
+  }
+  b->ArgNames({"policy", "key_bytes", "n"});
+  b->ArgsProduct({policies, {16, 32, 64}, {1000, 10000, 100000}});
+}
+
+BENCHMARK(BM_CreateFilter)->Apply(FilterArgs);
+BENCHMARK(BM_PositiveProbe)->Apply(FilterArgs);
+BENCHMARK(BM_NegativeProbe)->Apply(FilterArgs);
+
+}  // namespace
+
+}  // namespace leveldb
+
+BENCHMARK_MAIN();
@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_DB_BUILDER_H_
 #define STORAGE_LEVELDB_DB_BUILDER_H_
 
+#include "leveldb/slice.h"
 #include "leveldb/status.h"
 
 namespace leveldb {
@@ -22,8 +23,11 @@ class VersionEdit;
 // *meta will be filled with metadata about the generated table.
 // If no data is present in *iter, meta->file_size will be set to
 // zero, and no Table file will be produced.
+// If "filter" is non-empty, it is written as the full filter of the table
+// (see TableBuilder::SetFullFilter) instead of one built from the keys.
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta);
+                  TableCache* table_cache, Iterator* iter, FileMetaData* meta,
+                  const Slice& filter = Slice());
 
 }  // namespace leveldb
 
@@ -0,0 +1,275 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/db_filter.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "leveldb/env.h"
+#include "leveldb/iterator.h"
+#include "leveldb/write_batch.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+// A utility routine: write "data" to the named file and Sync() it.
+Status WriteStringToFileSync(Env* env, const Slice& data,
+                             const std::string& fname);
+
+// A saved filter is made of the encodings of its tables, its counts and a
+// trailer:
+//    table    : length-prefixed encoding of table_
+//    counted  : length-prefixed encoding of counted_
+//    counts   : hash (fixed64) and records (fixed32) per entry of counts_
+//    entries  : fixed64
+//    sequence : fixed64
+//    crc      : fixed32 (masked crc32c of everything before it)
+//    magic    : fixed64
+static const size_t kTrailerSize = 8 + 8 + 4 + 8;
+static const size_t kCountSize = 8 + 4;
+static const uint64_t kDBFilterMagic = 0x8f3c51d2a7e4b60aull;
+
+// Share of the records of a full filter that must be gone before it is
+// rebuilt.
+static const int kRebuildRemovedShare = 4;
+
+// The second table holds one fingerprint per key written more than once.
+static size_t CountedTableBytes(size_t bytes) {
+  return std::max<size_t>(bytes / 32, 1024);
+}
+
+class DBFilter::Inserter : public WriteBatch::Handler {
+ public:
+  explicit Inserter(DBFilter* filter) : filter_(filter) {}
+
+  void Put(const Slice& key, const Slice& value) override {
+    filter_->Insert(Hash(key));
+  }
+  void Delete(const Slice& key) override { filter_->Insert(Hash(key)); }
+
+ private:
+  DBFilter* const filter_;
+};
+
+DBFilter::DBFilter(size_t bytes, int fingerprint_bits)
+    : bytes_(bytes),
+      fingerprint_bits_(fingerprint_bits),
+      table_(bytes, fingerprint_bits),
+      counted_(CountedTableBytes(bytes), fingerprint_bits),
+      entries_(0),
+      removed_since_full_(0),
+      rebuilding_(false) {}
+
+// REQUIRES: mutex_ is held
+void DBFilter::Insert(uint64_t hash) {
+  entries_.fetch_add(1, std::memory_order_relaxed);
+  if (rebuilding_) {
+    rebuild_inserts_.push_back(hash);
+  }
+  // A full filter matches every key, so records that find no room are
+  // still covered.
+  if (full()) {
+    return;
+  }
+  if (!table_.MayMatch(hash)) {
+    table_.Insert(hash);
+  } else if (counts_[hash]++ == 0) {
+    // Also taken for keys that only share a fingerprint with a key in
+    // table_, whose records must outlive those of the other key.
+    counted_.Insert(hash);
+  }
+}
+
+// REQUIRES: mutex_ is held
+void DBFilter::RemoveOne(uint64_t hash) {
+  entries_.fetch_sub(1, std::memory_order_relaxed);
+  if (rebuilding_) {
+    rebuild_removes_.push_back(hash);
+  }
+  if (full()) {
+    removed_since_full_++;
+    return;
+  }
+  auto it = counts_.find(hash);
+  if (it == counts_.end()) {
+    table_.Remove(hash);
+  } else if (--it->second == 0) {
+    counts_.erase(it);
+    counted_.Remove(hash);
+  }
+}
+
+void DBFilter::AddBatch(const WriteBatch* batch) {
+  MutexLock l(&mutex_);
+  Inserter inserter(this);
+  batch->Iterate(&inserter);  // Corrupt batches are caught by the writer
+}
+
+Status DBFilter::AddAll(Iterator* iter, SequenceNumber sequence) {
+  MutexLock l(&mutex_);
+  ParsedInternalKey ikey;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    if (ParseInternalKey(iter->key(), &ikey) && ikey.sequence <= sequence) {
+      Insert(Hash(ikey.user_key));
+    }
+  }
+  return iter->status();
+}
+
+void DBFilter::Remove(const std::vector<uint64_t>& hashes) {
+  MutexLock l(&mutex_);
+  for (uint64_t hash : hashes) {
+    RemoveOne(hash);
+  }
+}
+
+bool DBFilter::NeedsRebuild() {
+  MutexLock l(&mutex_);
+  return full() && !rebuilding_ &&
+         removed_since_full_ * kRebuildRemovedShare >=
+             entries_.load(std::memory_order_relaxed);
+}
+
+void DBFilter::BeginRebuild() {
+  MutexLock l(&mutex_);
+  assert(!rebuilding_);
+  rebuilding_ = true;
+}
+
+Status DBFilter::Rebuild(const std::vector<Iterator*>& iters,
+                         SequenceNumber sequence) {
+  DBFilter fresh(bytes_, fingerprint_bits_);
+  Status s;
+  for (Iterator* iter : iters) {
+    if (s.ok()) {
+      s = fresh.AddAll(iter, sequence);
+    }
+  }
+
+  MutexLock l(&mutex_);
+  MutexLock fresh_lock(&fresh.mutex_);
+  assert(rebuilding_);
+  if (s.ok()) {
+    for (uint64_t hash : rebuild_inserts_) {
+      fresh.Insert(hash);
+    }
+    // After the inserts, since a record may be added and dropped again
+    // while the iterators run.
+    for (uint64_t hash : rebuild_removes_) {
+      fresh.RemoveOne(hash);
+    }
+    if (fresh.full()) {
+      s = Status::NotSupported("db filter is full");
+    }
+  }
+  rebuilding_ = false;
+  rebuild_inserts_.clear();
+  rebuild_removes_.clear();
+  removed_since_full_ = 0;
+  if (!s.ok()) {
+    return s;
+  }
+
+  // Readers match every key while either table is full, so the tables
+  // that are not full are replaced first and a full one last, which
+  // clears its flag only once every bucket is in place.
+  std::string contents, counted_contents;
+  fresh.table_.EncodeTo(&contents);
+  fresh.counted_.EncodeTo(&counted_contents);
+  if (table_.full()) {
+    counted_.DecodeFrom(counted_contents);
+    table_.DecodeFrom(contents);
+  } else {
+    table_.DecodeFrom(contents);
+    counted_.DecodeFrom(counted_contents);
+  }
+  counts_.swap(fresh.counts_);
+  entries_.store(fresh.entries(), std::memory_order_relaxed);
+  return s;
+}
+
+size_t DBFilter::ApproximateMemoryUsage() {
+  MutexLock l(&mutex_);
+  return table_.ApproximateMemoryUsage() + counted_.ApproximateMemoryUsage() +
+         counts_.size() * (sizeof(uint64_t) + sizeof(uint32_t) +
+                           2 * sizeof(void*));
+}
+
+Status DBFilter::Save(Env* env, const std::string& fname,
+                      SequenceNumber sequence) {
+  std::string contents;
+  {
+    MutexLock l(&mutex_);
+    std::string table, counted;
+    if (!table_.EncodeTo(&table) || !counted_.EncodeTo(&counted)) {
+      return Status::NotSupported("db filter is full");
+    }
+    PutLengthPrefixedSlice(&contents, table);
+    PutLengthPrefixedSlice(&contents, counted);
+    for (const auto& count : counts_) {
+      PutFixed64(&contents, count.first);
+      PutFixed32(&contents, count.second);
+    }
+    PutFixed64(&contents, entries_.load(std::memory_order_relaxed));
+  }
+  PutFixed64(&contents, sequence);
+  PutFixed32(&contents,
+             crc32c::Mask(crc32c::Value(contents.data(), contents.size())));
+  PutFixed64(&contents, kDBFilterMagic);
+
+  const std::string tmp = fname + ".tmp";
+  Status s = WriteStringToFileSync(env, contents, tmp);
+  if (s.ok()) {
+    s = env->RenameFile(tmp, fname);
+  }
+  if (!s.ok()) {
+    env->RemoveFile(tmp);
+  }
+  return s;
+}
+
+Status DBFilter::Load(Env* env, const std::string& fname,
+                      SequenceNumber sequence) {
+  std::string contents;
+  Status s = ReadFileToString(env, fname, &contents);
+  if (!s.ok()) {
+    return s;
+  }
+  if (contents.size() < kTrailerSize ||
+      DecodeFixed64(contents.data() + contents.size() - 8) != kDBFilterMagic) {
+    return Status::Corruption(fname, "not a db filter");
+  }
+  const char* trailer = contents.data() + contents.size() - kTrailerSize;
+  const uint32_t crc = crc32c::Unmask(DecodeFixed32(trailer + 16));
+  if (crc != crc32c::Value(contents.data(), trailer + 16 - contents.data())) {
+    return Status::Corruption(fname, "checksum mismatch");
+  }
+  if (DecodeFixed64(trailer + 8) != sequence) {
+    return Status::InvalidArgument(fname, "saved at another sequence");
+  }
+
+  Slice input(contents.data(), trailer - contents.data());
+  Slice table, counted;
+  if (!GetLengthPrefixedSlice(&input, &table) ||
+      !GetLengthPrefixedSlice(&input, &counted) ||
+      input.size() % kCountSize != 0) {
+    return Status::Corruption(fname, "bad db filter contents");
+  }
+  MutexLock l(&mutex_);
+  if (!table_.DecodeFrom(table) || !counted_.DecodeFrom(counted)) {
+    return Status::InvalidArgument(fname, "saved with another size");
+  }
+  counts_.clear();
+  for (const char* p = input.data(); p < input.data() + input.size();
+       p += kCountSize) {
+    counts_[DecodeFixed64(p)] = DecodeFixed32(p + 8);
+  }
+  entries_.store(DecodeFixed64(trailer), std::memory_order_relaxed);
+  return Status::OK();
+}
+
+}  // namespace leveldb
@@ -0,0 +1,121 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Thread-safe (provides internal synchronization)
+
+#ifndef STORAGE_LEVELDB_DB_DB_FILTER_H_
+#define STORAGE_LEVELDB_DB_DB_FILTER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "leveldb/status.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/wormhole.h"
+
+namespace leveldb {
+
+class Env;
+class Iterator;
+class WriteBatch;
+
+// A filter over the user keys of every record of a database, in its
+// memtables and in its tables (see Options::db_filter_size).  The filter
+// counts the records of every key, and a compaction takes out every record
+// it drops, so a key stops matching once no record of it is left.  Only the
+// first record of a key takes a fingerprint in the main table; the others
+// are counted by exact hash on the side, with one fingerprint per counted
+// key in a smaller second table, so a key written many times costs no more
+// room than one written twice.  Lookups never block; changes are
+// serialized.
+class DBFilter {
+ public:
+  DBFilter(size_t bytes, int fingerprint_bits);
+
+  DBFilter(const DBFilter&) = delete;
+  DBFilter& operator=(const DBFilter&) = delete;
+
+  static uint64_t Hash(const Slice& user_key) { return WormholeHash(user_key); }
+
+  // Adds every record of *batch.
+  void AddBatch(const WriteBatch* batch);
+
+  // Adds every record of *iter, whose keys are internal keys, up to
+  // "sequence".
+  Status AddAll(Iterator* iter, SequenceNumber sequence);
+
+  // Takes out one record per hash, as returned by Hash(), of records that
+  // are gone from the database.
+  void Remove(const std::vector<uint64_t>& hashes);
+
+  bool KeyMayMatch(const Slice& user_key) const {
+    const uint64_t hash = Hash(user_key);
+    return table_.MayMatch(hash) || counted_.MayMatch(hash);
+  }
+
+  // Number of records in the filter.
+  uint64_t entries() const { return entries_.load(std::memory_order_relaxed); }
+
+  // True once a record found no room.  The filter then matches every key
+  // until Rebuild() succeeds.
+  bool full() const { return table_.full() || counted_.full(); }
+
+  // True if the filter is full and enough of its records are gone since
+  // that a rebuild may make it fit again.
+  bool NeedsRebuild();
+
+  // Starts recording the records added and taken out, for Rebuild() to
+  // replay.
+  // REQUIRES: Every record added so far is in the database at the current
+  // last sequence, and no record is being added.
+  void BeginRebuild();
+
+  // Refills the filter from *iters, every record of the database at the
+  // last sequence "sequence" of BeginRebuild(), then replays the changes
+  // since.  Keeps the filter full if the records still do not fit or if
+  // an iterator fails.
+  Status Rebuild(const std::vector<Iterator*>& iters, SequenceNumber sequence);
+
+  size_t ApproximateMemoryUsage();
+
+  // Writes the filter to "fname", recording that it covers every record
+  // up to "sequence".  Fails if the filter is full.
+  Status Save(Env* env, const std::string& fname, SequenceNumber sequence);
+
+  // Replaces the contents of the filter with the copy in "fname" if it was
+  // saved by a filter of the same geometry at "sequence".  The contents are
+  // unspecified if it fails.
+  Status Load(Env* env, const std::string& fname, SequenceNumber sequence);
+
+ private:
+  class Inserter;
+
+  void Insert(uint64_t hash) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void RemoveOne(uint64_t hash) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  const size_t bytes_;
+  const int fingerprint_bits_;
+  port::Mutex mutex_;  // Serializes changes
+  // One fingerprint per key with a record...
+  WormholeTable table_;
+  // ...and one per key in counts_, whose records take no room in table_.
+  WormholeTable counted_;
+  // Records of a key besides the one that took its fingerprint in table_
+  std::unordered_map<uint64_t, uint32_t> counts_ GUARDED_BY(mutex_);
+  std::atomic<uint64_t> entries_;
+  uint64_t removed_since_full_ GUARDED_BY(mutex_);
+  bool rebuilding_ GUARDED_BY(mutex_);
+  // Changes since BeginRebuild()
+  std::vector<uint64_t> rebuild_inserts_ GUARDED_BY(mutex_);
+  std::vector<uint64_t> rebuild_removes_ GUARDED_BY(mutex_);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_DB_FILTER_H_
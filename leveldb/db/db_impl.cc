@@ -8,11 +8,13 @@
 #include <atomic>
 #include <cstdint>
 #include <cstdio>
+#include <memory>
 #include <set>
 #include <string>
 #include <vector>
 
 #include "db/builder.h"
+#include "db/db_filter.h"
 #include "db/db_iter.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
@@ -34,6 +36,8 @@
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/perf_context_imp.h"
+#include "util/wormhole.h"
 
 namespace leveldb {
 
@@ -78,6 +82,10 @@ struct DBImpl::CompactionState {
 
   std::vector<Output> outputs;
 
+  // Hashes of the user keys of dropped records, which leave the db filter
+  // once the compaction is installed.
+  std::vector<uint64_t> dropped_hashes;
+
   // State kept for output being generated
   WritableFile* outfile;
   TableBuilder* builder;
@@ -85,6 +93,29 @@ struct DBImpl::CompactionState {
   uint64_t total_bytes;
 };
 
+// The database at the start of a db filter rebuild, held until the
+// rebuild has read it
+struct DBImpl::DBFilterRebuild {
+  DBFilterRebuild(MemTable* m, MemTable* i, Version* v, SequenceNumber seq)
+      : mem(m), imm(i), version(v), sequence(seq) {
+    mem->Ref();
+    if (imm != nullptr) imm->Ref();
+    version->Ref();
+  }
+
+  // REQUIRES: The db mutex is held
+  void Unref() {
+    mem->Unref();
+    if (imm != nullptr) imm->Unref();
+    version->Unref();
+  }
+
+  MemTable* const mem;
+  MemTable* const imm;
+  Version* const version;
+  const SequenceNumber sequence;
+};
+
 // Fix user-supplied options to be reasonable
 template <class T, class V>
 static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
@@ -94,10 +125,13 @@ static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
 Options SanitizeOptions(const std::string& dbname,
                         const InternalKeyComparator* icmp,
                         const InternalFilterPolicy* ipolicy,
+                        const InternalSliceTransform* iprefix,
                         const Options& src) {
   Options result = src;
   result.comparator = icmp;
   result.filter_policy = (src.filter_policy != nullptr) ? ipolicy : nullptr;
+  result.prefix_extractor =
+      (src.prefix_extractor != nullptr) ? iprefix : nullptr;
   ClipToRange(&result.max_open_files, 64 + kNumNonTableCacheFiles, 50000);
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
@@ -127,8 +161,10 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
       internal_filter_policy_(raw_options.filter_policy),
+      internal_prefix_extractor_(raw_options.prefix_extractor),
       options_(SanitizeOptions(dbname, &internal_comparator_,
-                               &internal_filter_policy_, raw_options)),
+                               &internal_filter_policy_,
+                               &internal_prefix_extractor_, raw_options)),
       owns_info_log_(options_.info_log != raw_options.info_log),
       owns_cache_(options_.block_cache != raw_options.block_cache),
       dbname_(dbname),
@@ -138,6 +174,9 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       background_work_finished_signal_(&mutex_),
       mem_(nullptr),
       imm_(nullptr),
+      db_filter_(nullptr),
+      db_filter_rebuild_wanted_(false),
+      db_filter_rebuild_(nullptr),
       has_imm_(false),
       logfile_(nullptr),
       logfile_number_(0),
@@ -147,7 +186,17 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       background_compaction_scheduled_(false),
       manual_compaction_(nullptr),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
-                               &internal_comparator_)) {}
+                               &internal_comparator_)) {
+  for (int level = 0; level < config::kNumLevels; level++) {
+    const FilterPolicy* policy = nullptr;
+    if (options_.filter_policy != nullptr &&
+        level < static_cast<int>(options_.level_filter_policies.size())) {
+      policy = options_.level_filter_policies[level];
+    }
+    level_filter_policies_[level] =
+        policy != nullptr ? new InternalFilterPolicy(policy) : nullptr;
+  }
+}
 
 DBImpl::~DBImpl() {
   // Wait for background work to finish.
@@ -156,6 +205,20 @@ DBImpl::~DBImpl() {
   while (background_compaction_scheduled_) {
     background_work_finished_signal_.Wait();
   }
+  if (db_filter_rebuild_ != nullptr) {
+    // Never started, and the filter is full so it is not saved below
+    db_filter_rebuild_->Unref();
+    delete db_filter_rebuild_;
+  }
+  if (db_filter_ != nullptr) {
+    // Covers every record up to the last sequence, so the next open can
+    // skip rebuilding it unless the database changes in between.
+    Status s = db_filter_->Save(env_, DBFilterFileName(DBFilterDir()),
+                                versions_->LastSequence());
+    if (!s.ok()) {
+      Log(options_.info_log, "DB filter not saved: %s", s.ToString().c_str());
+    }
+  }
   mutex_.Unlock();
 
   if (db_lock_ != nullptr) {
@@ -169,6 +232,10 @@ DBImpl::~DBImpl() {
   delete log_;
   delete logfile_;
   delete table_cache_;
+  delete db_filter_;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    delete level_filter_policies_[level];
+  }
 
   if (owns_info_log_) {
     delete options_.info_log;
@@ -222,6 +289,25 @@ void DBImpl::MaybeIgnoreError(Status* s) const {
   }
 }
 
+// Removes every filter file in "filter_dir", including a saved db filter.
+static Status RemoveFilterFiles(Env* env, const std::string& filter_dir) {
+  std::vector<std::string> filenames;
+  env->GetChildren(filter_dir, &filenames);  // Ignoring errors on purpose
+  uint64_t number;
+  FileType type;
+  Status result;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (ParseFileName(filenames[i], &number, &type) &&
+        (type == kFilterFile || type == kDBFilterFile)) {
+      Status del = env->RemoveFile(filter_dir + "/" + filenames[i]);
+      if (result.ok() && !del.ok()) {
+        result = del;
+      }
+    }
+  }
+  return result;
+}
+
 void DBImpl::RemoveObsoleteFiles() {
   mutex_.AssertHeld();
 
@@ -261,9 +347,14 @@ void DBImpl::RemoveObsoleteFiles() {
           // be recorded in pending_outputs_, which is inserted into "live"
           keep = (live.find(number) != live.end());
           break;
+        case kFilterFile:
+          // Filter files live and die with their tables
+          keep = (live.find(number) != live.end());
+          break;
         case kCurrentFile:
         case kDBLockFile:
         case kInfoLogFile:
+        case kDBFilterFile:
           keep = true;
           break;
       }
@@ -279,6 +370,22 @@ void DBImpl::RemoveObsoleteFiles() {
     }
   }
 
+  // Filter files kept outside the db directory
+  std::vector<std::string> filter_files_to_delete;
+  const std::string& filter_dir = options_.filter_dir;
+  if (!filter_dir.empty() && filter_dir != dbname_) {
+    filenames.clear();
+    env_->GetChildren(filter_dir, &filenames);  // Ignoring errors on purpose
+    for (std::string& filename : filenames) {
+      if (ParseFileName(filename, &number, &type) && type == kFilterFile &&
+          live.find(number) == live.end()) {
+        filter_files_to_delete.push_back(std::move(filename));
+        Log(options_.info_log, "Delete type=%d #%lld\n",
+            static_cast<int>(type), static_cast<unsigned long long>(number));
+      }
+    }
+  }
+
   // While deleting all files unblock other threads. All files being deleted
   // have unique names which will not collide with newly created files and
   // are therefore safe to delete while allowing other threads to proceed.
@@ -286,6 +393,9 @@ void DBImpl::RemoveObsoleteFiles() {
   for (const std::string& filename : files_to_delete) {
     env_->RemoveFile(dbname_ + "/" + filename);
   }
+  for (const std::string& filename : filter_files_to_delete) {
+    env_->RemoveFile(filter_dir + "/" + filename);
+  }
   mutex_.Lock();
 }
 
@@ -296,6 +406,9 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
   // committed only when the descriptor is created, and this directory
   // may already exist from a previous failed creation attempt.
   env_->CreateDir(dbname_);
+  if (!options_.filter_dir.empty()) {
+    env_->CreateDir(options_.filter_dir);
+  }
   assert(db_lock_ == nullptr);
   Status s = env_->LockFile(LockFileName(dbname_), &db_lock_);
   if (!s.ok()) {
@@ -310,6 +423,16 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
       if (!s.ok()) {
         return s;
       }
+      // Likewise for the db filter of an earlier database
+      env_->RemoveFile(DBFilterFileName(dbname_));
+      if (!options_.filter_dir.empty()) {
+        // Filter files of an earlier database would be taken for the
+        // filters of the new tables with the same numbers.
+        s = RemoveFilterFiles(env_, options_.filter_dir);
+        if (!s.ok()) {
+          return s;
+        }
+      }
     } else {
       return Status::InvalidArgument(
           dbname_, "does not exist (create_if_missing is false)");
@@ -438,7 +561,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     WriteBatchInternal::SetContents(&batch, record);
 
     if (mem == nullptr) {
-      mem = new MemTable(internal_comparator_);
+      mem = NewMemTable();
       mem->Ref();
     }
     status = WriteBatchInternal::InsertInto(&batch, mem);
@@ -484,7 +607,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
         mem = nullptr;
       } else {
         // mem can be nullptr if lognum exists but was empty.
-        mem_ = new MemTable(internal_comparator_);
+        mem_ = NewMemTable();
         mem_->Ref();
       }
     }
@@ -502,6 +625,78 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   return status;
 }
 
+// Fingerprint bits of the in-memory filters: those of the table filters if
+// they are wormhole filters too.
+static int InMemoryFilterFingerprintBits(const InternalFilterPolicy& policy) {
+  int fingerprint_bits = WormholeFingerprintBits(policy.user_policy());
+  return fingerprint_bits > 0 ? fingerprint_bits : 12;
+}
+
+Options DBImpl::TableOptions(int level, bool bottommost) const {
+  Options options = options_;
+  if (bottommost && options_.optimize_filters_for_hits) {
+    options.filter_policy = nullptr;
+  } else if (level_filter_policies_[level] != nullptr) {
+    options.filter_policy = level_filter_policies_[level];
+  }
+  return options;
+}
+
+MemTable* DBImpl::NewMemTable() const {
+  size_t filter_bytes = 0;
+  if (options_.memtable_filter_size_ratio > 0) {
+    filter_bytes = static_cast<size_t>(options_.write_buffer_size *
+                                       options_.memtable_filter_size_ratio);
+  }
+  return new MemTable(internal_comparator_, filter_bytes,
+                      InMemoryFilterFingerprintBits(internal_filter_policy_));
+}
+
+Status DBImpl::OpenDBFilter() {
+  mutex_.AssertHeld();
+  assert(db_filter_ == nullptr);
+  DBFilter* filter = new DBFilter(
+      options_.db_filter_size,
+      InMemoryFilterFingerprintBits(internal_filter_policy_));
+  const std::string fname = DBFilterFileName(DBFilterDir());
+  Status s = filter->Load(env_, fname, versions_->LastSequence());
+  if (s.ok()) {
+    Log(options_.info_log, "DB filter: loaded %llu records",
+        static_cast<unsigned long long>(filter->entries()));
+    db_filter_ = filter;
+    return s;
+  }
+  if (!s.IsNotFound()) {
+    Log(options_.info_log, "DB filter: %s", s.ToString().c_str());
+  }
+  delete filter;
+  filter = new DBFilter(options_.db_filter_size,
+                        InMemoryFilterFingerprintBits(internal_filter_policy_));
+
+  // Every recovered record is in a table or in mem_
+  ReadOptions options;
+  options.fill_cache = false;
+  std::vector<Iterator*> list;
+  list.push_back(mem_->NewIterator());
+  versions_->current()->AddIterators(options, &list);
+  s = Status::OK();
+  for (Iterator* iter : list) {
+    if (s.ok()) {
+      s = filter->AddAll(iter, kMaxSequenceNumber);
+    }
+    delete iter;
+  }
+  if (!s.ok()) {
+    delete filter;
+    return s;
+  }
+  Log(options_.info_log, "DB filter: rebuilt from %llu records%s",
+      static_cast<unsigned long long>(filter->entries()),
+      filter->full() ? ", too many for its size" : "");
+  db_filter_ = filter;
+  return s;
+}
+
 Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
                                 Version* base) {
   mutex_.AssertHeld();
@@ -513,10 +708,34 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long)meta.number);
 
+  // Pick the level before building the table, which gets the filter
+  // policy of that level
+  int level = 0;
+  iter->SeekToFirst();
+  if (base != nullptr && iter->Valid()) {
+    const std::string min_user_key = ExtractUserKey(iter->key()).ToString();
+    iter->SeekToLast();
+    level = base->PickLevelForMemTableOutput(min_user_key,
+                                             ExtractUserKey(iter->key()));
+  }
+  const Options table_options = TableOptions(
+      level, (base != nullptr ? base : versions_->current())
+                 ->IsBottommostLevel(level));
+
+  // The memtable filter already holds every user key of the table, so it
+  // can stand in for a full filter built by the same policy.
+  std::string filter;
+  if (options_.full_filter && options_.filter_partition_keys <= 0 &&
+      table_options.filter_policy == options_.filter_policy &&
+      WormholeFingerprintBits(internal_filter_policy_.user_policy()) > 0) {
+    mem->EncodeFilter(&filter);
+  }
+
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, table_options, table_cache_, iter, &meta,
+                   filter);
     mutex_.Lock();
   }
 
@@ -528,13 +747,7 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
-  int level = 0;
   if (s.ok() && meta.file_size > 0) {
-    const Slice min_user_key = meta.smallest.user_key();
-    const Slice max_user_key = meta.largest.user_key();
-    if (base != nullptr) {
-      level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
-    }
     edit->AddFile(level, meta.number, meta.file_size, meta.smallest,
                   meta.largest);
   }
@@ -668,7 +881,7 @@ void DBImpl::MaybeScheduleCompaction() {
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
   } else if (imm_ == nullptr && manual_compaction_ == nullptr &&
-             !versions_->NeedsCompaction()) {
+             db_filter_rebuild_ == nullptr && !versions_->NeedsCompaction()) {
     // No work to be done
   } else {
     background_compaction_scheduled_ = true;
@@ -687,8 +900,12 @@ void DBImpl::BackgroundCall() {
     // No more background work when shutting down.
   } else if (!bg_error_.ok()) {
     // No more background work after a background error.
+  } else if (db_filter_rebuild_ != nullptr && imm_ == nullptr &&
+             manual_compaction_ == nullptr) {
+    RebuildDBFilter();
   } else {
     BackgroundCompaction();
+    MaybeRebuildDBFilter();
   }
 
   background_compaction_scheduled_ = false;
@@ -817,7 +1034,10 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   std::string fname = TableFileName(dbname_, file_number);
   Status s = env_->NewWritableFile(fname, &compact->outfile);
   if (s.ok()) {
-    compact->builder = new TableBuilder(options_, compact->outfile);
+    compact->builder = new TableBuilder(
+        TableOptions(compact->compaction->level() + 1,
+                     compact->compaction->IsBottommostLevel()),
+        compact->outfile);
   }
   return s;
 }
@@ -858,7 +1078,8 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   if (s.ok() && current_entries > 0) {
     // Verify that the table is usable
     Iterator* iter =
-        table_cache_->NewIterator(ReadOptions(), output_number, current_bytes);
+        table_cache_->NewIterator(ReadOptions(), output_number, current_bytes,
+                                  nullptr, compact->compaction->level() + 1);
     s = iter->status();
     delete iter;
     if (s.ok()) {
@@ -975,6 +1196,9 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       }
 
       last_sequence_for_key = ikey.sequence;
+      if (drop && db_filter_ != nullptr) {
+        compact->dropped_hashes.push_back(DBFilter::Hash(ikey.user_key));
+      }
     }
 #if 0
     Log(options_.info_log,
@@ -1042,6 +1266,11 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok()) {
     status = InstallCompactionResults(compact);
   }
+  if (status.ok() && db_filter_ != nullptr) {
+    // Only now are the dropped records gone from every version that a
+    // later read can start from.
+    db_filter_->Remove(compact->dropped_hashes);
+  }
   if (!status.ok()) {
     RecordBackgroundError(status);
   }
@@ -1112,10 +1341,91 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
   return versions_->MaxNextLevelOverlappingBytes();
 }
 
+bool DBImpl::TEST_DBFilterFull() {
+  MutexLock l(&mutex_);
+  while (db_filter_rebuild_ != nullptr && bg_error_.ok()) {
+    background_work_finished_signal_.Wait();
+  }
+  return db_filter_ != nullptr && db_filter_->full();
+}
+
+// MemTable::Get() timed as "metric" of the thread's perf context.
+static bool TimedMemTableGet(MemTable* mem, const LookupKey& key,
+                             std::string* value, Status* s,
+                             uint64_t PerfContext::*metric) {
+  PerfTimer timer(metric);
+  return mem->Get(key, value, s);
+}
+
+bool DBImpl::DBFilterMayMatch(const Slice& key) const {
+  if (db_filter_ == nullptr) {
+    return true;
+  }
+  PerfTimer timer(&PerfContext::filter_probe_nanos);
+  PerfCount(&PerfContext::filter_probe_count);
+  return db_filter_->KeyMayMatch(key);
+}
+
+void DBImpl::MaybeRebuildDBFilter() {
+  mutex_.AssertHeld();
+  if (db_filter_ == nullptr || db_filter_rebuild_ != nullptr ||
+      db_filter_rebuild_wanted_ || !db_filter_->NeedsRebuild()) {
+    return;
+  }
+  if (writers_.empty()) {
+    BeginDBFilterRebuild();
+  } else {
+    db_filter_rebuild_wanted_ = true;
+  }
+}
+
+void DBImpl::BeginDBFilterRebuild() {
+  mutex_.AssertHeld();
+  assert(db_filter_rebuild_ == nullptr);
+  // Every record written so far is in mem_, imm_ or current() at the last
+  // sequence, and every later one is recorded by the filter.
+  db_filter_->BeginRebuild();
+  db_filter_rebuild_ = new DBFilterRebuild(
+      mem_, imm_, versions_->current(), versions_->LastSequence());
+  MaybeScheduleCompaction();
+}
+
+void DBImpl::RebuildDBFilter() {
+  mutex_.AssertHeld();
+  DBFilterRebuild* rebuild = db_filter_rebuild_;
+  ReadOptions options;
+  options.fill_cache = false;
+  std::vector<Iterator*> list;
+  list.push_back(rebuild->mem->NewIterator());
+  if (rebuild->imm != nullptr) {
+    list.push_back(rebuild->imm->NewIterator());
+  }
+  rebuild->version->AddIterators(options, &list);
+
+  mutex_.Unlock();
+  const uint64_t start_micros = env_->NowMicros();
+  Status s = db_filter_->Rebuild(list, rebuild->sequence);
+  for (Iterator* iter : list) {
+    delete iter;
+  }
+  Log(options_.info_log, "DB filter: rebuilt from %llu records in %llu us: %s",
+      static_cast<unsigned long long>(db_filter_->entries()),
+      static_cast<unsigned long long>(env_->NowMicros() - start_micros),
+      s.ToString().c_str());
+  mutex_.Lock();
+
+  rebuild->Unref();
+  delete rebuild;
+  db_filter_rebuild_ = nullptr;
+}
+
 Status DBImpl::Get(const ReadOptions& options, const Slice& key,
                    std::string* value) {
+  PerfTimer get_timer(&PerfContext::get_nanos);
   Status s;
+  PerfTimer mutex_timer(&PerfContext::mutex_wait_nanos);
   MutexLock l(&mutex_);
+  mutex_timer.Stop();
   SequenceNumber snapshot;
   if (options.snapshot != nullptr) {
     snapshot =
@@ -1139,14 +1449,21 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
     mutex_.Unlock();
     // First look in the memtable, then in the immutable memtable (if any).
     LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
+    if (!DBFilterMayMatch(key)) {
+      s = Status::NotFound(Slice());
+    } else if (TimedMemTableGet(mem, lkey, value, &s,
+                                &PerfContext::memtable_get_nanos)) {
       // Done
-    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
+    } else if (imm != nullptr &&
+               TimedMemTableGet(imm, lkey, value, &s,
+                                &PerfContext::imm_get_nanos)) {
       // Done
     } else {
+      PerfTimer timer(&PerfContext::version_get_nanos);
       s = current->Get(options, lkey, value, &stats);
       have_stat_update = true;
     }
+    PerfTimer relock_timer(&PerfContext::mutex_wait_nanos);
     mutex_.Lock();
   }
 
@@ -1159,6 +1476,72 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
   return s;
 }
 
+void DBImpl::MultiGet(const ReadOptions& options, const Slice* keys,
+                      size_t n, std::string* values, Status* statuses) {
+  MutexLock l(&mutex_);
+  SequenceNumber snapshot;
+  if (options.snapshot != nullptr) {
+    snapshot =
+        static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
+  } else {
+    snapshot = versions_->LastSequence();
+  }
+
+  MemTable* mem = mem_;
+  MemTable* imm = imm_;
+  Version* current = versions_->current();
+  mem->Ref();
+  if (imm != nullptr) imm->Ref();
+  current->Ref();
+
+  std::vector<Version::GetStats> stats;
+
+  // Unlock while reading from files and memtables
+  {
+    mutex_.Unlock();
+    std::vector<std::unique_ptr<LookupKey>> lkeys(n);
+    std::vector<const LookupKey*> file_keys;
+    std::vector<std::string*> file_values;
+    std::vector<Status*> file_statuses;
+    for (size_t i = 0; i < n; i++) {
+      lkeys[i].reset(new LookupKey(keys[i], snapshot));
+      statuses[i] = Status();
+      if (!DBFilterMayMatch(keys[i])) {
+        statuses[i] = Status::NotFound(Slice());
+      } else if (mem->Get(*lkeys[i], &values[i], &statuses[i])) {
+        // Done
+      } else if (imm != nullptr && imm->Get(*lkeys[i], &values[i],
+                                            &statuses[i])) {
+        // Done
+      } else {
+        file_keys.push_back(lkeys[i].get());
+        file_values.push_back(&values[i]);
+        file_statuses.push_back(&statuses[i]);
+      }
+    }
+    if (!file_keys.empty()) {
+      stats.resize(file_keys.size());
+      current->MultiGet(options, file_keys.data(), file_keys.size(),
+                        file_values.data(), file_statuses.data(),
+                        stats.data());
+    }
+    mutex_.Lock();
+  }
+
+  bool need_compaction = false;
+  for (size_t i = 0; i < stats.size(); i++) {
+    if (current->UpdateStats(stats[i])) {
+      need_compaction = true;
+    }
+  }
+  if (need_compaction) {
+    MaybeScheduleCompaction();
+  }
+  mem->Unref();
+  if (imm != nullptr) imm->Unref();
+  current->Unref();
+}
+
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
@@ -1168,7 +1551,10 @@ Iterator* DBImpl::NewIterator(const ReadOptions& options) {
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
                             : latest_snapshot),
-                       seed);
+                       seed,
+                       options.prefix_same_as_start
+                           ? internal_prefix_extractor_.user_transform()
+                           : nullptr);
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1211,6 +1597,11 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   if (w.done) {
     return w.status;
   }
+  if (db_filter_rebuild_wanted_) {
+    // Nothing is being added to db_filter_ while this writer leads
+    db_filter_rebuild_wanted_ = false;
+    BeginDBFilterRebuild();
+  }
 
   // May temporarily unlock and wait.
   Status status = MakeRoomForWrite(updates == nullptr);
@@ -1227,6 +1618,11 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
     // into mem_.
     {
       mutex_.Unlock();
+      // Before the log write: a record that recovery may find must never
+      // be missing from the filter.
+      if (db_filter_ != nullptr) {
+        db_filter_->AddBatch(write_batch);
+      }
       status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
       bool sync_error = false;
       if (status.ok() && options.sync) {
@@ -1389,7 +1785,7 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       log_ = new log::Writer(lfile);
       imm_ = mem_;
       has_imm_.store(true, std::memory_order_release);
-      mem_ = new MemTable(internal_comparator_);
+      mem_ = NewMemTable();
       mem_->Ref();
       force = false;  // Do not force another compaction if have room
       MaybeScheduleCompaction();
@@ -1442,6 +1838,37 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   } else if (in == "sstables") {
     *value = versions_->current()->DebugString();
     return true;
+  } else if (in == "block-cache-stats") {
+    table_cache_->stats().AppendCacheStats(value);
+    char buf[100];
+    std::snprintf(buf, sizeof(buf), "Block cache usage: %llu bytes\n",
+                  static_cast<unsigned long long>(
+                      options_.block_cache->TotalCharge()));
+    value->append(buf);
+    return true;
+  } else if (in == "filter-stats") {
+    table_cache_->stats().AppendFilterStats(value);
+    return true;
+  } else if (in == "data-block-lookups") {
+    const TableStats& stats = table_cache_->stats();
+    char buf[50];
+    std::snprintf(
+        buf, sizeof(buf), "%llu",
+        static_cast<unsigned long long>(
+            stats.cache_hits[kDataBlockKind].load(std::memory_order_relaxed) +
+            stats.cache_misses[kDataBlockKind].load(
+                std::memory_order_relaxed)));
+    value->append(buf);
+    return true;
+  } else if (in == "db-filter-entries") {
+    if (db_filter_ == nullptr) {
+      return false;
+    }
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(db_filter_->entries()));
+    value->append(buf);
+    return true;
   } else if (in == "approximate-memory-usage") {
     size_t total_usage = options_.block_cache->TotalCharge();
     if (mem_) {
@@ -1450,6 +1877,9 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
     if (imm_) {
       total_usage += imm_->ApproximateMemoryUsage();
     }
+    if (db_filter_) {
+      total_usage += db_filter_->ApproximateMemoryUsage();
+    }
     char buf[50];
     std::snprintf(buf, sizeof(buf), "%llu",
                   static_cast<unsigned long long>(total_usage));
@@ -1492,6 +1922,21 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+void DB::MultiGet(const ReadOptions& options, const Slice* keys, size_t n,
+                  std::string* values, Status* statuses) {
+  // Read every key as of the same snapshot
+  ReadOptions snapshot_options = options;
+  if (options.snapshot == nullptr) {
+    snapshot_options.snapshot = GetSnapshot();
+  }
+  for (size_t i = 0; i < n; i++) {
+    statuses[i] = Get(snapshot_options, keys[i], &values[i]);
+  }
+  if (options.snapshot == nullptr) {
+    ReleaseSnapshot(snapshot_options.snapshot);
+  }
+}
+
 DB::~DB() = default;
 
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
@@ -1514,7 +1959,7 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
       impl->log_ = new log::Writer(lfile);
-      impl->mem_ = new MemTable(impl->internal_comparator_);
+      impl->mem_ = impl->NewMemTable();
       impl->mem_->Ref();
     }
   }
@@ -1523,6 +1968,9 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
     edit.SetLogNumber(impl->logfile_number_);
     s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
   }
+  if (s.ok() && options.db_filter_size > 0) {
+    s = impl->OpenDBFilter();
+  }
   if (s.ok()) {
     impl->RemoveObsoleteFiles();
     impl->MaybeScheduleCompaction();
@@ -1563,6 +2011,13 @@ Status DestroyDB(const std::string& dbname, const Options& options) {
         }
       }
     }
+    if (!options.filter_dir.empty() && options.filter_dir != dbname) {
+      Status del = RemoveFilterFiles(env, options.filter_dir);
+      if (result.ok() && !del.ok()) {
+        result = del;
+      }
+      env->RemoveDir(options.filter_dir);  // Ignore error as for dbname
+    }
     env->UnlockFile(lock);  // Ignore error since state is already gone
     env->RemoveFile(lockname);
     env->RemoveDir(dbname);  // Ignore error in case dir contains other files
@@ -20,6 +20,7 @@
 
 namespace leveldb {
 
+class DBFilter;
 class MemTable;
 class TableCache;
 class Version;
@@ -42,6 +43,8 @@ class DBImpl : public DB {
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
+  void MultiGet(const ReadOptions& options, const Slice* keys, size_t n,
+                std::string* values, Status* statuses) override;
   Iterator* NewIterator(const ReadOptions&) override;
   const Snapshot* GetSnapshot() override;
   void ReleaseSnapshot(const Snapshot* snapshot) override;
@@ -66,6 +69,10 @@ class DBImpl : public DB {
   // file at a level >= 1.
   int64_t TEST_MaxNextLevelOverlappingBytes();
 
+  // Waits for a pending rebuild of the db filter, then returns true if the
+  // filter is full.
+  bool TEST_DBFilterFull();
+
   // Record a sample of bytes read at the specified internal key.
   // Samples are taken approximately once every config::kReadBytesPeriod
   // bytes.
@@ -74,6 +81,7 @@ class DBImpl : public DB {
  private:
   friend class DB;
   struct CompactionState;
+  struct DBFilterRebuild;
   struct Writer;
 
   // Information for a manual compaction
@@ -130,6 +138,39 @@ class DBImpl : public DB {
   Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Returns the options of the tables written to "level", whose filter
+  // policy may differ from that of options_.  "bottommost" tells if no
+  // level below "level" holds data.
+  Options TableOptions(int level, bool bottommost) const;
+
+  // Returns a new memtable, with a filter if options_ ask for one.
+  MemTable* NewMemTable() const;
+
+  // Directory of the saved db filter.
+  const std::string& DBFilterDir() const {
+    return options_.filter_dir.empty() ? dbname_ : options_.filter_dir;
+  }
+
+  // Sets up db_filter_ from its saved copy, or from every record of the
+  // recovered database if there is no valid saved copy.
+  Status OpenDBFilter() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Returns false if db_filter_ rules out every record of user key "key".
+  bool DBFilterMayMatch(const Slice& key) const;
+
+  // Starts a rebuild of a full db_filter_ once compactions dropped enough
+  // records: right away if no write is in flight, and at the start of the
+  // next write otherwise.
+  void MaybeRebuildDBFilter() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Takes the snapshot of the database that db_filter_ is rebuilt from.
+  // REQUIRES: No write is in flight.
+  void BeginDBFilterRebuild() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Rebuilds db_filter_ from the snapshot of BeginDBFilterRebuild(), with
+  // mutex_ released while it reads the database.
+  void RebuildDBFilter() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   WriteBatch* BuildBatchGroup(Writer** last_writer)
@@ -159,7 +200,11 @@ class DBImpl : public DB {
   Env* const env_;
   const InternalKeyComparator internal_comparator_;
   const InternalFilterPolicy internal_filter_policy_;
+  const InternalSliceTransform internal_prefix_extractor_;
   const Options options_;  // options_.comparator == &internal_comparator_
+  // Options::level_filter_policies; null for the levels that use
+  // options_.filter_policy
+  const InternalFilterPolicy* level_filter_policies_[config::kNumLevels];
   const bool owns_info_log_;
   const bool owns_cache_;
   const std::string dbname_;
@@ -176,6 +221,11 @@ class DBImpl : public DB {
   port::CondVar background_work_finished_signal_ GUARDED_BY(mutex_);
   MemTable* mem_;
   MemTable* imm_ GUARDED_BY(mutex_);  // Memtable being compacted
+  DBFilter* db_filter_;  // Set by DB::Open if options_.db_filter_size > 0
+  // Set when the next write should call BeginDBFilterRebuild()
+  bool db_filter_rebuild_wanted_ GUARDED_BY(mutex_);
+  // Snapshot that the background thread rebuilds db_filter_ from
+  DBFilterRebuild* db_filter_rebuild_ GUARDED_BY(mutex_);
   std::atomic<bool> has_imm_;         // So bg thread can detect non-null imm_
   WritableFile* logfile_;
   uint64_t logfile_number_ GUARDED_BY(mutex_);
@@ -210,6 +260,7 @@ class DBImpl : public DB {
 Options SanitizeOptions(const std::string& db,
                         const InternalKeyComparator* icmp,
                         const InternalFilterPolicy* ipolicy,
+                        const InternalSliceTransform* iprefix,
                         const Options& src);
 
 }  // namespace leveldb
@@ -9,6 +9,7 @@
 #include "db/filename.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/slice_transform.h"
 #include "port/port.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -46,13 +47,15 @@ class DBIter : public Iterator {
   enum Direction { kForward, kReverse };
 
   DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+         uint32_t seed, const SliceTransform* prefix_extractor)
       : db_(db),
         user_comparator_(cmp),
         iter_(iter),
         sequence_(s),
+        prefix_extractor_(prefix_extractor),
         direction_(kForward),
         valid_(false),
+        prefix_active_(false),
         rnd_(seed),
         bytes_until_read_sampling_(RandomCompactionPeriod()) {}
 
@@ -110,11 +113,14 @@ class DBIter : public Iterator {
   const Comparator* const user_comparator_;
   Iterator* const iter_;
   SequenceNumber const sequence_;
+  const SliceTransform* const prefix_extractor_;  // May be null
   Status status_;
   std::string saved_key_;    // == current key when direction_==kReverse
   std::string saved_value_;  // == current raw value when direction_==kReverse
   Direction direction_;
   bool valid_;
+  bool prefix_active_;  // Forward reads stop at the end of prefix_
+  std::string prefix_;
   Random rnd_;
   size_t bytes_until_read_sampling_;
 };
@@ -180,7 +186,16 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   assert(direction_ == kForward);
   do {
     ParsedInternalKey ikey;
-    if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+    const bool parsed = ParseKey(&ikey);
+    if (parsed && prefix_active_ &&
+        (!prefix_extractor_->InDomain(ikey.user_key) ||
+         prefix_extractor_->Transform(ikey.user_key) != Slice(prefix_))) {
+      // Past the last key with the prefix of the seek target
+      valid_ = false;
+      saved_key_.clear();
+      return;
+    }
+    if (parsed && ikey.sequence <= sequence_) {
       switch (ikey.type) {
         case kTypeDeletion:
           // Arrange to skip all upcoming entries for this key since
@@ -278,6 +293,12 @@ void DBIter::FindPrevUserEntry() {
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
   ClearSavedValue();
+  prefix_active_ =
+      prefix_extractor_ != nullptr && prefix_extractor_->InDomain(target);
+  if (prefix_active_) {
+    Slice prefix = prefix_extractor_->Transform(target);
+    prefix_.assign(prefix.data(), prefix.size());
+  }
   saved_key_.clear();
   AppendInternalKey(&saved_key_,
                     ParsedInternalKey(target, sequence_, kValueTypeForSeek));
@@ -292,6 +313,7 @@ void DBIter::Seek(const Slice& target) {
 void DBIter::SeekToFirst() {
   direction_ = kForward;
   ClearSavedValue();
+  prefix_active_ = false;
   iter_->SeekToFirst();
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
@@ -303,6 +325,7 @@ void DBIter::SeekToFirst() {
 void DBIter::SeekToLast() {
   direction_ = kReverse;
   ClearSavedValue();
+  prefix_active_ = false;
   iter_->SeekToLast();
   FindPrevUserEntry();
 }
@@ -311,8 +334,10 @@ void DBIter::SeekToLast() {
 
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                        uint32_t seed,
+                        const SliceTransform* prefix_extractor) {
+  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed,
+                    prefix_extractor);
 }
 
 }  // namespace leveldb
@@ -6,6 +6,10 @@
 
 #include <atomic>
 #include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
 #include <string>
 
 #include "gtest/gtest.h"
@@ -16,12 +20,15 @@
 #include "leveldb/cache.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/perf_context.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
 #include "util/hash.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/read_buffer.h"
 #include "util/testutil.h"
 
 namespace leveldb {
@@ -141,6 +148,9 @@ class SpecialEnv : public EnvWrapper {
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
 
+  // Copy random reads into heap buffers, like an Env that does not mmap.
+  bool heap_random_reads_;
+
   explicit SpecialEnv(Env* base)
       : EnvWrapper(base),
         delay_data_sync_(false),
@@ -150,7 +160,8 @@ class SpecialEnv : public EnvWrapper {
         manifest_sync_error_(false),
         manifest_write_error_(false),
         log_file_close_(false),
-        count_random_reads_(false) {}
+        count_random_reads_(false),
+        heap_random_reads_(false) {}
 
   Status NewWritableFile(const std::string& f, WritableFile** r) {
     class DataFile : public WritableFile {
@@ -249,7 +260,31 @@ class SpecialEnv : public EnvWrapper {
       }
     };
 
+    class HeapFile : public RandomAccessFile {
+     private:
+      RandomAccessFile* target_;
+
+     public:
+      explicit HeapFile(RandomAccessFile* target) : target_(target) {}
+      ~HeapFile() override { delete target_; }
+      Status Read(uint64_t offset, size_t n, Slice* result,
+                  ReadBuffer* scratch) const override {
+        ReadBuffer buffer;
+        Status s = target_->Read(offset, n, result, &buffer);
+        if (s.ok()) {
+          char* copy = static_cast<char*>(std::malloc(result->size()));
+          std::memcpy(copy, result->data(), result->size());
+          scratch->SetPtr(copy, /*aligned=*/false);
+          *result = Slice(copy, result->size());
+        }
+        return s;
+      }
+    };
+
     Status s = target()->NewRandomAccessFile(f, r);
+    if (s.ok() && heap_random_reads_) {
+      *r = new HeapFile(*r);
+    }
     if (s.ok() && count_random_reads_) {
       *r = new CountingFile(*r, &random_read_counter_);
     }
@@ -1988,6 +2023,896 @@ TEST_F(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+TEST_F(DBTest, FullFilter) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.compression = kNoCompression;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewWormholeFilterPolicy();
+  options.full_filter = true;
+  Reopen(&options);
+
+  // Populate multiple layers
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  // Lookup present keys.  Should rarely read from small sstable.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d present => %d reads\n", N, reads);
+  ASSERT_GE(reads, N);
+  ASSERT_LE(reads, N + 2 * N / 100);
+
+  // Lookup missing keys.  Should rarely read from either sstable.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Keymissing(i)));
+  }
+  reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 3 * N / 100);
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+
+  // Full filters are used regardless of the current setting.
+  options.full_filter = false;
+  Reopen(&options);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, MemTableFilter) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.compression = kNoCompression;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewWormholeFilterPolicy();
+  options.full_filter = true;
+  options.memtable_filter_size_ratio = 0.02;
+  Reopen(&options);
+
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  for (int i = 0; i < N; i += 10) {
+    ASSERT_LEVELDB_OK(Delete(Key(i)));
+  }
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(i % 10 == 0 ? "NOT_FOUND" : Key(i), Get(Key(i)));
+    ASSERT_EQ("NOT_FOUND", Get(Keymissing(i)));
+  }
+
+  // The flushed table uses the memtable filter as its full filter
+  dbfull()->TEST_CompactMemTable();
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Keymissing(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 3 * N / 100);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(i % 10 == 0 ? "NOT_FOUND" : Key(i), Get(Key(i)));
+  }
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+
+  // Memtables rebuilt from the log get a filter too
+  for (int i = 0; i < N; i += 10) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v2"));
+  }
+  Reopen(&options);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(i % 10 == 0 ? "v2" : Key(i), Get(Key(i)));
+  }
+
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, PartitionedFilter) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.compression = kNoCompression;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewWormholeFilterPolicy();
+  options.full_filter = true;
+  options.filter_partition_keys = 100;
+  Reopen(&options);
+
+  // Populate multiple layers
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  // Lookup present keys.  Every table whose key range covers the key reads
+  // one partition; the small table should rarely need a data block.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d present => %d reads\n", N, reads);
+  ASSERT_GE(reads, 2 * N);
+  ASSERT_LE(reads, 3 * N + 2 * N / 100);
+
+  // Lookup missing keys inside the key ranges.  Only partitions are read.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + "x"));
+  }
+  reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 2 * N + 3 * N / 100);
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+
+  // Partitioned filters are used regardless of the current setting.
+  options.full_filter = false;
+  options.filter_partition_keys = 0;
+  Reopen(&options);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, MultiGet) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.compression = kNoCompression;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewWormholeFilterPolicy();
+  options.full_filter = true;
+  options.max_file_size = 1 << 20;  // Several files per level
+  Reopen(&options);
+
+  // Spread versions of the keys over the levels and both memtables.  The
+  // keys are written twice so that the compaction has to split its output.
+  const int N = 20000;
+  const std::string padding(100, 'x');
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i) + "v0"));
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i) + "v1" + padding));
+  }
+  Compact("a", "z");
+  const Snapshot* snapshot = db_->GetSnapshot();
+  for (int i = 0; i < N; i += 3) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i) + "v2"));
+  }
+  for (int i = 0; i < N; i += 7) {
+    ASSERT_LEVELDB_OK(Delete(Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < N; i += 5) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i) + "v3"));
+  }
+  ASSERT_GT(TotalTableFiles(), 3);
+
+  // Unsorted, with duplicates and missing keys
+  std::vector<std::string> keys;
+  Random rnd(301);
+  for (int i = 0; i < 2 * N; i++) {
+    int k = rnd.Uniform(N);
+    keys.push_back(rnd.OneIn(4) ? Keymissing(k) : Key(k));
+  }
+  std::vector<Slice> key_slices(keys.begin(), keys.end());
+  std::vector<std::string> values(keys.size());
+  std::vector<Status> statuses(keys.size());
+
+  for (int parallel_reads : {1, 4}) {
+    for (const Snapshot* s : {static_cast<const Snapshot*>(nullptr), snapshot}) {
+      ReadOptions read_options;
+      read_options.snapshot = s;
+      read_options.max_parallel_reads = parallel_reads;
+      db_->MultiGet(read_options, key_slices.data(), keys.size(),
+                    values.data(), statuses.data());
+      for (size_t i = 0; i < keys.size(); i++) {
+        std::string result;
+        if (statuses[i].ok()) {
+          result = values[i];
+        } else if (statuses[i].IsNotFound()) {
+          result = "NOT_FOUND";
+        } else {
+          result = statuses[i].ToString();
+        }
+        ASSERT_EQ(Get(keys[i], s), result) << keys[i];
+      }
+    }
+  }
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  // Keys that share a data block share its read
+  keys.clear();
+  for (int i = 0; i < N; i++) {
+    keys.push_back(Key(i));
+  }
+  key_slices.assign(keys.begin(), keys.end());
+  values.resize(keys.size());
+  statuses.resize(keys.size());
+  env_->random_read_counter_.Reset();
+  db_->MultiGet(ReadOptions(), key_slices.data(), keys.size(), values.data(),
+                statuses.data());
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d present => %d reads\n", N, reads);
+  ASSERT_LE(reads, N / 10);
+
+  // Lookups done on other threads count in the caller's perf context
+  SetPerfLevel(kPerfEnableCount);
+  uint64_t table_lookups[2];
+  for (int parallel_reads : {1, 4}) {
+    ReadOptions read_options;
+    read_options.max_parallel_reads = parallel_reads;
+    GetPerfContext()->Reset();
+    db_->MultiGet(read_options, key_slices.data(), keys.size(), values.data(),
+                  statuses.data());
+    table_lookups[parallel_reads > 1] = GetPerfContext()->table_lookup_count;
+  }
+  SetPerfLevel(kPerfDisable);
+  ASSERT_GT(table_lookups[0], 0);
+  ASSERT_EQ(table_lookups[0], table_lookups[1]);
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  db_->ReleaseSnapshot(snapshot);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+// Number of files of the given type in "dir".
+static int CountFilesOfType(Env* env, const std::string& dir,
+                            FileType file_type) {
+  std::vector<std::string> filenames;
+  env->GetChildren(dir, &filenames);
+  uint64_t number;
+  FileType type;
+  int count = 0;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (ParseFileName(filenames[i], &number, &type) && type == file_type) {
+      count++;
+    }
+  }
+  return count;
+}
+
+TEST_F(DBTest, FilterDir) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.compression = kNoCompression;
+  options.filter_policy = NewWormholeFilterPolicy();
+  options.full_filter = true;
+  options.filter_dir = dbname_ + "_filters";
+  Reopen(&options);
+
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // Every table that has been opened has its filter file.  Files are
+  // counted once the DB is closed, so that no compaction is running.
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+    ASSERT_EQ("NOT_FOUND", Get(Keymissing(i)));
+  }
+  Close();
+  ASSERT_EQ(CountFilesOfType(env_, dbname_, kTableFile),
+            CountFilesOfType(env_, options.filter_dir, kFilterFile));
+
+  // Reopened tables map their filters
+  Reopen(&options);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+    ASSERT_EQ("NOT_FOUND", Get(Keymissing(i)));
+  }
+
+  // Filter files go away with their tables
+  Compact("a", "z");
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  Close();
+  ASSERT_EQ(CountFilesOfType(env_, dbname_, kTableFile),
+            CountFilesOfType(env_, options.filter_dir, kFilterFile));
+
+  // A filter file that does not match its table is rewritten
+  std::vector<std::string> filenames;
+  env_->GetChildren(options.filter_dir, &filenames);
+  for (size_t i = 0; i < filenames.size(); i++) {
+    uint64_t number;
+    FileType type;
+    if (ParseFileName(filenames[i], &number, &type) && type == kFilterFile) {
+      ASSERT_LEVELDB_OK(WriteStringToFile(
+          env_, "garbage", options.filter_dir + "/" + filenames[i]));
+    }
+  }
+  Reopen(&options);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+
+  Close();
+  ASSERT_LEVELDB_OK(DestroyDB(dbname_, options));
+  ASSERT_EQ(0, CountFilesOfType(env_, options.filter_dir, kFilterFile));
+  delete options.filter_policy;
+}
+
+// Block cache lookups (hits plus misses) of blocks of "kind", as reported
+// by the leveldb.block-cache-stats property.
+static uint64_t BlockCacheLookups(DB* db, const std::string& kind) {
+  std::string stats;
+  db->GetProperty("leveldb.block-cache-stats", &stats);
+  size_t start = 0;
+  while (start < stats.size()) {
+    size_t end = stats.find('\n', start);
+    std::string line = stats.substr(start, end - start);
+    char name[32];
+    unsigned long long hits, misses;
+    if (std::sscanf(line.c_str(), "%31s %llu %llu", name, &hits, &misses) ==
+            3 &&
+        kind == name) {
+      return hits + misses;
+    }
+    start = end == std::string::npos ? stats.size() : end + 1;
+  }
+  return 0;
+}
+
+TEST_F(DBTest, CacheIndexAndFilterBlocks) {
+  // Blocks read through mmap are never cached
+  env_->heap_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.filter_policy = NewWormholeFilterPolicy();
+  options.full_filter = true;
+  options.cache_index_and_filter_blocks = true;
+  options.block_cache = NewLRUCache(1);  // Evicts every block not in use
+  Reopen(&options);
+
+  // Overlapping flushes land in levels 2, 1 and 0
+  const int N = 1000;
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < N; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), Key(i + round)));
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  ASSERT_EQ("1,1,1", FilesPerLevel());
+
+  // Every lookup is answered by the level-0 table, whose index and filter
+  // go through the block cache unless they are pinned there.
+  for (int pin = 0; pin < 2; pin++) {
+    options.pin_l0_filter_and_index_blocks_in_cache = pin;
+    Reopen(&options);
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ(Key(i + 2), Get(Key(i)));
+    }
+    ASSERT_EQ(pin ? 0 : N, BlockCacheLookups(db_, "filter"));
+    ASSERT_EQ(pin ? 0 : N, BlockCacheLookups(db_, "index"));
+    ASSERT_LE(N, BlockCacheLookups(db_, "data"));
+  }
+
+  // Tables of other levels read their blocks again after eviction
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Keymissing(i)));
+  }
+  ASSERT_LE(N, BlockCacheLookups(db_, "filter"));
+
+  Close();
+  env_->heap_random_reads_ = false;
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+static uint64_t DBFilterEntries(DB* db) {
+  std::string entries;
+  EXPECT_TRUE(db->GetProperty("leveldb.db-filter-entries", &entries));
+  return std::strtoull(entries.c_str(), nullptr, 10);
+}
+
+TEST_F(DBTest, DBFilter) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.compression = kNoCompression;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.db_filter_size = 64 << 10;
+  Reopen(&options);
+
+  // Two versions of every key, then a deletion of every other key
+  const int N = 1000;
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < N; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), Key(i + round)));
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  for (int i = 0; i < N; i += 2) {
+    ASSERT_LEVELDB_OK(Delete(Key(i)));
+  }
+  ASSERT_EQ(2 * N + N / 2, DBFilterEntries(db_));
+
+  // Missing keys are answered without a table read, even though no table
+  // has a filter.
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Keymissing(i)));
+  }
+  ASSERT_LE(env_->random_read_counter_.Read(), N / 100);
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+
+  // Compactions drop old values and tombstones together with the keys
+  // they deleted, which leave the filter.
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(N / 2, DBFilterEntries(db_));
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(i % 2 == 0 ? "NOT_FOUND" : Key(i + 1), Get(Key(i)));
+  }
+
+  // The filter is saved on close, and rebuilt if the saved copy is gone
+  // or stale.
+  Reopen(&options);
+  ASSERT_EQ(N / 2, DBFilterEntries(db_));
+  Close();
+  ASSERT_LEVELDB_OK(env_->RemoveFile(DBFilterFileName(dbname_)));
+  Reopen(&options);
+  ASSERT_EQ(N / 2, DBFilterEntries(db_));
+  ASSERT_LEVELDB_OK(Put(Key(0), "v"));
+  options.db_filter_size = 0;
+  Reopen(&options);
+  ASSERT_LEVELDB_OK(Put(Key(2), "v"));
+  options.db_filter_size = 64 << 10;
+  Reopen(&options);
+  ASSERT_EQ(N / 2 + 2, DBFilterEntries(db_));
+  ASSERT_EQ("v", Get(Key(2)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(4)));
+
+  Close();
+  delete options.block_cache;
+}
+
+TEST_F(DBTest, DBFilterOverwrites) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.compression = kNoCompression;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.db_filter_size = 64 << 10;
+  Reopen(&options);
+
+  // Far more versions of one key than its probe window has slots
+  const int N = 1000;
+  const int kVersions = 200;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < kVersions; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(0), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(N + kVersions, DBFilterEntries(db_));
+  ASSERT_FALSE(dbfull()->TEST_DBFilterFull());
+
+  for (int reopen = 0; reopen < 2; reopen++) {
+    env_->random_read_counter_.Reset();
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ("NOT_FOUND", Get(Keymissing(i)));
+    }
+    ASSERT_LE(env_->random_read_counter_.Read(), N / 100);
+    ASSERT_EQ(Key(kVersions - 1), Get(Key(0)));
+
+    // The filter is not full, so it is saved on close
+    Reopen(&options);
+    ASSERT_EQ(N + kVersions, DBFilterEntries(db_));
+    ASSERT_FALSE(dbfull()->TEST_DBFilterFull());
+  }
+
+  // Dropping the old versions leaves one record of the key
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(N, DBFilterEntries(db_));
+  ASSERT_EQ(Key(kVersions - 1), Get(Key(0)));
+
+  Close();
+  delete options.block_cache;
+}
+
+TEST_F(DBTest, DBFilterRebuild) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.compression = kNoCompression;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.db_filter_size = 4 << 10;
+  Reopen(&options);
+
+  // Too many keys for the filter, which then matches every key...
+  const int N = 4000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  ASSERT_TRUE(dbfull()->TEST_DBFilterFull());
+  dbfull()->TEST_CompactMemTable();
+
+  // ...until compactions drop enough of them for the others to fit.
+  for (int i = N / 4; i < N; i++) {
+    ASSERT_LEVELDB_OK(Delete(Key(i)));
+  }
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_FALSE(dbfull()->TEST_DBFilterFull());
+  ASSERT_EQ(N / 4, DBFilterEntries(db_));
+
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(i < N / 4 ? Key(i) : "NOT_FOUND", Get(Key(i)));
+    ASSERT_EQ("NOT_FOUND", Get(Keymissing(i)));
+  }
+  ASSERT_LE(env_->random_read_counter_.Read(), N / 4 + N / 100);
+
+  // Writes during and after the rebuild are covered
+  ASSERT_LEVELDB_OK(Put(Key(N), "v"));
+  ASSERT_EQ("v", Get(Key(N)));
+  Reopen(&options);
+  ASSERT_EQ(N / 4 + 1, DBFilterEntries(db_));
+  ASSERT_EQ("v", Get(Key(N)));
+
+  Close();
+  delete options.block_cache;
+}
+
+namespace {
+
+// Counts the filters built through it.  Keeps the name of the policy it
+// wraps, so that its filters are read back by that policy.
+class CountingFilterPolicy : public FilterPolicy {
+ public:
+  explicit CountingFilterPolicy(const FilterPolicy* base)
+      : base_(base), filters_(0) {}
+
+  int filters() const { return filters_.load(std::memory_order_relaxed); }
+
+  const char* Name() const override { return base_->Name(); }
+  void CreateFilter(const Slice* keys, int n,
+                    std::string* dst) const override {
+    filters_.fetch_add(1, std::memory_order_relaxed);
+    base_->CreateFilter(keys, n, dst);
+  }
+  bool KeyMayMatch(const Slice& key, const Slice& filter) const override {
+    return base_->KeyMayMatch(key, filter);
+  }
+  bool SupportsHashing() const override { return base_->SupportsHashing(); }
+  uint64_t HashKey(const Slice& key) const override {
+    return base_->HashKey(key);
+  }
+  void CreateFilterFromHashes(const uint64_t* hashes, int n,
+                              std::string* dst) const override {
+    filters_.fetch_add(1, std::memory_order_relaxed);
+    base_->CreateFilterFromHashes(hashes, n, dst);
+  }
+
+ private:
+  std::unique_ptr<const FilterPolicy> base_;
+  mutable std::atomic<int> filters_;
+};
+
+}  // namespace
+
+TEST_F(DBTest, LevelFilterPolicies) {
+  std::unique_ptr<const FilterPolicy> policy(NewWormholeFilterPolicy());
+  CountingFilterPolicy upper_policy(NewWormholeFilterPolicy(24, 14));
+  Options options = CurrentOptions();
+  options.filter_policy = policy.get();
+  options.full_filter = true;
+  options.level_filter_policies = {nullptr, nullptr, &upper_policy};
+  Reopen(&options);
+
+  // A flush of keys that overlap nothing is pushed to level 2, and gets
+  // the filter of that level
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(1, NumTableFilesAtLevel(2));
+  ASSERT_EQ(1, upper_policy.filters());
+
+  // Compacted into level 3, the keys get the filter of filter_policy
+  dbfull()->TEST_CompactRange(2, nullptr, nullptr);
+  ASSERT_EQ(0, NumTableFilesAtLevel(2));
+  ASSERT_EQ(1, NumTableFilesAtLevel(3));
+  ASSERT_EQ(1, upper_policy.filters());
+
+  // Filters of both geometries are read with filter_policy
+  for (int i = 0; i < 2 * N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(N + i), Key(N + i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(2, upper_policy.filters());
+  for (int i = 0; i < 3 * N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+    ASSERT_EQ("NOT_FOUND", Get(Keymissing(i)));
+  }
+  Close();
+}
+
+TEST_F(DBTest, OptimizeFiltersForHits) {
+  CountingFilterPolicy policy(NewWormholeFilterPolicy());
+  Options options = CurrentOptions();
+  options.filter_policy = &policy;
+  options.full_filter = true;
+  options.optimize_filters_for_hits = true;
+  Reopen(&options);
+
+  // Tables of the bottommost level get no filter, whether they come from a
+  // flush or from a compaction
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(2 * i), Key(2 * i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(1, NumTableFilesAtLevel(2));
+  dbfull()->TEST_CompactRange(2, nullptr, nullptr);
+  ASSERT_EQ(1, NumTableFilesAtLevel(3));
+  ASSERT_EQ(0, policy.filters());
+
+  // Levels above it still get filters
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(2 * i + 1), Key(2 * i + 1)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(1, NumTableFilesAtLevel(2));
+  ASSERT_EQ(1, policy.filters());
+
+  // Tables without a filter may hold any key
+  for (int i = 0; i < 2 * N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+    ASSERT_EQ("NOT_FOUND", Get(Keymissing(i)));
+  }
+  Close();
+}
+
+// Filter counters of "level" from the leveldb.filter-stats property:
+// probes, rejects, useful rejects and false positives.
+static std::vector<unsigned long long> FilterStatsOfLevel(DB* db, int level) {
+  std::string stats;
+  EXPECT_TRUE(db->GetProperty("leveldb.filter-stats", &stats));
+  std::vector<unsigned long long> counters(4, 0);
+  size_t start = 0;
+  while (start < stats.size()) {
+    size_t end = stats.find('\n', start);
+    std::string line = stats.substr(start, end - start);
+    int l;
+    if (std::sscanf(line.c_str(), "%d %llu %llu %llu %llu", &l, &counters[0],
+                    &counters[1], &counters[2], &counters[3]) == 5 &&
+        l == level) {
+      return counters;
+    }
+    start = end == std::string::npos ? stats.size() : end + 1;
+  }
+  return std::vector<unsigned long long>(4, 0);
+}
+
+TEST_F(DBTest, FilterStats) {
+  Options options = CurrentOptions();
+  options.filter_policy = NewWormholeFilterPolicy();
+  options.full_filter = true;
+  Reopen(&options);
+
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(2 * i), Key(2 * i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(1, NumTableFilesAtLevel(2));
+
+  // Present keys pass the filter and are found
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(2 * i), Get(Key(2 * i)));
+  }
+  std::vector<unsigned long long> stats = FilterStatsOfLevel(db_, 2);
+  ASSERT_EQ(N, stats[0]);
+  ASSERT_EQ(0, stats[1]);
+  ASSERT_EQ(0, stats[3]);
+
+  // Missing keys between them are either rejected, saving a data block
+  // read, or read their data block in vain
+  const int M = N - 1;
+  for (int i = 0; i < M; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(2 * i + 1)));
+  }
+  stats = FilterStatsOfLevel(db_, 2);
+  ASSERT_EQ(N + M, stats[0]);
+  ASSERT_EQ(M, stats[1] + stats[3]);
+  ASSERT_EQ(stats[1], stats[2]);
+  ASSERT_LT(stats[3], N / 10);
+
+  // MultiGet() probes the same way
+  std::vector<std::string> keys;
+  for (int i = 0; i < M; i++) {
+    keys.push_back(Key(2 * i + 1));
+  }
+  std::vector<Slice> key_slices(keys.begin(), keys.end());
+  std::vector<std::string> values(M);
+  std::vector<Status> statuses(M);
+  db_->MultiGet(ReadOptions(), key_slices.data(), M, values.data(),
+                statuses.data());
+  std::vector<unsigned long long> after = FilterStatsOfLevel(db_, 2);
+  ASSERT_EQ(N + 2 * M, after[0]);
+  ASSERT_EQ(2 * stats[1], after[1]);
+  ASSERT_EQ(2 * stats[3], after[3]);
+
+  Close();
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, PerfContext) {
+  Options options = CurrentOptions();
+  options.filter_policy = NewWormholeFilterPolicy();
+  options.full_filter = true;
+  Reopen(&options);
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(Put("c", "vc"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_LEVELDB_OK(Put("d", "vd"));
+  PerfContext* context = GetPerfContext();
+
+  // Nothing is collected by default
+  context->Reset();
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("", context->ToString());
+
+  // A memtable hit does not get to the tables
+  SetPerfLevel(kPerfEnableTime);
+  ASSERT_EQ("vd", Get("d"));
+  ASSERT_GT(context->get_nanos, 0);
+  ASSERT_GT(context->memtable_get_nanos, 0);
+  ASSERT_EQ(0, context->version_get_nanos);
+  ASSERT_EQ(0, context->table_lookup_count);
+
+  // A table hit probes the filter and reads the data block
+  context->Reset();
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_GE(context->get_nanos, context->version_get_nanos);
+  ASSERT_GE(context->version_get_nanos, context->filter_probe_nanos);
+  ASSERT_GT(context->filter_probe_nanos, 0);
+  ASSERT_EQ(1, context->table_lookup_count);
+  ASSERT_EQ(1, context->filter_probe_count);
+  ASSERT_EQ(1, context->block_read_count + context->block_cache_hit_count);
+
+  // Counters only
+  SetPerfLevel(kPerfEnableCount);
+  context->Reset();
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ(0, context->get_nanos);
+  ASSERT_EQ(1, context->table_lookup_count);
+  ASSERT_EQ(1, context->filter_probe_count);
+
+  SetPerfLevel(kPerfDisable);
+  Close();
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, PrefixFilter) {
+  env_->count_random_reads_ = true;
+  std::unique_ptr<const SliceTransform> prefix_extractor(
+      NewFixedPrefixTransform(4));
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.compression = kNoCompression;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.prefix_extractor = prefix_extractor.get();
+  Reopen(&options);
+
+  // Keys with the even prefixes "p000" to "p018": half of them compacted
+  // into one level, the rest in tables of their own.
+  const int kPrefixes = 20;
+  const int kKeysPerPrefix = 100;
+  char buf[32];
+  for (int p = 0; p < kPrefixes; p += 2) {
+    for (int k = 0; k < kKeysPerPrefix; k++) {
+      std::snprintf(buf, sizeof(buf), "p%03d-%03d", p, k);
+      ASSERT_LEVELDB_OK(Put(buf, buf));
+    }
+    if (p == kPrefixes / 2) {
+      dbfull()->CompactRange(nullptr, nullptr);
+    } else {
+      dbfull()->TEST_CompactMemTable();
+    }
+  }
+
+  ReadOptions read_options;
+  read_options.prefix_same_as_start = true;
+  Iterator* iter = db_->NewIterator(read_options);
+  for (int p = 0; p < kPrefixes; p++) {
+    std::snprintf(buf, sizeof(buf), "p%03d", p);
+    const std::string prefix = buf;
+    int count = 0;
+    for (iter->Seek(prefix); iter->Valid(); iter->Next()) {
+      ASSERT_TRUE(iter->key().starts_with(prefix));
+      ASSERT_EQ(iter->key(), iter->value());
+      count++;
+    }
+    ASSERT_LEVELDB_OK(iter->status());
+    ASSERT_EQ(p % 2 == 0 ? kKeysPerPrefix : 0, count);
+
+    // Seeks within a prefix stop at its end too
+    std::snprintf(buf, sizeof(buf), "p%03d-%03d", p, kKeysPerPrefix / 2);
+    count = 0;
+    for (iter->Seek(buf); iter->Valid(); iter->Next()) {
+      count++;
+    }
+    ASSERT_EQ(p % 2 == 0 ? kKeysPerPrefix / 2 : 0, count);
+  }
+
+  // Seeks to missing prefixes read no blocks, unlike ordinary seeks
+  env_->random_read_counter_.Reset();
+  for (int p = 1; p < kPrefixes; p += 2) {
+    std::snprintf(buf, sizeof(buf), "p%03d", p);
+    iter->Seek(buf);
+    ASSERT_TRUE(!iter->Valid());
+  }
+  ASSERT_LE(env_->random_read_counter_.Read(), 1);
+  delete iter;
+
+  iter = db_->NewIterator(ReadOptions());
+  env_->random_read_counter_.Reset();
+  for (int p = 1; p < kPrefixes - 1; p += 2) {
+    std::snprintf(buf, sizeof(buf), "p%03d", p);
+    iter->Seek(buf);
+    ASSERT_TRUE(iter->Valid());
+  }
+  ASSERT_GE(env_->random_read_counter_.Read(), kPrefixes / 2 - 1);
+  delete iter;
+
+  Close();
+  delete options.block_cache;
+}
+
 /*
 TEST_F(DBTest, LogCloseError) {
   // Regression test for bug where we could ignore log file
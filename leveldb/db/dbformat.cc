@@ -6,6 +6,7 @@
 
 #include <cstdio>
 #include <sstream>
+#include <vector>
 
 #include "port/port.h"
 #include "util/coding.h"
@@ -114,6 +115,41 @@ bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const {
   return user_policy_->KeyMayMatch(ExtractUserKey(key), f);
 }
 
+void InternalFilterPolicy::KeysMayMatch(const Slice* keys, int n,
+                                        const Slice& f, bool* out) const {
+  std::vector<Slice> user_keys(n);
+  for (int i = 0; i < n; i++) {
+    user_keys[i] = ExtractUserKey(keys[i]);
+  }
+  user_policy_->KeysMayMatch(user_keys.data(), n, f, out);
+}
+
+bool InternalFilterPolicy::SupportsHashing() const {
+  return user_policy_->SupportsHashing();
+}
+
+uint64_t InternalFilterPolicy::HashKey(const Slice& key) const {
+  return user_policy_->HashKey(ExtractUserKey(key));
+}
+
+void InternalFilterPolicy::CreateFilterFromHashes(const uint64_t* hashes,
+                                                  int n,
+                                                  std::string* dst) const {
+  user_policy_->CreateFilterFromHashes(hashes, n, dst);
+}
+
+const char* InternalSliceTransform::Name() const {
+  return user_transform_->Name();
+}
+
+bool InternalSliceTransform::InDomain(const Slice& key) const {
+  return user_transform_->InDomain(ExtractUserKey(key));
+}
+
+Slice InternalSliceTransform::Transform(const Slice& key) const {
+  return user_transform_->Transform(ExtractUserKey(key));
+}
+
 LookupKey::LookupKey(const Slice& user_key, SequenceNumber s) {
   size_t usize = user_key.size();
   size_t needed = usize + 13;  // A conservative estimate
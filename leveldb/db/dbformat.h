@@ -13,6 +13,7 @@
 #include "leveldb/db.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
 #include "util/coding.h"
 #include "util/logging.h"
@@ -123,9 +124,30 @@ class InternalFilterPolicy : public FilterPolicy {
 
  public:
   explicit InternalFilterPolicy(const FilterPolicy* p) : user_policy_(p) {}
+  const FilterPolicy* user_policy() const { return user_policy_; }
   const char* Name() const override;
   void CreateFilter(const Slice* keys, int n, std::string* dst) const override;
   bool KeyMayMatch(const Slice& key, const Slice& filter) const override;
+  void KeysMayMatch(const Slice* keys, int n, const Slice& filter,
+                    bool* out) const override;
+  bool SupportsHashing() const override;
+  uint64_t HashKey(const Slice& key) const override;
+  void CreateFilterFromHashes(const uint64_t* hashes, int n,
+                              std::string* dst) const override;
+};
+
+// Prefix extractor wrapper that converts from internal keys to user keys
+class InternalSliceTransform : public SliceTransform {
+ private:
+  const SliceTransform* const user_transform_;
+
+ public:
+  explicit InternalSliceTransform(const SliceTransform* t)
+      : user_transform_(t) {}
+  const SliceTransform* user_transform() const { return user_transform_; }
+  const char* Name() const override;
+  bool InDomain(const Slice& key) const override;
+  Slice Transform(const Slice& key) const override;
 };
 
 // Modules in this directory should keep internal keys wrapped inside
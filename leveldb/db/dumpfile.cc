@@ -5,19 +5,29 @@
 #include "leveldb/dumpfile.h"
 
 #include <cstdio>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/filename.h"
 #include "db/log_reader.h"
+#include "db/table_cache.h"
 #include "db/version_edit.h"
+#include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/comparator.h"
 #include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
 #include "leveldb/status.h"
 #include "leveldb/table.h"
 #include "leveldb/write_batch.h"
+#include "table/block.h"
+#include "table/filter_block.h"
+#include "table/format.h"
 #include "util/logging.h"
+#include "util/read_buffer.h"
+#include "util/wormhole.h"
 
 namespace leveldb {
 
@@ -209,8 +219,300 @@ Status DumpTable(Env* env, const std::string& fname, WritableFile* dst) {
   return Status::OK();
 }
 
+// Shape of the filters of one table, or of all tables of one level.  Only
+// the filters of NewWormholeFilterPolicy() have slots; of the others only
+// the number and size are known.
+struct FilterShape {
+  FilterShape()
+      : tables(0),
+        mapped_tables(0),
+        filters(0),
+        bytes(0),
+        slots(0),
+        used_slots(0),
+        stashed(0),
+        wrapped(0) {}
+
+  void AddFilter(const Slice& filter) {
+    filters++;
+    bytes += filter.size();
+    WormholeOccupancy occupancy;
+    if (!GetWormholeOccupancy(filter, &occupancy)) {
+      return;
+    }
+    slots += occupancy.slots;
+    used_slots += occupancy.used_slots;
+    stashed += occupancy.stashed;
+    wrapped += occupancy.wrapped;
+    AddDistances(occupancy.distances);
+  }
+
+  void Add(const FilterShape& other) {
+    tables += other.tables;
+    mapped_tables += other.mapped_tables;
+    filters += other.filters;
+    bytes += other.bytes;
+    slots += other.slots;
+    used_slots += other.used_slots;
+    stashed += other.stashed;
+    wrapped += other.wrapped;
+    AddDistances(other.distances);
+  }
+
+  void AddDistances(const std::vector<uint64_t>& d) {
+    if (distances.size() < d.size()) {
+      distances.resize(d.size(), 0);
+    }
+    for (size_t i = 0; i < d.size(); i++) {
+      distances[i] += d[i];
+    }
+  }
+
+  uint64_t tables;
+  uint64_t mapped_tables;  // Tables env mapped instead of reading them
+  uint64_t filters;
+  uint64_t bytes;
+  uint64_t slots;
+  uint64_t used_slots;
+  uint64_t stashed;
+  uint64_t wrapped;
+  std::vector<uint64_t> distances;
+};
+
+// Adds the filters of the block at "handle" to *shape.  "name" is the key
+// of the block in the metaindex block.
+Status AddFilterBlock(RandomAccessFile* file, const Slice& name,
+                      const BlockHandle& handle, FilterShape* shape) {
+  BlockContents contents;
+  Status s = ReadBlock(file, ReadOptions(), handle, &contents);
+  if (!s.ok()) {
+    return s;
+  }
+  if (name.starts_with("filter.")) {
+    // One filter per range of data block offsets
+    FilterBlockReader reader(nullptr, contents.data);
+    for (size_t i = 0; i < reader.num_filters(); i++) {
+      const Slice filter = reader.filter(i);
+      if (!filter.empty()) {
+        shape->AddFilter(filter);
+      }
+    }
+    delete contents.read_buffer;
+  } else if (name.starts_with("partitionedfilter.")) {
+    // An index of the partitions, each of which is a block of its own.
+    // Blocks are only iterated, so the comparator is never used.
+    Block index(contents);
+    Iterator* iter = index.NewIterator(BytewiseComparator());
+    for (iter->SeekToFirst(); s.ok() && iter->Valid(); iter->Next()) {
+      Slice input = iter->value();
+      BlockHandle partition_handle;
+      s = partition_handle.DecodeFrom(&input);
+      BlockContents partition;
+      if (s.ok()) {
+        s = ReadBlock(file, ReadOptions(), partition_handle, &partition);
+      }
+      if (s.ok()) {
+        shape->AddFilter(partition.data);
+        delete partition.read_buffer;
+      }
+    }
+    if (s.ok()) {
+      s = iter->status();
+    }
+    delete iter;
+  } else {
+    // "fullfilter." and "prefixfilter." blocks are a single filter
+    shape->AddFilter(contents.data);
+    delete contents.read_buffer;
+  }
+  return s;
+}
+
+// Adds the filters of the table in "fname" to *shape.  Only the footer, the
+// metaindex block and the filter blocks of the table are read.
+Status AddTableFilters(Env* env, const std::string& fname,
+                       FilterShape* shape) {
+  uint64_t file_size;
+  RandomAccessFile* file = nullptr;
+  Status s = env->GetFileSize(fname, &file_size);
+  if (s.ok()) {
+    s = env->NewRandomAccessFile(fname, &file);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  if (file_size < Footer::kEncodedLength) {
+    delete file;
+    return Status::Corruption(fname, "file is too short to be an sstable");
+  }
+
+  ReadBuffer footer_buffer;
+  Slice footer_input;
+  s = file->Read(file_size - Footer::kEncodedLength, Footer::kEncodedLength,
+                 &footer_input, &footer_buffer);
+  Footer footer;
+  if (s.ok()) {
+    s = footer.DecodeFrom(&footer_input);
+  }
+  BlockContents contents;
+  if (s.ok()) {
+    s = ReadBlock(file, ReadOptions(), footer.metaindex_handle(), &contents);
+  }
+  if (!s.ok()) {
+    delete file;
+    return s;
+  }
+  shape->tables++;
+  if (!footer_buffer.PtrIsNotNull()) {
+    shape->mapped_tables++;  // The footer was read in place
+  }
+
+  Block meta(contents);
+  Iterator* iter = meta.NewIterator(BytewiseComparator());
+  for (iter->SeekToFirst(); s.ok() && iter->Valid(); iter->Next()) {
+    const Slice name = iter->key();
+    if (!name.starts_with("filter.") && !name.starts_with("fullfilter.") &&
+        !name.starts_with("partitionedfilter.") &&
+        !name.starts_with("prefixfilter.")) {
+      continue;
+    }
+    Slice input = iter->value();
+    BlockHandle handle;
+    s = handle.DecodeFrom(&input);
+    if (s.ok()) {
+      s = AddFilterBlock(file, name, handle, shape);
+    }
+  }
+  if (s.ok()) {
+    s = iter->status();
+  }
+  delete iter;
+  delete file;
+  if (!s.ok()) {
+    s = Status::Corruption(fname, s.ToString());
+  }
+  return s;
+}
+
+std::string Percent(uint64_t part, uint64_t total) {
+  if (total == 0) {
+    return "-";
+  }
+  char buf[20];
+  std::snprintf(buf, sizeof(buf), "%.2f%%", 100.0 * part / total);
+  return buf;
+}
+
+// Appends one row of the filter stats table.
+void AppendFilterShape(const std::string& level, const std::string& table,
+                       const FilterShape& shape, WritableFile* dst) {
+  const char* read_mode = "-";
+  if (shape.tables > 0) {
+    read_mode = shape.mapped_tables == shape.tables ? "mmap"
+                : shape.mapped_tables == 0          ? "stream"
+                                                    : "mixed";
+  }
+  char buf[200];
+  std::snprintf(buf, sizeof(buf), "%5s  %-14s %9llu %14llu %8s %8llu %8s  %s\n",
+                level.c_str(), table.c_str(),
+                static_cast<unsigned long long>(shape.filters),
+                static_cast<unsigned long long>(shape.bytes),
+                Percent(shape.used_slots, shape.slots).c_str(),
+                static_cast<unsigned long long>(shape.stashed),
+                Percent(shape.wrapped, shape.used_slots).c_str(), read_mode);
+  dst->Append(buf);
+}
+
+// Appends the share of tags at every displacement from their home bucket.
+void AppendDistances(const FilterShape& shape, WritableFile* dst) {
+  if (shape.used_slots == 0) {
+    return;
+  }
+  std::string r = "       Displacement:";
+  for (size_t d = 0; d < shape.distances.size(); d++) {
+    r += " " + std::to_string(d) + ":" +
+         Percent(shape.distances[d], shape.used_slots);
+  }
+  r += "\n";
+  dst->Append(r);
+}
+
+void AppendFilterShapeHeader(WritableFile* dst) {
+  char buf[200];
+  std::snprintf(buf, sizeof(buf), "%5s  %-14s %9s %14s %8s %8s %8s  %s\n",
+                "Level", "Table", "Filters", "Bytes", "Load", "Stashed",
+                "Wrapped", "Read");
+  dst->Append(buf);
+  dst->Append(std::string(82, '-') + "\n");
+}
+
+// Basename of "fname"
+std::string BaseName(const std::string& fname) {
+  size_t pos = fname.rfind('/');
+  return pos == std::string::npos ? fname : fname.substr(pos + 1);
+}
+
 }  // namespace
 
+Status DumpFilterStats(Env* env, const std::string& name, WritableFile* dst) {
+  FileType ftype;
+  if (GuessType(name, &ftype) && ftype == kTableFile) {
+    FilterShape shape;
+    Status s = AddTableFilters(env, name, &shape);
+    if (s.ok()) {
+      AppendFilterShapeHeader(dst);
+      AppendFilterShape("-", BaseName(name), shape, dst);
+      AppendDistances(shape, dst);
+    }
+    return s;
+  }
+
+  // A database: find the level of every table in its descriptor
+  Options options;
+  options.env = env;
+  InternalKeyComparator icmp(options.comparator);
+  TableCache table_cache(name, options, 1);
+  VersionSet versions(name, &options, &table_cache, &icmp);
+  bool ignored;
+  Status s = versions.Recover(&ignored);
+  if (!s.ok()) {
+    return s;
+  }
+
+  AppendFilterShapeHeader(dst);
+  FilterShape total;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    std::vector<FileMetaData*> files;
+    versions.current()->GetOverlappingInputs(level, nullptr, nullptr, &files);
+    if (files.empty()) {
+      continue;
+    }
+    FilterShape level_shape;
+    for (FileMetaData* f : files) {
+      std::string fname = TableFileName(name, f->number);
+      if (!env->FileExists(fname)) {
+        fname = SSTTableFileName(name, f->number);
+      }
+      FilterShape shape;
+      s = AddTableFilters(env, fname, &shape);
+      if (!s.ok()) {
+        return s;
+      }
+      AppendFilterShape(std::to_string(level), BaseName(fname), shape, dst);
+      level_shape.Add(shape);
+    }
+    AppendFilterShape(std::to_string(level),
+                      std::to_string(level_shape.tables) + " tables",
+                      level_shape, dst);
+    AppendDistances(level_shape, dst);
+    total.Add(level_shape);
+  }
+  AppendFilterShape("all", std::to_string(total.tables) + " tables", total,
+                    dst);
+  AppendDistances(total, dst);
+  return Status::OK();
+}
+
 Status DumpFile(Env* env, const std::string& fname, WritableFile* dst) {
   FileType ftype;
   if (!GuessType(fname, &ftype)) {
@@ -59,6 +59,15 @@ std::string TempFileName(const std::string& dbname, uint64_t number) {
   return MakeFileName(dbname, number, "dbtmp");
 }
 
+std::string FilterFileName(const std::string& filter_dir, uint64_t number) {
+  assert(number > 0);
+  return MakeFileName(filter_dir, number, "filter");
+}
+
+std::string DBFilterFileName(const std::string& dir) {
+  return dir + "/DBFILTER";
+}
+
 std::string InfoLogFileName(const std::string& dbname) {
   return dbname + "/LOG";
 }
@@ -73,8 +82,10 @@ std::string OldInfoLogFileName(const std::string& dbname) {
 //    dbname/LOCK
 //    dbname/LOG
 //    dbname/LOG.old
+//    (dbname|filter_dir)/DBFILTER
 //    dbname/MANIFEST-[0-9]+
 //    dbname/[0-9]+.(log|sst|ldb)
+//    filter_dir/[0-9]+.filter
 bool ParseFileName(const std::string& filename, uint64_t* number,
                    FileType* type) {
   Slice rest(filename);
@@ -87,6 +98,9 @@ bool ParseFileName(const std::string& filename, uint64_t* number,
   } else if (rest == "LOG" || rest == "LOG.old") {
     *number = 0;
     *type = kInfoLogFile;
+  } else if (rest == "DBFILTER") {
+    *number = 0;
+    *type = kDBFilterFile;
   } else if (rest.starts_with("MANIFEST-")) {
     rest.remove_prefix(strlen("MANIFEST-"));
     uint64_t num;
@@ -112,6 +126,8 @@ bool ParseFileName(const std::string& filename, uint64_t* number,
       *type = kTableFile;
     } else if (suffix == Slice(".dbtmp")) {
       *type = kTempFile;
+    } else if (suffix == Slice(".filter")) {
+      *type = kFilterFile;
     } else {
       return false;
     }
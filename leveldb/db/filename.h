@@ -25,7 +25,9 @@ enum FileType {
   kDescriptorFile,
   kCurrentFile,
   kTempFile,
-  kInfoLogFile  // Either the current one, or an old one
+  kInfoLogFile,  // Either the current one, or an old one
+  kFilterFile,
+  kDBFilterFile
 };
 
 // Return the name of the log file with the specified number
@@ -61,6 +63,16 @@ std::string LockFileName(const std::string& dbname);
 // The result will be prefixed with "dbname".
 std::string TempFileName(const std::string& dbname, uint64_t number);
 
+// Return the name of the file that holds the filter block of the table
+// with the specified number (see Options::filter_dir).  The result will
+// be prefixed with "filter_dir".
+std::string FilterFileName(const std::string& filter_dir, uint64_t number);
+
+// Return the name of the file that holds the saved filter over all keys
+// of a database (see Options::db_filter_size).  The result will be
+// prefixed with "dir", the filter_dir or the db directory.
+std::string DBFilterFileName(const std::string& dir);
+
 // Return the name of the info log file for "dbname".
 std::string InfoLogFileName(const std::string& dbname);
 
@@ -32,6 +32,7 @@ TEST(FileNameTest, Parse) {
       {"MANIFEST-7", 7, kDescriptorFile},
       {"LOG", 0, kInfoLogFile},
       {"LOG.old", 0, kInfoLogFile},
+      {"DBFILTER", 0, kDBFilterFile},
       {"18446744073709551615.log", 18446744073709551615ull, kLogFile},
   };
   for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
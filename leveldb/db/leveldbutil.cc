@@ -35,6 +35,19 @@ bool HandleDumpCommand(Env* env, char** files, int num) {
   return ok;
 }
 
+bool HandleFilterStatsCommand(Env* env, char** names, int num) {
+  StdoutPrinter printer;
+  bool ok = true;
+  for (int i = 0; i < num; i++) {
+    Status s = DumpFilterStats(env, names[i], &printer);
+    if (!s.ok()) {
+      std::fprintf(stderr, "%s\n", s.ToString().c_str());
+      ok = false;
+    }
+  }
+  return ok;
+}
+
 }  // namespace
 }  // namespace leveldb
 
@@ -42,7 +55,9 @@ static void Usage() {
   std::fprintf(
       stderr,
       "Usage: leveldbutil command...\n"
-      "   dump files...         -- dump contents of specified files\n");
+      "   dump files...         -- dump contents of specified files\n"
+      "   filterstats names...  -- summarize the filters of the specified\n"
+      "                            databases or table files\n");
 }
 
 int main(int argc, char** argv) {
@@ -55,6 +70,8 @@ int main(int argc, char** argv) {
     std::string command = argv[1];
     if (command == "dump") {
       ok = leveldb::HandleDumpCommand(env, argv + 2, argc - 2);
+    } else if (command == "filterstats") {
+      ok = leveldb::HandleFilterStatsCommand(env, argv + 2, argc - 2);
     } else {
       Usage();
       ok = false;
@@ -8,6 +8,7 @@
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "util/coding.h"
+#include "util/wormhole.h"
 
 namespace leveldb {
 
@@ -18,10 +19,19 @@ static Slice GetLengthPrefixedSlice(const char* data) {
   return Slice(p, len);
 }
 
-MemTable::MemTable(const InternalKeyComparator& comparator)
-    : comparator_(comparator), refs_(0), table_(comparator_, &arena_) {}
-
-MemTable::~MemTable() { assert(refs_ == 0); }
+MemTable::MemTable(const InternalKeyComparator& comparator,
+                   size_t filter_bytes, int fingerprint_bits)
+    : comparator_(comparator),
+      refs_(0),
+      table_(comparator_, &arena_),
+      filter_(filter_bytes > 0
+                  ? new WormholeTable(filter_bytes, fingerprint_bits)
+                  : nullptr) {}
+
+MemTable::~MemTable() {
+  assert(refs_ == 0);
+  delete filter_;
+}
 
 size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
 
@@ -96,10 +106,18 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   p = EncodeVarint32(p, val_size);
   std::memcpy(p, value.data(), val_size);
   assert(p + val_size == buf + encoded_len);
+  // The key goes into the filter first so that a reader that finds the
+  // entry in table_ also finds the key in the filter.
+  if (filter_ != nullptr) {
+    filter_->Add(WormholeHash(key));
+  }
   table_.Insert(buf);
 }
 
 bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+  if (filter_ != nullptr && !filter_->MayMatch(WormholeHash(key.user_key()))) {
+    return false;
+  }
   Slice memkey = key.memtable_key();
   Table::Iterator iter(&table_);
   iter.Seek(memkey.data());
@@ -135,4 +153,8 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
   return false;
 }
 
+bool MemTable::EncodeFilter(std::string* dst) const {
+  return filter_ != nullptr && filter_->EncodeTo(dst);
+}
+
 }  // namespace leveldb
@@ -16,12 +16,17 @@ namespace leveldb {
 
 class InternalKeyComparator;
 class MemTableIterator;
+class WormholeTable;
 
 class MemTable {
  public:
   // MemTables are reference counted.  The initial reference count
   // is zero and the caller must call Ref() at least once.
-  explicit MemTable(const InternalKeyComparator& comparator);
+  //
+  // If filter_bytes is positive, the user keys added are also kept in a
+  // wormhole filter of that size, which Get() probes before searching.
+  explicit MemTable(const InternalKeyComparator& comparator,
+                    size_t filter_bytes = 0, int fingerprint_bits = 12);
 
   MemTable(const MemTable&) = delete;
   MemTable& operator=(const MemTable&) = delete;
@@ -62,6 +67,10 @@ class MemTable {
   // Else, return false.
   bool Get(const LookupKey& key, std::string* value, Status* s);
 
+  // If this memtable has a filter that still holds every key added, append
+  // it to *dst as a filter of NewWormholeFilterPolicy() and return true.
+  bool EncodeFilter(std::string* dst) const;
+
  private:
   friend class MemTableIterator;
   friend class MemTableBackwardIterator;
@@ -80,6 +89,7 @@ class MemTable {
   int refs_;
   Arena arena_;
   Table table_;
+  WormholeTable* const filter_;  // Null if no filter was asked for
 };
 
 }  // namespace leveldb
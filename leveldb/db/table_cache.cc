@@ -8,9 +8,13 @@
 #include "leveldb/env.h"
 #include "leveldb/table.h"
 #include "util/coding.h"
+#include "util/perf_context_imp.h"
 
 namespace leveldb {
 
+static_assert(config::kNumLevels <= kNumFilterStatsLevels,
+              "filter counters are not kept for every level");
+
 struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
@@ -46,7 +50,7 @@ Status TableCache::NewRandomAccessFileForTable(const std::string& fname, RandomA
 }
 
 Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
-                             Cache::Handle** handle) {
+                             int level, Cache::Handle** handle) {
   Status s;
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
@@ -64,7 +68,12 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
       }
     }
     if (s.ok()) {
-      s = Table::Open(options_, file, file_size, &table);
+      std::string filter_fname;
+      if (!options_.filter_dir.empty()) {
+        filter_fname = FilterFileName(options_.filter_dir, file_number);
+      }
+      s = Table::Open(options_, file, file_size, &table, filter_fname, level,
+                      &stats_);
     }
 
     if (!s.ok()) {
@@ -84,13 +93,13 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
 
 Iterator* TableCache::NewIterator(const ReadOptions& options,
                                   uint64_t file_number, uint64_t file_size,
-                                  Table** tableptr) {
+                                  Table** tableptr, int level) {
   if (tableptr != nullptr) {
     *tableptr = nullptr;
   }
 
   Cache::Handle* handle = nullptr;
-  Status s = FindTable(file_number, file_size, &handle);
+  Status s = FindTable(file_number, file_size, level, &handle);
   if (!s.ok()) {
     return NewErrorIterator(s);
   }
@@ -106,13 +115,48 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
 
 Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
                        uint64_t file_size, const Slice& k, void* arg,
-                       void (*handle_result)(void*, const Slice&,
-                                             const Slice&)) {
+                       bool (*handle_result)(void*, const Slice&,
+                                             const Slice&),
+                       int level) {
+  PerfCount(&PerfContext::table_lookup_count);
+  Cache::Handle* handle = nullptr;
+  PerfTimer find_timer(&PerfContext::find_table_nanos);
+  Status s = FindTable(file_number, file_size, level, &handle);
+  find_timer.Stop();
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    s = t->InternalGet(options, k, arg, handle_result, level);
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+bool TableCache::PrefixMayMatch(uint64_t file_number, uint64_t file_size,
+                                const Slice& prefix, int level) {
+  Cache::Handle* handle = nullptr;
+  if (!FindTable(file_number, file_size, level, &handle).ok()) {
+    return true;  // Let the iterator report the error
+  }
+  Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  const bool may_match = t->PrefixMayMatch(prefix);
+  cache_->Release(handle);
+  return may_match;
+}
+
+Status TableCache::MultiGet(const ReadOptions& options, uint64_t file_number,
+                            uint64_t file_size, const Slice* keys, int n,
+                            void* const* args,
+                            bool (*handle_result)(void*, const Slice&,
+                                                  const Slice&),
+                            int level) {
+  PerfCount(&PerfContext::table_lookup_count, n);
   Cache::Handle* handle = nullptr;
-  Status s = FindTable(file_number, file_size, &handle);
+  PerfTimer find_timer(&PerfContext::find_table_nanos);
+  Status s = FindTable(file_number, file_size, level, &handle);
+  find_timer.Stop();
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-    s = t->InternalGet(options, k, arg, handle_result);
+    s = t->InternalMultiGet(options, keys, n, args, handle_result, level);
     cache_->Release(handle);
   }
   return s;
@@ -14,6 +14,7 @@
 #include "leveldb/cache.h"
 #include "leveldb/table.h"
 #include "port/port.h"
+#include "table/table_stats.h"
 
 namespace leveldb {
 
@@ -35,25 +36,53 @@ class TableCache {
   // underlies the returned iterator.  The returned "*tableptr" object is owned
   // by the cache and should not be deleted, and is valid for as long as the
   // returned iterator is live.
+  //
+  // "level" is the level the file is in, or -1 if not known.  It only
+  // matters if the table has to be opened (see
+  // Options::pin_l0_filter_and_index_blocks_in_cache).
   Iterator* NewIterator(const ReadOptions& options, uint64_t file_number,
-                        uint64_t file_size, Table** tableptr = nullptr);
+                        uint64_t file_size, Table** tableptr = nullptr,
+                        int level = -1);
 
   // If a seek to internal key "k" in specified file finds an entry,
-  // call (*handle_result)(arg, found_key, found_value).
+  // call (*handle_result)(arg, found_key, found_value), which returns true
+  // if the entry is for the key looked up.  Misses after a filter let "k"
+  // through count as false positives of "level" in stats().
   Status Get(const ReadOptions& options, uint64_t file_number,
              uint64_t file_size, const Slice& k, void* arg,
-             void (*handle_result)(void*, const Slice&, const Slice&));
+             bool (*handle_result)(void*, const Slice&, const Slice&),
+             int level = -1);
+
+  // Like Get() for keys[0,n-1], calling (*handle_result)(args[i], ...)
+  // for the entry found for keys[i].
+  Status MultiGet(const ReadOptions& options, uint64_t file_number,
+                  uint64_t file_size, const Slice* keys, int n,
+                  void* const* args,
+                  bool (*handle_result)(void*, const Slice&, const Slice&),
+                  int level = -1);
+
+  // Returns false if the prefix filter of the specified file rules out
+  // every key with the given prefix (see Options::prefix_extractor).
+  // Returns true if the table cannot be opened.
+  bool PrefixMayMatch(uint64_t file_number, uint64_t file_size,
+                      const Slice& prefix, int level = -1);
 
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
+  // Block cache hits and misses, and filter counters, of all tables
+  // opened through this cache
+  const TableStats& stats() const { return stats_; }
+
  private:
-  Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+  Status FindTable(uint64_t file_number, uint64_t file_size, int level,
+                   Cache::Handle**);
   Status NewRandomAccessFileForTable(const std::string& fname, RandomAccessFile** file);
   Env* const env_;
   const std::string dbname_;
   const Options& options_;
   Cache* cache_;
+  TableStats stats_;
 };
 
 }  // namespace leveldb
@@ -5,7 +5,9 @@
 #include "db/version_set.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdio>
+#include <thread>
 
 #include "db/filename.h"
 #include "db/log_reader.h"
@@ -13,11 +15,13 @@
 #include "db/memtable.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 #include "util/logging.h"
+#include "util/perf_context_imp.h"
 
 namespace leveldb {
 
@@ -226,12 +230,113 @@ Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
       vset_->table_cache_, options);
 }
 
+namespace {
+
+// Wraps the iterator over some sorted, non-overlapping files for reads
+// with ReadOptions::prefix_same_as_start.  Seek() skips the files whose
+// prefix filters rule out the prefix of the target, and leaves the
+// iterator invalid if no file that may hold the prefix is left.  Keys
+// beyond the prefix are not filtered: the caller stops at the first one.
+class PrefixSkippingIterator : public Iterator {
+ public:
+  PrefixSkippingIterator(Iterator* iter, std::vector<FileMetaData*> files,
+                         const InternalKeyComparator& icmp,
+                         const SliceTransform* prefix_extractor,
+                         TableCache* table_cache, int level)
+      : iter_(iter),
+        files_(std::move(files)),
+        icmp_(icmp),
+        prefix_extractor_(prefix_extractor),
+        table_cache_(table_cache),
+        level_(level),
+        filtered_(false) {}
+
+  ~PrefixSkippingIterator() override { delete iter_; }
+
+  bool Valid() const override { return !filtered_ && iter_->Valid(); }
+  void Seek(const Slice& target) override {
+    filtered_ = false;
+    if (!prefix_extractor_->InDomain(target)) {
+      iter_->Seek(target);
+      return;
+    }
+    const Slice prefix = prefix_extractor_->Transform(target);
+    const size_t first = FindFile(icmp_, files_, target);
+    for (size_t i = first; i < files_.size(); i++) {
+      const FileMetaData* f = files_[i];
+      if (i > first) {
+        // Keys with one prefix are adjacent, so a later file that starts
+        // with another prefix holds none of them
+        const Slice smallest = f->smallest.Encode();
+        if (!prefix_extractor_->InDomain(smallest) ||
+            prefix_extractor_->Transform(smallest) != prefix) {
+          break;
+        }
+      }
+      if (table_cache_->PrefixMayMatch(f->number, f->file_size, prefix,
+                                       level_)) {
+        iter_->Seek(i == first ? target : f->smallest.Encode());
+        return;
+      }
+    }
+    filtered_ = true;
+  }
+  void SeekToFirst() override {
+    filtered_ = false;
+    iter_->SeekToFirst();
+  }
+  void SeekToLast() override {
+    filtered_ = false;
+    iter_->SeekToLast();
+  }
+  void Next() override {
+    assert(Valid());
+    iter_->Next();
+  }
+  void Prev() override {
+    assert(Valid());
+    iter_->Prev();
+  }
+  Slice key() const override {
+    assert(Valid());
+    return iter_->key();
+  }
+  Slice value() const override {
+    assert(Valid());
+    return iter_->value();
+  }
+  Status status() const override { return iter_->status(); }
+
+ private:
+  Iterator* const iter_;
+  const std::vector<FileMetaData*> files_;
+  const InternalKeyComparator icmp_;
+  const SliceTransform* const prefix_extractor_;
+  TableCache* const table_cache_;
+  const int level_;
+  bool filtered_;  // The last Seek() found no file that may hold its prefix
+};
+
+}  // namespace
+
 void Version::AddIterators(const ReadOptions& options,
                            std::vector<Iterator*>* iters) {
+  // With prefix_same_as_start, seeks skip the files that cannot hold the
+  // prefix of the target
+  const SliceTransform* prefix_extractor =
+      options.prefix_same_as_start ? vset_->options_->prefix_extractor
+                                   : nullptr;
+
   // Merge all level zero files together since they may overlap
   for (size_t i = 0; i < files_[0].size(); i++) {
-    iters->push_back(vset_->table_cache_->NewIterator(
-        options, files_[0][i]->number, files_[0][i]->file_size));
+    Iterator* iter = vset_->table_cache_->NewIterator(
+        options, files_[0][i]->number, files_[0][i]->file_size, nullptr, 0);
+    if (prefix_extractor != nullptr) {
+      iter = new PrefixSkippingIterator(iter, {files_[0][i]}, vset_->icmp_,
+                                        prefix_extractor, vset_->table_cache_,
+                                        0);
+    }
+    iters->push_back(iter);
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
@@ -239,7 +344,13 @@ void Version::AddIterators(const ReadOptions& options,
   // lazily.
   for (int level = 1; level < config::kNumLevels; level++) {
     if (!files_[level].empty()) {
-      iters->push_back(NewConcatenatingIterator(options, level));
+      Iterator* iter = NewConcatenatingIterator(options, level);
+      if (prefix_extractor != nullptr) {
+        iter = new PrefixSkippingIterator(iter, files_[level], vset_->icmp_,
+                                          prefix_extractor,
+                                          vset_->table_cache_, level);
+      }
+      iters->push_back(iter);
     }
   }
 }
@@ -259,7 +370,7 @@ struct Saver {
   std::string* value;
 };
 }  // namespace
-static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
+static bool SaveValue(void* arg, const Slice& ikey, const Slice& v) {
   Saver* s = reinterpret_cast<Saver*>(arg);
   ParsedInternalKey parsed_key;
   if (!ParseInternalKey(ikey, &parsed_key)) {
@@ -272,6 +383,7 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
       }
     }
   }
+  return s->state != kNotFound;
 }
 
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
@@ -353,7 +465,8 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
 
       state->s = state->vset->table_cache_->Get(*state->options, f->number,
                                                 f->file_size, state->ikey,
-                                                &state->saver, SaveValue);
+                                                &state->saver, SaveValue,
+                                                level);
       if (!state->s.ok()) {
         state->found = true;
         return false;
@@ -399,6 +512,182 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   return state.found ? state.s : Status::NotFound(Slice());
 }
 
+namespace {
+// Progress of one key of Version::MultiGet().
+struct MultiGetKey {
+  Saver saver;
+  Slice ikey;
+  Version::GetStats* stats;
+  Status* status;
+  FileMetaData* last_file_read;
+  int last_file_read_level;
+  bool done;
+};
+
+// The keys of a MultiGet() that have to be looked up in one file.
+struct FileLookup {
+  int level;
+  FileMetaData* file;
+  std::vector<MultiGetKey*> keys;
+};
+}  // namespace
+
+void Version::MultiGet(const ReadOptions& options,
+                       const LookupKey* const* keys, size_t n,
+                       std::string* const* vals, Status* const* statuses,
+                       GetStats* stats) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  std::vector<MultiGetKey> state(n);
+  for (size_t i = 0; i < n; i++) {
+    MultiGetKey* k = &state[i];
+    k->saver.state = kNotFound;
+    k->saver.ucmp = ucmp;
+    k->saver.user_key = keys[i]->user_key();
+    k->saver.value = vals[i];
+    k->ikey = keys[i]->internal_key();
+    k->stats = &stats[i];
+    k->stats->seek_file = nullptr;
+    k->stats->seek_file_level = -1;
+    k->status = statuses[i];
+    *k->status = Status::NotFound(Slice());
+    k->last_file_read = nullptr;
+    k->last_file_read_level = -1;
+    k->done = false;
+  }
+
+  // Same bookkeeping as Get() does for each file it reads.
+  TableCache* table_cache = vset_->table_cache_;
+  auto search = [&options, table_cache](FileLookup* lookup) {
+    const size_t num_keys = lookup->keys.size();
+    std::vector<Slice> ikeys(num_keys);
+    std::vector<void*> savers(num_keys);
+    for (size_t i = 0; i < num_keys; i++) {
+      MultiGetKey* k = lookup->keys[i];
+      if (k->stats->seek_file == nullptr && k->last_file_read != nullptr) {
+        // We have had more than one seek for this read.  Charge the 1st file.
+        k->stats->seek_file = k->last_file_read;
+        k->stats->seek_file_level = k->last_file_read_level;
+      }
+      k->last_file_read = lookup->file;
+      k->last_file_read_level = lookup->level;
+      ikeys[i] = k->ikey;
+      savers[i] = &k->saver;
+    }
+
+    Status s = table_cache->MultiGet(
+        options, lookup->file->number, lookup->file->file_size, ikeys.data(),
+        static_cast<int>(num_keys), savers.data(), SaveValue, lookup->level);
+    for (size_t i = 0; i < num_keys; i++) {
+      MultiGetKey* k = lookup->keys[i];
+      if (!s.ok()) {
+        *k->status = s;
+        k->done = true;
+        continue;
+      }
+      switch (k->saver.state) {
+        case kNotFound:
+          break;  // Keep searching in other files
+        case kFound:
+          *k->status = Status::OK();
+          k->done = true;
+          break;
+        case kDeleted:
+          k->done = true;
+          break;
+        case kCorrupt:
+          *k->status = Status::Corruption("corrupted key for ",
+                                          k->saver.user_key);
+          k->done = true;
+          break;
+      }
+    }
+  };
+
+  // Level-0 files may overlap each other, so they are searched one at a
+  // time from newest to oldest.
+  std::vector<FileMetaData*> level0(files_[0]);
+  std::sort(level0.begin(), level0.end(), NewestFirst);
+  for (FileMetaData* f : level0) {
+    FileLookup lookup;
+    lookup.level = 0;
+    lookup.file = f;
+    for (size_t i = 0; i < n; i++) {
+      MultiGetKey* k = &state[i];
+      if (!k->done &&
+          ucmp->Compare(k->saver.user_key, f->smallest.user_key()) >= 0 &&
+          ucmp->Compare(k->saver.user_key, f->largest.user_key()) <= 0) {
+        lookup.keys.push_back(k);
+      }
+    }
+    if (!lookup.keys.empty()) {
+      search(&lookup);
+    }
+  }
+
+  // A key overlaps at most one file of every other level, so the files of
+  // a level can be searched independently of each other.
+  for (int level = 1; level < config::kNumLevels; level++) {
+    size_t num_files = files_[level].size();
+    if (num_files == 0) continue;
+
+    std::vector<std::pair<uint32_t, MultiGetKey*>> hits;
+    for (size_t i = 0; i < n; i++) {
+      MultiGetKey* k = &state[i];
+      if (k->done) continue;
+      uint32_t index = FindFile(vset_->icmp_, files_[level], k->ikey);
+      if (index < num_files &&
+          ucmp->Compare(k->saver.user_key,
+                        files_[level][index]->smallest.user_key()) >= 0) {
+        hits.push_back(std::make_pair(index, k));
+      }
+    }
+    if (hits.empty()) continue;
+
+    std::stable_sort(hits.begin(), hits.end(),
+                     [](const std::pair<uint32_t, MultiGetKey*>& a,
+                        const std::pair<uint32_t, MultiGetKey*>& b) {
+                       return a.first < b.first;
+                     });
+    std::vector<FileLookup> lookups;
+    for (size_t i = 0; i < hits.size(); i++) {
+      if (i == 0 || hits[i].first != hits[i - 1].first) {
+        lookups.emplace_back();
+        lookups.back().level = level;
+        lookups.back().file = files_[level][hits[i].first];
+      }
+      lookups.back().keys.push_back(hits[i].second);
+    }
+
+    const size_t num_threads = std::min<size_t>(
+        lookups.size(), std::max(options.max_parallel_reads, 1));
+    std::atomic<size_t> next_lookup(0);
+    auto worker = [&lookups, &next_lookup, &search]() {
+      size_t i;
+      while ((i = next_lookup.fetch_add(1, std::memory_order_relaxed)) <
+             lookups.size()) {
+        search(&lookups[i]);
+      }
+    };
+    // The other threads collect at the perf level of this one, and their
+    // counts are added to its perf context once they are done.
+    const PerfLevel caller_perf_level = GetPerfLevel();
+    std::vector<PerfContext> contexts(num_threads - 1);
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < num_threads; t++) {
+      threads.emplace_back([&worker, &contexts, caller_perf_level, t]() {
+        SetPerfLevel(caller_perf_level);
+        worker();
+        contexts[t - 1] = *GetPerfContext();
+      });
+    }
+    worker();
+    for (size_t t = 1; t < num_threads; t++) {
+      threads[t - 1].join();
+      PerfMerge(contexts[t - 1]);
+    }
+  }
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
   if (f != nullptr) {
@@ -467,6 +756,15 @@ bool Version::OverlapInLevel(int level, const Slice* smallest_user_key,
                                smallest_user_key, largest_user_key);
 }
 
+bool Version::IsBottommostLevel(int level) const {
+  for (int lvl = level + 1; lvl < config::kNumLevels; lvl++) {
+    if (!files_[lvl].empty()) {
+      return false;
+    }
+  }
+  return true;
+}
+
 int Version::PickLevelForMemTableOutput(const Slice& smallest_user_key,
                                         const Slice& largest_user_key) {
   int level = 0;
@@ -1232,8 +1530,8 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
       if (c->level() + which == 0) {
         const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
-          list[num++] = table_cache_->NewIterator(options, files[i]->number,
-                                                  files[i]->file_size);
+          list[num++] = table_cache_->NewIterator(
+              options, files[i]->number, files[i]->file_size, nullptr, 0);
         }
       } else {
         // Create concatenating iterator for the files from this level
@@ -75,6 +75,16 @@ class Version {
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
              GetStats* stats);
 
+  // Lookup the values for keys[0,n-1], with the same results as a Get()
+  // per key: the value of keys[i] goes to *vals[i], its status to
+  // *statuses[i] and its stats to stats[i].  Sstables that overlap several
+  // keys are searched once for all of them, and the sstables of a level
+  // are searched in parallel (see ReadOptions::max_parallel_reads).
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, const LookupKey* const* keys, size_t n,
+                std::string* const* vals, Status* const* statuses,
+                GetStats* stats);
+
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
   // REQUIRES: lock is held
@@ -111,6 +121,9 @@ class Version {
 
   int NumFiles(int level) const { return files_[level].size(); }
 
+  // Returns true iff no level below "level" holds any file.
+  bool IsBottommostLevel(int level) const;
+
   // Return a human readable string that describes this version's contents.
   std::string DebugString() const;
 
@@ -349,6 +362,13 @@ class Compaction {
   // in levels greater than "level+1".
   bool IsBaseLevelForKey(const Slice& user_key);
 
+  // Returns true iff no level below "level+1" holds any file of the input
+  // version, so that the outputs of this compaction go to the bottommost
+  // level.
+  bool IsBottommostLevel() const {
+    return input_version_->IsBottommostLevel(level_ + 1);
+  }
+
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
   bool ShouldStopBefore(const Slice& internal_key);
@@ -87,6 +87,16 @@ class LEVELDB_EXPORT DB {
   virtual Status Get(const ReadOptions& options, const Slice& key,
                      std::string* value) = 0;
 
+  // Look up keys[0,n-1] as one Get() each would, all as of the same
+  // state of the database, storing the result for keys[i] in values[i]
+  // and statuses[i].  Sstables that cover several of the keys are
+  // searched once for all of them, and keys that fall into the same
+  // block share one read of that block.
+  //
+  // The default implementation calls Get() once per key.
+  virtual void MultiGet(const ReadOptions& options, const Slice* keys,
+                        size_t n, std::string* values, Status* statuses);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -121,6 +131,18 @@ class LEVELDB_EXPORT DB {
   //     of the sstables that make up the db contents.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
+  //  "leveldb.block-cache-stats" - returns a multi-line string with the
+  //     block cache hits and misses of index, filter and data blocks
+  //     since the DB was opened, and the current block cache usage.
+  //  "leveldb.filter-stats" - returns a multi-line string with, per level,
+  //     how many keys point lookups probed the table filters for, how many
+  //     the filters rejected, how many of those would have been searched
+  //     in a data block, how many passed a filter but were not in their
+  //     data block, and the data block bytes the rejects did not read,
+  //     since the DB was opened.
+  //  "leveldb.data-block-lookups" - returns the number of data blocks
+  //     looked up, in the block cache or in the files, since the DB was
+  //     opened.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
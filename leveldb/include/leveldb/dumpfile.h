@@ -23,6 +23,22 @@ namespace leveldb {
 LEVELDB_EXPORT Status DumpFile(Env* env, const std::string& fname,
                                WritableFile* dst);
 
+// Write a table of the filters of every table of the database named by
+// "name", or of the table file named by "name", to *dst.  Each row gives
+// the number and bytes of the filters of one table, or of all tables of
+// one level, and for filters of NewWormholeFilterPolicy() their load
+// factor, the keys that found no slot, and the share of tags that wrapped
+// around the end of their bucket array.  Each level is followed by the
+// share of tags at every displacement from their home bucket.  Only the
+// footer, metaindex and filter blocks of each table are read, one table
+// at a time, through env->NewRandomAccessFile(), which maps the file where
+// it can; the "Read" column tells whether it did.
+//
+// The levels of tables come from the descriptor of the database, which
+// must have been created with the default comparator.
+LEVELDB_EXPORT Status DumpFilterStats(Env* env, const std::string& name,
+                                      WritableFile* dst);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_DUMPFILE_H_
@@ -16,6 +16,7 @@
 #ifndef STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
 #define STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
 
+#include <cstdint>
 #include <string>
 
 #include "leveldb/export.h"
@@ -49,6 +50,35 @@ class LEVELDB_EXPORT FilterPolicy {
   // This method may return true or false if the key was not on the
   // list, but it should aim to return false with a high probability.
   virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const = 0;
+
+  // Set out[i] to KeyMayMatch(keys[i], filter) for every i in [0,n-1].
+  // The default calls KeyMayMatch() once per key; a policy may override
+  // it to decode "filter" only once and to overlap the memory accesses
+  // of the whole batch.
+  virtual void KeysMayMatch(const Slice* keys, int n, const Slice& filter,
+                            bool* out) const;
+
+  // Return true if this policy can build a filter from 64-bit key hashes.
+  // Table builders then call HashKey() once per key as it is added and
+  // keep only the hash instead of a copy of the key, and call
+  // CreateFilterFromHashes() instead of CreateFilter().  The default
+  // returns false.
+  virtual bool SupportsHashing() const;
+
+  // Return the hash of "key" that CreateFilterFromHashes() expects.  The
+  // filter it builds must match exactly what CreateFilter() would have
+  // built from the keys.
+  //
+  // REQUIRES: SupportsHashing()
+  virtual uint64_t HashKey(const Slice& key) const;
+
+  // hashes[0,n-1] contains HashKey() of a list of keys ordered according
+  // to the user supplied comparator.  Consecutive duplicates have been
+  // removed.  Append a filter that summarizes the keys to *dst.
+  //
+  // REQUIRES: SupportsHashing()
+  virtual void CreateFilterFromHashes(const uint64_t* hashes, int n,
+                                      std::string* dst) const;
 };
 
 // Return a new filter policy that uses a bloom filter with approximately
@@ -67,7 +97,17 @@ class LEVELDB_EXPORT FilterPolicy {
 // trailing spaces in keys.
 LEVELDB_EXPORT const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 
-LEVELDB_EXPORT const FilterPolicy* NewWormholeFilterPolicy();
+// Return a new filter policy that stores one 16-bit tag per key in a
+// wormhole table of about "bits_per_key" bits per key.  Every tag keeps
+// "fingerprint_bits" bits of the key's hash; the remaining 16 -
+// fingerprint_bits bits record how far the tag was displaced from its
+// home bucket, so the probe window is 2^(16 - fingerprint_bits) buckets.
+// The false positive rate is about 4 * 16 / bits_per_key /
+// 2^fingerprint_bits: 0.09% with the defaults.  Tables are never filled
+// beyond 95% of their slots, so bits_per_key below about 17 has no effect.
+// fingerprint_bits is clamped to [8, 14].
+LEVELDB_EXPORT const FilterPolicy* NewWormholeFilterPolicy(
+    int bits_per_key = 17, int fingerprint_bits = 12);
 
 }  // namespace leveldb
 
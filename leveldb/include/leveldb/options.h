@@ -6,6 +6,8 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <cstddef>
+#include <string>
+#include <vector>
 
 #include "leveldb/export.h"
 
@@ -16,6 +18,7 @@ class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class SliceTransform;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -84,6 +87,16 @@ struct LEVELDB_EXPORT Options {
   // the next time the database is opened.
   size_t write_buffer_size = 4 * 1024 * 1024;
 
+  // If positive, every memtable keeps a wormhole filter over its user keys
+  // of write_buffer_size * memtable_filter_size_ratio bytes, in addition to
+  // the write buffer itself.  Reads of keys absent from a memtable then
+  // skip its skiplist search.  If filter_policy was returned by
+  // NewWormholeFilterPolicy() and full_filter is set without partitions,
+  // a flushed memtable writes its filter as the full filter of its table
+  // instead of building a new one.  A filter that runs out of room
+  // matches every key and is not reused.
+  double memtable_filter_size_ratio = 0;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
   // one open file per 2MB of working set).
@@ -102,6 +115,26 @@ struct LEVELDB_EXPORT Options {
   // compression is enabled.  This parameter can be changed dynamically.
   size_t block_size = 4 * 1024;
 
+  // If true, the index block and the filter of every table are kept in
+  // block_cache, charged at their size, instead of being held by the
+  // open table for as long as it stays in the table cache.  Memory for
+  // index and filter blocks is then bounded by the block cache capacity
+  // rather than by max_open_files, at the cost of re-reading them after
+  // eviction.  Blocks served from a mapping (mmap reads or filter_dir)
+  // take no heap and stay with the table.
+  bool cache_index_and_filter_blocks = false;
+
+  // If true and cache_index_and_filter_blocks is set, the index and
+  // filter blocks of level-0 tables stay in block_cache (still charged)
+  // for as long as the table is open.  Every lookup probes all level-0
+  // tables, so evicting their filters costs the most.
+  bool pin_l0_filter_and_index_blocks_in_cache = false;
+
+  // If true and cache_index_and_filter_blocks is set, the top-level index
+  // of a partitioned filter stays in block_cache for as long as the table
+  // is open; only the partitions themselves are evicted.
+  bool pin_top_level_index_and_filter = true;
+
   // Number of keys between restart points for delta encoding of keys.
   // This parameter can be changed dynamically.  Most clients should
   // leave this parameter alone.
@@ -147,6 +180,86 @@ struct LEVELDB_EXPORT Options {
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
   const FilterPolicy* filter_policy = nullptr;
+
+  // If true, tables are written with one filter over all of their keys
+  // (meta block "fullfilter.<Name>") instead of one filter per 2KB of
+  // data (meta block "filter.<Name>").  A full filter is probed once per
+  // lookup, before the index block is searched.  Tables written in either
+  // format stay readable regardless of this setting.
+  bool full_filter = false;
+
+  // If positive and full_filter is set, the full filter of a table is split
+  // into partitions of at least this many keys, cut at data block
+  // boundaries, plus a small top-level index from key range to partition
+  // (meta block "partitionedfilter.<Name>").  Only the index is read when
+  // a table is opened; partitions are read on demand and kept in
+  // block_cache.  With using_direct_io, every partition starts on a 4KB
+  // boundary so that a partition is fetched with the fewest aligned reads.
+  int filter_partition_keys = 0;
+
+  // If true, a table builder hands the filters it builds one block or one
+  // partition at a time to a pool of threads shared by all tables, one per
+  // core up to 8, and collects them when the table is finished, so that
+  // compactions do not wait for them and several filters build at once.
+  // Full filters that are not partitioned, and prefix filters, start
+  // building from the key hashes gathered so far as soon as the last key is
+  // added.  Only key hashes are queued, and a bounded number of them.  This
+  // applies to policies that support hashing, like the builtin ones.
+  bool background_filter_build = false;
+
+  // If non-empty, level_filter_policies[i], if non-null, replaces
+  // filter_policy for the tables written to level i.  This lets the small
+  // upper levels, which every lookup of a missing key goes through, get
+  // filters with fewer false positives than the large last levels, which
+  // hold most of the keys and therefore most of the filter memory: with
+  // NewWormholeFilterPolicy(), more fingerprint bits for levels 0 to 2 and
+  // fewer for the last level cut the block reads wasted per lookup of a
+  // missing key for about the same memory.
+  //
+  // Every entry must have the same Name() as filter_policy, whose filters
+  // must describe their own geometry, as the builtin ones do: tables are
+  // read with filter_policy, and keep their filters when they move to
+  // another level without being rewritten.
+  std::vector<const FilterPolicy*> level_filter_policies;
+
+  // If true, tables written to the bottommost level that holds data get no
+  // filter.  Most of the keys are there, so its filters take most of the
+  // filter memory and of the filter building work of compactions, but
+  // when almost every lookup that reaches that level finds its key they
+  // rule out almost nothing.  Tables without a filter are searched for
+  // every key.  Levels that later get data below them keep their tables
+  // without a filter until those are compacted again.
+  bool optimize_filters_for_hits = false;
+
+  // If non-null, every table also gets a wormhole filter over the prefixes
+  // of its keys, as extracted by prefix_extractor (meta block
+  // "prefixfilter.<Name>").  Iterators created with
+  // ReadOptions::prefix_same_as_start then skip the tables that hold no key
+  // with the prefix of a Seek() target, without reading any of their
+  // blocks.  Prefix filters are held by open tables like a filter that is
+  // not in block_cache.
+  const SliceTransform* prefix_extractor = nullptr;
+
+  // If non-empty, the filter block of every table is also kept in its own
+  // file "<filter_dir>/<number>.filter", written from the table the first
+  // time the table is opened.  Later opens map that file through env
+  // instead of reading the filter into memory, so with filter_dir on a
+  // DAX-mounted persistent memory file system filters take no DRAM and
+  // reopening a database reads no filters.  The file is deleted together
+  // with its table.  Partitioned filters are not affected.
+  std::string filter_dir;
+
+  // If positive, the database keeps a wormhole filter of this many bytes
+  // in memory over the user keys of all of its records.  Get() then
+  // answers for keys that are not in the database with one probe instead
+  // of searching the memtables and one filter per level.  Every key with
+  // a record takes a slot until a compaction drops its last record.  A
+  // filter that runs out of slots matches every key until compactions drop
+  // a quarter of its records, and is then rebuilt in the background.  The
+  // filter is saved when the database is closed, in filter_dir if set and
+  // in the database directory otherwise, and is rebuilt by reading every
+  // table when no valid saved copy is found.
+  size_t db_filter_size = 0;
 };
 
 // Options that control read operations
@@ -164,6 +277,20 @@ struct LEVELDB_EXPORT ReadOptions {
   // not have been released).  If "snapshot" is null, use an implicit
   // snapshot of the state at the beginning of this read operation.
   const Snapshot* snapshot = nullptr;
+
+  // DB::MultiGet() searches up to this many sstables of a level at the
+  // same time, so that their block reads overlap.  Every call starts and
+  // joins max_parallel_reads - 1 threads per level it searches, which costs
+  // more than it saves unless the blocks come from a slow disk; 1 searches
+  // the sstables one after another on the calling thread.
+  int max_parallel_reads = 1;
+
+  // If true and Options::prefix_extractor is set, an iterator is only used
+  // to read, with Seek() and Next(), the keys that share the prefix of the
+  // target of its last Seek().  The iterator becomes invalid after the
+  // last such key, and Seek() skips every table whose prefix filter does
+  // not hold the prefix.  Prev() is not supported in this mode.
+  bool prefix_same_as_start = false;
 };
 
 // Options that control write operations
@@ -0,0 +1,71 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PerfContext breaks the cost of the point lookups of one thread down by
+// stage.  Collection is off until the thread calls SetPerfLevel(), and the
+// counters keep adding up until the thread calls Reset(), so the cost of a
+// single DB::Get() is read by resetting the context before the call:
+//
+//   leveldb::SetPerfLevel(leveldb::kPerfEnableTime);
+//   leveldb::GetPerfContext()->Reset();
+//   db->Get(leveldb::ReadOptions(), key, &value);
+//   std::cout << leveldb::GetPerfContext()->ToString();
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+#define STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+enum PerfLevel {
+  kPerfDisable = 0,      // Collect nothing
+  kPerfEnableCount = 1,  // Collect the counters only
+  kPerfEnableTime = 2,   // Collect the counters and the stage timings
+};
+
+// Sets the perf level of the calling thread.
+LEVELDB_EXPORT void SetPerfLevel(PerfLevel level);
+
+// Returns the perf level of the calling thread.
+LEVELDB_EXPORT PerfLevel GetPerfLevel();
+
+// Stage timings are in nanoseconds.  They are taken with the cycle counter
+// of the CPU where there is one, so each costs a few nanoseconds, and they
+// nest: e.g. filter_probe_nanos is part of version_get_nanos, which is part
+// of get_nanos.
+struct LEVELDB_EXPORT PerfContext {
+  // Sets every counter to zero.
+  void Reset();
+
+  // Returns the non-zero counters as "name = value" pairs.
+  std::string ToString() const;
+
+  uint64_t get_nanos;           // Whole of DB::Get()
+  uint64_t mutex_wait_nanos;    // Acquiring the DB mutex
+  uint64_t memtable_get_nanos;  // Searching the memtable
+  uint64_t imm_get_nanos;       // Searching the memtable being compacted
+  uint64_t version_get_nanos;   // Searching the tables
+  uint64_t find_table_nanos;    // Finding (or opening) tables in the cache
+  uint64_t filter_probe_nanos;  // Probing table and database filters
+  uint64_t index_seek_nanos;    // Seeking the index block of a table
+  uint64_t block_read_nanos;    // Reading blocks from files
+  uint64_t block_seek_nanos;    // Seeking the key in a data block
+
+  uint64_t table_lookup_count;     // Tables the keys were looked up in
+  uint64_t filter_probe_count;     // Filters probed
+  uint64_t block_cache_hit_count;  // Data blocks found in the block cache
+  uint64_t block_read_count;       // Blocks read from files
+  uint64_t block_read_bytes;       // Bytes of the blocks read from files
+};
+
+// Returns the perf context of the calling thread.
+LEVELDB_EXPORT PerfContext* GetPerfContext();
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
@@ -0,0 +1,49 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A SliceTransform maps keys to their prefixes.  A database configured
+// with one (see Options::prefix_extractor) keeps a filter over the
+// prefixes of every table, so that iterators that only read the keys of
+// one prefix skip the tables that hold none of them.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+#define STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+
+#include <cstddef>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT SliceTransform {
+ public:
+  virtual ~SliceTransform();
+
+  // Return the name of this transform.  The name is stored with the
+  // prefix filter of every table, and tables written with a transform of
+  // another name are not filtered, so the name must change whenever the
+  // prefixes of existing keys would.
+  virtual const char* Name() const = 0;
+
+  // Return true if "key" has a prefix.
+  virtual bool InDomain(const Slice& key) const = 0;
+
+  // Return the prefix of "key", which must be a prefix of key's bytes.
+  // Keys with the same prefix must be adjacent in the order of the
+  // comparator.
+  // REQUIRES: InDomain(key)
+  virtual Slice Transform(const Slice& key) const = 0;
+};
+
+// Return a new transform whose prefix is the first "prefix_len" bytes of a
+// key.  Shorter keys have no prefix.  Works with the default comparator.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const SliceTransform* NewFixedPrefixTransform(size_t prefix_len);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_INCLUDE_TABLE_H_
 
 #include <cstdint>
+#include <string>
 
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
@@ -14,11 +15,13 @@ namespace leveldb {
 
 class Block;
 class BlockHandle;
+struct BlockContents;
 class Footer;
 struct Options;
 class RandomAccessFile;
 struct ReadOptions;
 class TableCache;
+struct TableStats;
 
 // A Table is a sorted map from strings to strings.  Tables are
 // immutable and persistent.  A Table may be safely accessed from
@@ -37,8 +40,14 @@ class LEVELDB_EXPORT Table {
   // for the duration of the returned table's lifetime.
   //
   // *file must remain live while this Table is in use.
+  //
+  // If "filter_file" is non-empty, the filter block is served from that
+  // file (see Options::filter_dir): it is mapped through options.env if
+  // it exists and matches the table, and written from the table first
+  // otherwise.
   static Status Open(const Options& options, RandomAccessFile* file,
-                     uint64_t file_size, Table** table);
+                     uint64_t file_size, Table** table,
+                     const std::string& filter_file = std::string());
 
   Table(const Table&) = delete;
   Table& operator=(const Table&) = delete;
@@ -66,15 +75,50 @@ class LEVELDB_EXPORT Table {
 
   explicit Table(Rep* rep) : rep_(rep) {}
 
+  // Open() for TableCache.  "level" is the level of the table, or -1 if
+  // not known, and decides whether its index and filter blocks are pinned
+  // in the block cache.  Block cache lookups are counted in *stats unless
+  // it is null.
+  static Status Open(const Options& options, RandomAccessFile* file,
+                     uint64_t file_size, Table** table,
+                     const std::string& filter_file, int level,
+                     TableStats* stats);
+
   // Calls (*handle_result)(arg, ...) with the entry found after a call
   // to Seek(key).  May not make such a call if filter policy says
-  // that key is not present.
+  // that key is not present.  handle_result returns whether the entry is
+  // the one looked up; if not, the filter let through a false positive,
+  // which is counted in the stats of "level" (see TableStats).
   Status InternalGet(const ReadOptions&, const Slice& key, void* arg,
-                     void (*handle_result)(void* arg, const Slice& k,
-                                           const Slice& v));
+                     bool (*handle_result)(void* arg, const Slice& k,
+                                           const Slice& v),
+                     int level);
+
+  // Like InternalGet() for keys[0,n-1], with args[i] passed for keys[i].
+  // The filter is probed for all keys at once, and keys that land in the
+  // same data block share one read of it.
+  Status InternalMultiGet(const ReadOptions&, const Slice* keys, int n,
+                          void* const* args,
+                          bool (*handle_result)(void* arg, const Slice& k,
+                                                const Slice& v),
+                          int level);
 
   void ReadMeta(const Footer& footer);
+  bool ReadFilterBlock(const BlockHandle& handle, BlockContents* contents);
+  bool MapFilterFile(const BlockHandle& handle, BlockContents* contents);
   void ReadFilter(const Slice& filter_handle_value);
+  void ReadFullFilter(const Slice& filter_handle_value);
+  void ReadFilterIndex(const Slice& filter_handle_value);
+  void ReadPrefixFilter(const Slice& filter_handle_value);
+
+  // Returns false if the prefix filter rules out every key whose prefix,
+  // under Options::prefix_extractor, is "prefix".  Tables without a prefix
+  // filter match every prefix.
+  bool PrefixMayMatch(const Slice& prefix) const;
+
+  // Returns false if the filter partition covering key rules it out.
+  // Reads the partition through the block cache if it is not resident.
+  bool PartitionMayMatch(const ReadOptions&, const Slice& key);
 
   Rep* const rep_;
 };
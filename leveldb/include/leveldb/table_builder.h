@@ -51,6 +51,14 @@ class LEVELDB_EXPORT TableBuilder {
   // REQUIRES: Finish(), Abandon() have not been called
   void Add(const Slice& key, const Slice& value);
 
+  // Advanced operation: write "filter" as the full filter of the table
+  // instead of building one from the added keys.  Has no effect unless
+  // options.full_filter is set without filter partitions.
+  // REQUIRES: filter was built by options.filter_policy and matches every
+  // key that is added.
+  // REQUIRES: Finish(), Abandon() have not been called
+  void SetFullFilter(const Slice& filter);
+
   // Advanced operation: flush any buffered key/value pairs to file.
   // Can be used to ensure that two adjacent entries never live in
   // the same data block.  Most clients should not need to use this method.
@@ -83,6 +91,7 @@ class LEVELDB_EXPORT TableBuilder {
   bool ok() const { return status().ok(); }
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
+  void PadTo(size_t alignment);
 
   struct Rep;
   Rep* rep_;
@@ -0,0 +1,185 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/background_filter_builder.h"
+
+#include <algorithm>
+#include <cassert>
+#include <thread>
+
+#include "leveldb/filter_policy.h"
+#include "util/mutexlock.h"
+#include "util/no_destructor.h"
+
+namespace leveldb {
+
+// Hashes staged before they are handed to the pool, and groups per table
+// handed to the pool before Add() waits for them.  The pool runs
+// kMaxPendingGroups groups of one table at once at most.
+static const size_t kGroupHashes = 4096;
+static const size_t kMaxPendingGroups = 8;
+
+// Threads of the pool, which all table builders share.
+static const int kMaxPoolThreads = 8;
+
+namespace {
+
+// A fixed set of threads that run the work items they are handed in the
+// order they are handed, several at once.  Like the background thread of
+// Env::Default(), it is started on first use and never destroyed.
+class FilterBuildPool {
+ public:
+  FilterBuildPool()
+      : cv_(&mutex_),
+        num_threads_(std::min(
+            std::max(1, static_cast<int>(std::thread::hardware_concurrency())),
+            kMaxPoolThreads)),
+        started_threads_(0),
+        idle_threads_(0) {}
+
+  FilterBuildPool(const FilterBuildPool&) = delete;
+  FilterBuildPool& operator=(const FilterBuildPool&) = delete;
+
+  static FilterBuildPool* Default() {
+    static NoDestructor<FilterBuildPool> pool;
+    return pool.get();
+  }
+
+  // Arranges to run "(*function)(arg)" on one of the pool's threads.
+  void Schedule(void (*function)(void*), void* arg) {
+    MutexLock l(&mutex_);
+    queue_.emplace_back(function, arg);
+    // Threads are started as work arrives, up to num_threads_
+    if (started_threads_ < num_threads_ &&
+        static_cast<int>(queue_.size()) > idle_threads_) {
+      started_threads_++;
+      std::thread(&FilterBuildPool::Run, this).detach();
+    }
+    cv_.Signal();
+  }
+
+ private:
+  struct WorkItem {
+    WorkItem(void (*function)(void*), void* arg)
+        : function(function), arg(arg) {}
+
+    void (*const function)(void*);
+    void* const arg;
+  };
+
+  void Run() {
+    mutex_.Lock();
+    while (true) {
+      while (queue_.empty()) {
+        idle_threads_++;
+        cv_.Wait();
+        idle_threads_--;
+      }
+      WorkItem item = queue_.front();
+      queue_.pop_front();
+      mutex_.Unlock();
+      item.function(item.arg);
+      mutex_.Lock();
+    }
+  }
+
+  port::Mutex mutex_;
+  port::CondVar cv_ GUARDED_BY(mutex_);
+  const int num_threads_;
+  int started_threads_ GUARDED_BY(mutex_);
+  int idle_threads_ GUARDED_BY(mutex_);  // Threads waiting for work
+  std::deque<WorkItem> queue_ GUARDED_BY(mutex_);
+};
+
+}  // namespace
+
+BackgroundFilterBuilder::BackgroundFilterBuilder(const FilterPolicy* policy)
+    : policy_(policy),
+      staged_hashes_(0),
+      num_filters_(0),
+      finished_(false),
+      cv_(&mutex_),
+      pending_groups_(0) {
+  assert(policy->SupportsHashing());
+}
+
+BackgroundFilterBuilder::~BackgroundFilterBuilder() {
+  if (!finished_) {
+    Finish();
+  }
+}
+
+size_t BackgroundFilterBuilder::Add(std::vector<uint64_t>* hashes) {
+  assert(!finished_);
+  if (staged_.hashes.empty()) {
+    staged_.first = num_filters_;
+  }
+  staged_hashes_ += hashes->size();
+  staged_.hashes.emplace_back();
+  staged_.hashes.back().swap(*hashes);
+  const size_t index = num_filters_++;
+  if (staged_hashes_ >= kGroupHashes) {
+    Submit();
+  }
+  return index;
+}
+
+void BackgroundFilterBuilder::Submit() {
+  if (staged_.hashes.empty()) {
+    return;
+  }
+  Group* group = new Group;
+  group->builder = this;
+  group->first = staged_.first;
+  group->hashes.swap(staged_.hashes);
+  staged_hashes_ = 0;
+  {
+    MutexLock l(&mutex_);
+    while (pending_groups_ >= kMaxPendingGroups) {
+      cv_.Wait();
+    }
+    pending_groups_++;
+    filters_.resize(num_filters_);
+  }
+  FilterBuildPool::Default()->Schedule(&BackgroundFilterBuilder::BuildGroup,
+                                       group);
+}
+
+void BackgroundFilterBuilder::Finish() {
+  assert(!finished_);
+  Submit();
+  finished_ = true;
+  MutexLock l(&mutex_);
+  while (pending_groups_ > 0) {
+    cv_.Wait();
+  }
+}
+
+void BackgroundFilterBuilder::TakeFilter(size_t i, std::string* dst) {
+  assert(finished_);
+  MutexLock l(&mutex_);
+  dst->swap(filters_[i]);
+}
+
+void BackgroundFilterBuilder::BuildGroup(void* arg) {
+  Group* group = reinterpret_cast<Group*>(arg);
+  BackgroundFilterBuilder* builder = group->builder;
+
+  std::vector<std::string> built(group->hashes.size());
+  for (size_t i = 0; i < group->hashes.size(); i++) {
+    const std::vector<uint64_t>& hashes = group->hashes[i];
+    builder->policy_->CreateFilterFromHashes(
+        hashes.data(), static_cast<int>(hashes.size()), &built[i]);
+  }
+
+  MutexLock l(&builder->mutex_);
+  for (size_t i = 0; i < built.size(); i++) {
+    builder->filters_[group->first + i].swap(built[i]);
+  }
+  builder->pending_groups_--;
+  builder->cv_.SignalAll();  // Room for Submit(), or the end of Finish()
+  delete group;
+}
+
+}  // namespace leveldb
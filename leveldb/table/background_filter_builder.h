@@ -0,0 +1,81 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_TABLE_BACKGROUND_FILTER_BUILDER_H_
+#define STORAGE_LEVELDB_TABLE_BACKGROUND_FILTER_BUILDER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "port/port.h"
+#include "port/thread_annotations.h"
+
+namespace leveldb {
+
+class FilterPolicy;
+
+// Builds the filters of one table on a pool of threads shared by every
+// table builder of the process, so that the table builder can go on adding
+// keys meanwhile (see Options::background_filter_build).  Filters are
+// built from key hashes with FilterPolicy::CreateFilterFromHashes(), in
+// groups that run on as many pool threads at once as there are groups
+// queued.  Only hashes are queued, and a bounded number of groups per
+// table, so memory use does not grow with the table.
+//
+// Not thread-safe: one thread calls Add(), Submit() and Finish().
+class BackgroundFilterBuilder {
+ public:
+  // REQUIRES: policy->SupportsHashing()
+  explicit BackgroundFilterBuilder(const FilterPolicy* policy);
+
+  BackgroundFilterBuilder(const BackgroundFilterBuilder&) = delete;
+  BackgroundFilterBuilder& operator=(const BackgroundFilterBuilder&) = delete;
+
+  // Waits for the filters still being built.
+  ~BackgroundFilterBuilder();
+
+  // Queues the filter over "*hashes", which is cleared, and returns its
+  // index among the filters queued so far.
+  size_t Add(std::vector<uint64_t>* hashes);
+
+  // Hands the filters added so far to the pool without waiting for them to
+  // be built.  Add() does so by itself once enough hashes are staged.
+  void Submit();
+
+  // Waits until every queued filter is built.
+  void Finish();
+
+  // Moves the filter of index "i" into *dst.
+  // REQUIRES: Finish() has been called
+  void TakeFilter(size_t i, std::string* dst);
+
+ private:
+  // Filters handed to the pool together, to keep its wakeups rare.
+  struct Group {
+    BackgroundFilterBuilder* builder;
+    size_t first;  // Index of the first filter
+    std::vector<std::vector<uint64_t>> hashes;
+  };
+
+  static void BuildGroup(void* arg);
+
+  const FilterPolicy* const policy_;
+  Group staged_;          // Filters not handed to the pool yet
+  size_t staged_hashes_;  // Hashes in staged_
+  size_t num_filters_;    // Filters queued so far
+  bool finished_;         // Finish() was called
+
+  port::Mutex mutex_;
+  port::CondVar cv_ GUARDED_BY(mutex_);
+  size_t pending_groups_ GUARDED_BY(mutex_);  // Handed to the pool, not built
+  std::deque<std::string> filters_ GUARDED_BY(mutex_);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_BACKGROUND_FILTER_BUILDER_H_
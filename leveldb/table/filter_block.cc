@@ -4,7 +4,11 @@
 
 #include "table/filter_block.h"
 
+#include <algorithm>
+#include <cassert>
+
 #include "leveldb/filter_policy.h"
+#include "table/background_filter_builder.h"
 #include "util/coding.h"
 
 namespace leveldb {
@@ -15,28 +19,95 @@ namespace leveldb {
 static const size_t kFilterBaseLg = 11;
 static const size_t kFilterBase = 1 << kFilterBaseLg;
 
-FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy)
-    : policy_(policy) {}
+FilterKeyBuffer::FilterKeyBuffer(const FilterPolicy* policy)
+    : policy_(policy), use_hashes_(policy->SupportsHashing()) {}
+
+void FilterKeyBuffer::Add(const Slice& key) {
+  if (use_hashes_) {
+    // Keys arrive in order, so repeated keys are adjacent
+    const uint64_t hash = policy_->HashKey(key);
+    if (hashes_.empty() || hashes_.back() != hash) {
+      hashes_.push_back(hash);
+    }
+  } else {
+    start_.push_back(keys_.size());
+    keys_.append(key.data(), key.size());
+  }
+}
+
+void FilterKeyBuffer::CreateFilter(std::string* dst) {
+  if (use_hashes_) {
+    policy_->CreateFilterFromHashes(hashes_.data(),
+                                    static_cast<int>(hashes_.size()), dst);
+    hashes_.clear();
+    return;
+  }
+
+  // Make list of keys from flattened key structure
+  const size_t num_keys = start_.size();
+  start_.push_back(keys_.size());  // Simplify length computation
+  tmp_keys_.resize(num_keys);
+  for (size_t i = 0; i < num_keys; i++) {
+    const char* base = keys_.data() + start_[i];
+    size_t length = start_[i + 1] - start_[i];
+    tmp_keys_[i] = Slice(base, length);
+  }
+  policy_->CreateFilter(tmp_keys_.data(), static_cast<int>(num_keys), dst);
+
+  tmp_keys_.clear();
+  keys_.clear();
+  start_.clear();
+}
+
+size_t FilterKeyBuffer::CreateFilter(BackgroundFilterBuilder* builder) {
+  assert(use_hashes_);
+  return builder->Add(&hashes_);
+}
+
+// Filters are only built in the background from hashes
+static BackgroundFilterBuilder* NewBackgroundFilterBuilder(
+    const FilterPolicy* policy, bool background) {
+  return background && policy->SupportsHashing()
+             ? new BackgroundFilterBuilder(policy)
+             : nullptr;
+}
+
+FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy,
+                                       bool background)
+    : keys_(policy),
+      background_(NewBackgroundFilterBuilder(policy, background)) {}
+
+FilterBlockBuilder::~FilterBlockBuilder() { delete background_; }
 
 void FilterBlockBuilder::StartBlock(uint64_t block_offset) {
   uint64_t filter_index = (block_offset / kFilterBase);
-  assert(filter_index >= filter_offsets_.size());
-  while (filter_index > filter_offsets_.size()) {
+  assert(filter_index >= num_filters());
+  while (filter_index > num_filters()) {
     GenerateFilter();
   }
 }
 
-void FilterBlockBuilder::AddKey(const Slice& key) {
-  Slice k = key;
-  start_.push_back(keys_.size());
-  keys_.append(k.data(), k.size());
-}
+void FilterBlockBuilder::AddKey(const Slice& key) { keys_.Add(key); }
 
 Slice FilterBlockBuilder::Finish() {
-  if (!start_.empty()) {
+  if (!keys_.empty()) {
     GenerateFilter();
   }
 
+  if (background_ != nullptr) {
+    // Lay out the filters built in the background in order
+    background_->Finish();
+    size_t next = 0;
+    std::string filter;
+    for (bool has_keys : has_keys_) {
+      filter_offsets_.push_back(result_.size());
+      if (has_keys) {
+        background_->TakeFilter(next++, &filter);
+        result_.append(filter);
+      }
+    }
+  }
+
   // Append array of per-filter offsets
   const uint32_t array_offset = result_.size();
   for (size_t i = 0; i < filter_offsets_.size(); i++) {
@@ -49,29 +120,23 @@ Slice FilterBlockBuilder::Finish() {
 }
 
 void FilterBlockBuilder::GenerateFilter() {
-  const size_t num_keys = start_.size();
-  if (num_keys == 0) {
-    // Fast path if there are no keys for this filter
-    filter_offsets_.push_back(result_.size());
+  if (background_ != nullptr) {
+    has_keys_.push_back(!keys_.empty());
+    if (!keys_.empty()) {
+      keys_.CreateFilter(background_);
+    }
     return;
   }
 
-  // Make list of keys from flattened key structure
-  start_.push_back(keys_.size());  // Simplify length computation
-  tmp_keys_.resize(num_keys);
-  for (size_t i = 0; i < num_keys; i++) {
-    const char* base = keys_.data() + start_[i];
-    size_t length = start_[i + 1] - start_[i];
-    tmp_keys_[i] = Slice(base, length);
+  if (keys_.empty()) {
+    // Fast path if there are no keys for this filter
+    filter_offsets_.push_back(result_.size());
+    return;
   }
 
   // Generate filter for current set of keys and append to result_.
   filter_offsets_.push_back(result_.size());
-  policy_->CreateFilter(&tmp_keys_[0], static_cast<int>(num_keys), &result_);
-
-  tmp_keys_.clear();
-  keys_.clear();
-  start_.clear();
+  keys_.CreateFilter(&result_);
 }
 
 FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
@@ -103,4 +168,132 @@ bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
   return true;  // Errors are treated as potential matches
 }
 
+Slice FilterBlockReader::filter(size_t i) const {
+  uint32_t start = DecodeFixed32(offset_ + i * 4);
+  uint32_t limit = DecodeFixed32(offset_ + i * 4 + 4);
+  if (start <= limit && limit <= static_cast<size_t>(offset_ - data_)) {
+    return Slice(data_ + start, limit - start);
+  }
+  return Slice();
+}
+
+FullFilterBlockBuilder::FullFilterBlockBuilder(const FilterPolicy* policy,
+                                               bool background)
+    : keys_(policy),
+      prebuilt_(false),
+      background_(NewBackgroundFilterBuilder(policy, background)),
+      keys_ended_(false),
+      building_(false) {}
+
+FullFilterBlockBuilder::~FullFilterBlockBuilder() { delete background_; }
+
+void FullFilterBlockBuilder::AddKey(const Slice& key) {
+  assert(!keys_ended_);
+  if (!prebuilt_) {
+    keys_.Add(key);
+  }
+}
+
+void FullFilterBlockBuilder::SetFilter(const Slice& filter) {
+  assert(!keys_ended_);
+  result_.assign(filter.data(), filter.size());
+  prebuilt_ = true;
+}
+
+void FullFilterBlockBuilder::EndKeys() {
+  assert(!keys_ended_);
+  keys_ended_ = true;
+  if (background_ != nullptr && !prebuilt_ && !keys_.empty()) {
+    // The hashes streamed so far are handed over as they are
+    keys_.CreateFilter(background_);
+    background_->Submit();
+    building_ = true;
+  }
+}
+
+Slice FullFilterBlockBuilder::Finish() {
+  if (!keys_ended_) {
+    EndKeys();
+  }
+  if (building_) {
+    background_->Finish();
+    background_->TakeFilter(0, &result_);
+    return Slice(result_);
+  }
+  if (prebuilt_ || keys_.empty()) {
+    // An empty full filter matches nothing; a prebuilt one is used as is
+    return Slice(result_);
+  }
+  keys_.CreateFilter(&result_);
+  return Slice(result_);
+}
+
+const FilterPolicy* PrefixFilterPolicy() {
+  static const FilterPolicy* const policy = NewWormholeFilterPolicy();
+  return policy;
+}
+
+FullFilterBlockReader::FullFilterBlockReader(const FilterPolicy* policy,
+                                             const Slice& contents)
+    : policy_(policy), contents_(contents) {}
+
+bool FullFilterBlockReader::KeyMayMatch(const Slice& key) {
+  if (contents_.empty()) {
+    // Empty filters do not match any keys
+    return false;
+  }
+  return policy_->KeyMayMatch(key, contents_);
+}
+
+void FullFilterBlockReader::KeysMayMatch(const Slice* keys, int n,
+                                         bool* out) {
+  if (contents_.empty()) {
+    std::fill(out, out + n, false);
+    return;
+  }
+  policy_->KeysMayMatch(keys, n, contents_, out);
+}
+
+PartitionedFilterBlockBuilder::PartitionedFilterBlockBuilder(
+    const FilterPolicy* policy, int partition_keys, bool background)
+    : keys_per_partition_(partition_keys),
+      keys_(policy),
+      background_(NewBackgroundFilterBuilder(policy, background)) {}
+
+PartitionedFilterBlockBuilder::~PartitionedFilterBlockBuilder() {
+  delete background_;
+}
+
+void PartitionedFilterBlockBuilder::AddKey(const Slice& key) {
+  keys_.Add(key);
+}
+
+void PartitionedFilterBlockBuilder::MaybeCutPartition(const Slice& last_key) {
+  if (keys_.size() >= keys_per_partition_) {
+    CutPartition(last_key);
+  }
+}
+
+void PartitionedFilterBlockBuilder::Finish(const Slice& last_key) {
+  if (!keys_.empty()) {
+    CutPartition(last_key);
+  }
+  if (background_ != nullptr) {
+    background_->Finish();
+    for (size_t i = 0; i < partitions_.size(); i++) {
+      background_->TakeFilter(i, &partitions_[i]);
+    }
+  }
+}
+
+void PartitionedFilterBlockBuilder::CutPartition(const Slice& last_key) {
+  partition_keys_.push_back(last_key.ToString());
+  partitions_.emplace_back();
+  if (background_ != nullptr) {
+    keys_.CreateFilter(background_);  // Its index is that of the partition
+  } else {
+    keys_.CreateFilter(&partitions_.back());
+  }
+}
+
 }  // namespace leveldb
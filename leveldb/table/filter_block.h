@@ -4,7 +4,8 @@
 //
 // A filter block is stored near the end of a Table file.  It contains
 // filters (e.g., bloom filters) for all data blocks in the table combined
-// into a single filter block.
+// into a single filter block, or a single "full" filter over all keys,
+// optionally split into key-range partitions.
 
 #ifndef STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
 #define STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
@@ -19,8 +20,40 @@
 
 namespace leveldb {
 
+class BackgroundFilterBuilder;
 class FilterPolicy;
 
+// The keys of one filter while it is being built.  If the policy supports
+// hashing, every key is hashed as it is added and only the hash is kept;
+// otherwise the key bytes are copied.
+class FilterKeyBuffer {
+ public:
+  explicit FilterKeyBuffer(const FilterPolicy*);
+
+  FilterKeyBuffer(const FilterKeyBuffer&) = delete;
+  FilterKeyBuffer& operator=(const FilterKeyBuffer&) = delete;
+
+  void Add(const Slice& key);
+  size_t size() const { return use_hashes_ ? hashes_.size() : start_.size(); }
+  bool empty() const { return size() == 0; }
+
+  // Appends the filter over the buffered keys to *dst and clears the buffer.
+  void CreateFilter(std::string* dst);
+
+  // Like CreateFilter(), but has *builder build the filter, and returns its
+  // index there.
+  // REQUIRES: The policy supports hashing
+  size_t CreateFilter(BackgroundFilterBuilder* builder);
+
+ private:
+  const FilterPolicy* policy_;
+  const bool use_hashes_;
+  std::vector<uint64_t> hashes_;  // Key hashes, if use_hashes_
+  std::string keys_;              // Flattened key contents, otherwise
+  std::vector<size_t> start_;     // Starting index in keys_ of each key
+  std::vector<Slice> tmp_keys_;   // policy_->CreateFilter() argument
+};
+
 // A FilterBlockBuilder is used to construct all of the filters for a
 // particular Table.  It generates a single string which is stored as
 // a special block in the Table.
@@ -29,11 +62,15 @@ class FilterPolicy;
 //      (StartBlock AddKey*)* Finish
 class FilterBlockBuilder {
  public:
-  explicit FilterBlockBuilder(const FilterPolicy*);
+  // If "background" is true and the policy supports hashing, filters are
+  // built on a thread of their own and collected by Finish().
+  explicit FilterBlockBuilder(const FilterPolicy*, bool background = false);
 
   FilterBlockBuilder(const FilterBlockBuilder&) = delete;
   FilterBlockBuilder& operator=(const FilterBlockBuilder&) = delete;
 
+  ~FilterBlockBuilder();
+
   void StartBlock(uint64_t block_offset);
   void AddKey(const Slice& key);
   Slice Finish();
@@ -41,12 +78,16 @@ class FilterBlockBuilder {
  private:
   void GenerateFilter();
 
-  const FilterPolicy* policy_;
-  std::string keys_;             // Flattened key contents
-  std::vector<size_t> start_;    // Starting index in keys_ of each key
-  std::string result_;           // Filter data computed so far
-  std::vector<Slice> tmp_keys_;  // policy_->CreateFilter() argument
+  // Number of filters generated so far
+  size_t num_filters() const {
+    return background_ != nullptr ? has_keys_.size() : filter_offsets_.size();
+  }
+
+  FilterKeyBuffer keys_;  // Keys of the filter being built
+  std::string result_;    // Filter data computed so far
   std::vector<uint32_t> filter_offsets_;
+  BackgroundFilterBuilder* background_;  // May be null
+  std::vector<bool> has_keys_;  // With background_: per filter, not empty
 };
 
 class FilterBlockReader {
@@ -55,6 +96,14 @@ class FilterBlockReader {
   FilterBlockReader(const FilterPolicy* policy, const Slice& contents);
   bool KeyMayMatch(uint64_t block_offset, const Slice& key);
 
+  // Number of filters in the block, one per 2^base_lg bytes of data blocks
+  size_t num_filters() const { return num_; }
+
+  // Returns filter i, which is empty if no data block starts in its range
+  // or if the block is corrupt.
+  // REQUIRES: i < num_filters()
+  Slice filter(size_t i) const;
+
  private:
   const FilterPolicy* policy_;
   const char* data_;    // Pointer to filter data (at block-start)
@@ -63,6 +112,106 @@ class FilterBlockReader {
   size_t base_lg_;      // Encoding parameter (see kFilterBaseLg in .cc file)
 };
 
+// A FullFilterBlockBuilder builds a single filter over every key of a
+// Table, so a lookup can be rejected before the index block is searched.
+//
+// The sequence of calls to FullFilterBlockBuilder must match the regexp:
+//      (AddKey | SetFilter)* EndKeys? Finish
+class FullFilterBlockBuilder {
+ public:
+  // If "background" is true and the policy supports hashing, the filter is
+  // built on the background filter pool from the hashes of the added keys,
+  // starting at EndKeys(), and collected by Finish().
+  explicit FullFilterBlockBuilder(const FilterPolicy*,
+                                  bool background = false);
+
+  FullFilterBlockBuilder(const FullFilterBlockBuilder&) = delete;
+  FullFilterBlockBuilder& operator=(const FullFilterBlockBuilder&) = delete;
+
+  ~FullFilterBlockBuilder();
+
+  void AddKey(const Slice& key);
+
+  // Makes Finish() return a copy of "filter", which must match every key,
+  // instead of a filter built from the added keys.
+  void SetFilter(const Slice& filter);
+
+  // No more keys will be added.  In the background, the filter starts
+  // building here, so that it overlaps whatever the caller does before
+  // Finish().  Finish() calls it if the caller did not.
+  void EndKeys();
+
+  Slice Finish();
+
+ private:
+  FilterKeyBuffer keys_;
+  std::string result_;  // Filter data
+  bool prebuilt_;       // Set by SetFilter(); result_ holds the filter
+  BackgroundFilterBuilder* background_;  // May be null
+  bool keys_ended_;                      // EndKeys() was called
+  bool building_;  // EndKeys() handed the filter to background_
+};
+
+// Returns the policy of the filters over key prefixes that tables get with
+// Options::prefix_extractor.  The result is never deleted.
+const FilterPolicy* PrefixFilterPolicy();
+
+class FullFilterBlockReader {
+ public:
+  // REQUIRES: "contents" and *policy must stay live while *this is live.
+  FullFilterBlockReader(const FilterPolicy* policy, const Slice& contents);
+  bool KeyMayMatch(const Slice& key);
+  void KeysMayMatch(const Slice* keys, int n, bool* out);
+
+ private:
+  const FilterPolicy* policy_;
+  Slice contents_;
+};
+
+// A PartitionedFilterBlockBuilder splits the full filter of a Table into
+// partitions that each cover a contiguous range of keys.  Partitions are
+// only closed at data block boundaries, so every partition is described by
+// the last key it covers, just like a data block in the index block.
+//
+// The sequence of calls to PartitionedFilterBlockBuilder must match the
+// regexp:
+//      (AddKey* MaybeCutPartition)* AddKey* Finish
+class PartitionedFilterBlockBuilder {
+ public:
+  // If "background" is true and the policy supports hashing, partitions
+  // are built on a thread of their own and collected by Finish().
+  PartitionedFilterBlockBuilder(const FilterPolicy*, int partition_keys,
+                                bool background = false);
+
+  PartitionedFilterBlockBuilder(const PartitionedFilterBlockBuilder&) = delete;
+  PartitionedFilterBlockBuilder& operator=(
+      const PartitionedFilterBlockBuilder&) = delete;
+
+  ~PartitionedFilterBlockBuilder();
+
+  void AddKey(const Slice& key);
+
+  // Closes the current partition if it holds at least partition_keys keys.
+  // "last_key" is the last key added to the table so far.
+  void MaybeCutPartition(const Slice& last_key);
+
+  // Closes the last partition.
+  void Finish(const Slice& last_key);
+
+  size_t num_partitions() const { return partition_keys_.size(); }
+  Slice partition_key(size_t i) const { return partition_keys_[i]; }
+  Slice partition(size_t i) const { return partitions_[i]; }
+
+ private:
+  void CutPartition(const Slice& last_key);
+
+  const size_t keys_per_partition_;
+  FilterKeyBuffer keys_;  // Keys of the open partition
+  std::vector<std::string> partition_keys_;  // Last key of each partition
+  std::vector<std::string> partitions_;      // Filter of each partition
+  BackgroundFilterBuilder* background_;      // May be null
+};
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
@@ -4,6 +4,10 @@
 
 #include "table/filter_block.h"
 
+#include <memory>
+#include <thread>
+#include <vector>
+
 #include "gtest/gtest.h"
 #include "leveldb/filter_policy.h"
 #include "util/coding.h"
@@ -119,4 +123,93 @@ TEST_F(FilterBlockTest, MultiChunk) {
   ASSERT_TRUE(!reader.KeyMayMatch(9000, "bar"));
 }
 
+TEST_F(FilterBlockTest, BackgroundBuild) {
+  // Filters built in the background are laid out exactly like the others,
+  // with enough keys to fill several groups of hashes
+  std::unique_ptr<const FilterPolicy> policy(NewWormholeFilterPolicy());
+  FilterBlockBuilder foreground(policy.get());
+  FilterBlockBuilder background(policy.get(), /*background=*/true);
+  PartitionedFilterBlockBuilder partitioned_foreground(policy.get(), 1000);
+  PartitionedFilterBlockBuilder partitioned_background(policy.get(), 1000,
+                                                       /*background=*/true);
+  FullFilterBlockBuilder full_foreground(policy.get());
+  FullFilterBlockBuilder full_background(policy.get(), /*background=*/true);
+  std::string key;
+  for (int i = 0; i < 50000; i++) {
+    if (i % 100 == 0) {
+      // Some filters are left empty
+      const uint64_t offset = (i / 100) * 2048 + ((i / 100) % 5 == 4) * 2048;
+      foreground.StartBlock(offset);
+      background.StartBlock(offset);
+      partitioned_foreground.MaybeCutPartition(key);
+      partitioned_background.MaybeCutPartition(key);
+    }
+    key = "key" + NumberToString(i);
+    foreground.AddKey(key);
+    background.AddKey(key);
+    partitioned_foreground.AddKey(key);
+    partitioned_background.AddKey(key);
+    full_foreground.AddKey(key);
+    full_background.AddKey(key);
+  }
+  ASSERT_EQ(foreground.Finish(), background.Finish());
+  full_background.EndKeys();
+  ASSERT_EQ(full_foreground.Finish(), full_background.Finish());
+
+  partitioned_foreground.Finish(key);
+  partitioned_background.Finish(key);
+  ASSERT_EQ(50, partitioned_background.num_partitions());
+  for (size_t i = 0; i < partitioned_foreground.num_partitions(); i++) {
+    ASSERT_EQ(partitioned_foreground.partition_key(i),
+              partitioned_background.partition_key(i));
+    ASSERT_EQ(partitioned_foreground.partition(i),
+              partitioned_background.partition(i));
+  }
+}
+
+TEST_F(FilterBlockTest, BackgroundBuildConcurrentTables) {
+  // Tables sharing the pool get the same filters as when built alone
+  std::unique_ptr<const FilterPolicy> policy(NewWormholeFilterPolicy());
+  const int kTables = 4;
+  std::string expected[kTables];
+  for (int t = 0; t < kTables; t++) {
+    PartitionedFilterBlockBuilder partitioned(policy.get(), 500);
+    std::string key;
+    for (int i = 0; i < 20000; i++) {
+      if (i % 100 == 0) partitioned.MaybeCutPartition(key);
+      key = "table" + NumberToString(t) + "key" + NumberToString(i);
+      partitioned.AddKey(key);
+    }
+    partitioned.Finish(key);
+    for (size_t i = 0; i < partitioned.num_partitions(); i++) {
+      expected[t].append(partitioned.partition(i).ToString());
+    }
+  }
+
+  std::string actual[kTables];
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kTables; t++) {
+    threads.emplace_back([&, t]() {
+      PartitionedFilterBlockBuilder partitioned(policy.get(), 500,
+                                                /*background=*/true);
+      std::string key;
+      for (int i = 0; i < 20000; i++) {
+        if (i % 100 == 0) partitioned.MaybeCutPartition(key);
+        key = "table" + NumberToString(t) + "key" + NumberToString(i);
+        partitioned.AddKey(key);
+      }
+      partitioned.Finish(key);
+      for (size_t i = 0; i < partitioned.num_partitions(); i++) {
+        actual[t].append(partitioned.partition(i).ToString());
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (int t = 0; t < kTables; t++) {
+    ASSERT_EQ(expected[t], actual[t]);
+  }
+}
+
 }  // namespace leveldb
@@ -10,6 +10,7 @@
 #include "table/block.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
+#include "util/perf_context_imp.h"
 
 namespace leveldb {
 
@@ -72,9 +73,14 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
   result->read_buffer = nullptr;
   result->cachable = false;
 
+  // Timed up to the end of decompression
+  PerfTimer timer(&PerfContext::block_read_nanos);
+  PerfCount(&PerfContext::block_read_count);
+
   // Read the block contents as well as the type/crc footer.
   // See table_builder.cc for the code that built this structure.
   size_t n = static_cast<size_t>(handle.size());
+  PerfCount(&PerfContext::block_read_bytes, n + kBlockTrailerSize);
   ReadBuffer read_buffer;
   Slice contents;
   Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, &read_buffer);
@@ -120,6 +126,7 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
       //data will be freed when read_buffer object is gone
       result->data = Slice(ubuf, ulength);
       result->read_buffer =  new ReadBuffer(ubuf, /*aligned=*/false);
+      result->cachable = true;
       break;
     }
     case kZstdCompression: {
@@ -134,6 +141,7 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
       }
       result->data = Slice(ubuf, ulength);
       result->read_buffer = new ReadBuffer(ubuf, /*aligned=*/false);
+      result->cachable = true;
       break;
     }
     default:
@@ -4,39 +4,319 @@
 
 #include "leveldb/table.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "table/table_stats.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/perf_context_imp.h"
 
 namespace leveldb {
 
+// An index block, a filter index block or a filter (including filter
+// partitions), as held by a table or kept in the block cache.
+struct MetaBlock {
+  MetaBlock()
+      : block(nullptr),
+        filter(nullptr),
+        full_filter(nullptr),
+        buffer(nullptr),
+        charge(0) {}
+  ~MetaBlock() {
+    delete block;
+    delete filter;
+    delete full_filter;
+    delete buffer;
+  }
+
+  Block* block;                        // Index and filter index blocks
+  FilterBlockReader* filter;           // Filter blocks
+  FullFilterBlockReader* full_filter;  // Full filters and partitions
+  ReadBuffer* buffer;                  // Owns the bytes behind a filter
+  size_t charge;                       // Bytes taken in the block cache
+};
+
+static void DeleteCachedMetaBlock(const Slice& key, void* value) {
+  delete reinterpret_cast<MetaBlock*>(value);
+}
+
+static void ReleaseBlock(void* arg, void* h) {
+  Cache* cache = reinterpret_cast<Cache*>(arg);
+  Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
+  cache->Release(handle);
+}
+
+static const int kNumMetaBlockKinds = kDataBlockKind;
+
 struct Table::Rep {
   ~Rep() {
-    delete filter;
-    delete[] filter_data;
-    delete index_block;
+    for (int i = 0; i < kNumMetaBlockKinds; i++) {
+      delete meta[i];
+      if (pinned[i] != nullptr) {
+        options.block_cache->Release(pinned[i]);
+      }
+    }
+    delete prefix_filter;
+    delete filter_file;
+  }
+
+  // Returns the block cache key of the block at "offset".
+  Slice CacheKey(uint64_t offset, char* buf) const {
+    EncodeFixed64(buf, cache_id);
+    EncodeFixed64(buf + 8, offset);
+    return Slice(buf, 16);
+  }
+
+  bool HasMetaBlock(BlockKind kind) const {
+    return meta_handle[kind].offset() != BlockHandle().offset();
+  }
+
+  void RecordCacheLookup(BlockKind kind, bool hit) {
+    if (stats != nullptr) {
+      stats->RecordCacheLookup(kind, hit);
+    }
+  }
+
+  MetaBlock* NewMetaBlock(BlockKind kind, const BlockContents& contents,
+                          bool full_filter);
+  void InstallMetaBlock(BlockKind kind, const BlockHandle& handle,
+                        const BlockContents& contents, bool pin);
+  MetaBlock* GetMetaBlock(const ReadOptions& options, BlockKind kind,
+                          Cache::Handle** cache_handle, Status* status);
+  void ReleaseMetaBlock(Cache::Handle* cache_handle);
+  Iterator* NewIndexIterator(const ReadOptions& options);
+  void SummarizeIndex(Block* index);
+  void RecordProbe(FilterStats* filter_stats, const Slice& key,
+                   bool may_match, uint64_t block_bytes);
+
+  // The filter counters of tables at "level", or null if not counted
+  FilterStats* LevelFilterStats(int level) {
+    return stats != nullptr ? stats->filter_stats(level) : nullptr;
   }
 
   Options options;
   Status status;
   RandomAccessFile* file;
   uint64_t cache_id;
-  FilterBlockReader* filter;
-  const char* filter_data;
+  TableStats* stats;  // May be null
+  std::string filter_fname;      // Options::filter_dir file, if any
+  RandomAccessFile* filter_file;  // Maps the filter block from filter_fname
+  bool full_filter;      // The filter block is a full filter
+  bool cache_meta_blocks;  // Options::cache_index_and_filter_blocks applies
+  bool pin_meta_blocks;    // ... and the table's meta blocks are pinned
+  MetaBlock* prefix_filter;  // Always held by the table; may be null
+
+  // Index summary for the filter counters of stats, see SummarizeIndex()
+  std::string last_index_key;    // Empty if the table has no data block
+  uint64_t average_block_bytes;  // Of a data block, trailer included
+
+  // The index, filter and filter index blocks, by BlockKind.  meta[kind]
+  // is the block if the table holds it; otherwise the block lives in
+  // block_cache under meta_handle[kind].offset(), and pinned[kind] is its
+  // cache entry if the table keeps it there.
+  MetaBlock* meta[kNumMetaBlockKinds];
+  BlockHandle meta_handle[kNumMetaBlockKinds];
+  Cache::Handle* pinned[kNumMetaBlockKinds];
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
-  Block* index_block;
 };
 
+MetaBlock* Table::Rep::NewMetaBlock(BlockKind kind,
+                                    const BlockContents& contents,
+                                    bool full_filter) {
+  MetaBlock* meta_block = new MetaBlock;
+  if (kind == kFilterBlockKind) {
+    meta_block->buffer = contents.read_buffer;
+    if (full_filter) {
+      meta_block->full_filter =
+          new FullFilterBlockReader(options.filter_policy, contents.data);
+    } else {
+      meta_block->filter =
+          new FilterBlockReader(options.filter_policy, contents.data);
+    }
+  } else {
+    meta_block->block = new Block(contents);
+  }
+  meta_block->charge = sizeof(MetaBlock) + contents.data.size();
+  return meta_block;
+}
+
+// Makes the block just read at "handle" the table's block of "kind".
+// Blocks whose bytes stay in a mapping take no memory of their own and
+// are always held by the table.
+void Table::Rep::InstallMetaBlock(BlockKind kind, const BlockHandle& handle,
+                                  const BlockContents& contents, bool pin) {
+  MetaBlock* meta_block = NewMetaBlock(kind, contents, full_filter);
+  if (kind == kIndexBlockKind) {
+    SummarizeIndex(meta_block->block);
+  }
+  meta_handle[kind] = handle;
+  if (!cache_meta_blocks || !contents.cachable) {
+    meta[kind] = meta_block;
+    return;
+  }
+
+  char cache_key_buffer[16];
+  Cache* block_cache = options.block_cache;
+  Cache::Handle* cache_handle =
+      block_cache->Insert(CacheKey(handle.offset(), cache_key_buffer),
+                          meta_block, meta_block->charge,
+                          &DeleteCachedMetaBlock);
+  if (pin) {
+    pinned[kind] = cache_handle;
+  } else {
+    block_cache->Release(cache_handle);
+  }
+}
+
+// Returns the table's block of "kind", or nullptr if the table has none
+// or it cannot be read, in which case *status (if non-null) says why.  If
+// *cache_handle is set, it must be passed to ReleaseMetaBlock() once the
+// block is no longer used.
+MetaBlock* Table::Rep::GetMetaBlock(const ReadOptions& options,
+                                    BlockKind kind,
+                                    Cache::Handle** cache_handle,
+                                    Status* status) {
+  *cache_handle = nullptr;
+  if (meta[kind] != nullptr) {
+    return meta[kind];
+  }
+  Cache* block_cache = this->options.block_cache;
+  if (pinned[kind] != nullptr) {
+    return reinterpret_cast<MetaBlock*>(block_cache->Value(pinned[kind]));
+  }
+  if (!HasMetaBlock(kind)) {
+    return nullptr;
+  }
+  const BlockHandle& handle = meta_handle[kind];
+
+  char cache_key_buffer[16];
+  Slice key = CacheKey(handle.offset(), cache_key_buffer);
+  *cache_handle = block_cache->Lookup(key);
+  RecordCacheLookup(kind, *cache_handle != nullptr);
+  if (*cache_handle == nullptr) {
+    // Evicted: read it again.  The block was cachable when the table was
+    // opened, so it is read from the table even with a filter file.
+    ReadOptions opt;
+    opt.verify_checksums =
+        options.verify_checksums || this->options.paranoid_checks;
+    BlockContents contents;
+    Status s = ReadBlock(file, opt, handle, &contents);
+    if (!s.ok()) {
+      if (status != nullptr) {
+        *status = s;
+      }
+      return nullptr;
+    }
+    MetaBlock* meta_block = NewMetaBlock(kind, contents, full_filter);
+    *cache_handle = block_cache->Insert(key, meta_block, meta_block->charge,
+                                        &DeleteCachedMetaBlock);
+  }
+  return reinterpret_cast<MetaBlock*>(block_cache->Value(*cache_handle));
+}
+
+void Table::Rep::ReleaseMetaBlock(Cache::Handle* cache_handle) {
+  if (cache_handle != nullptr) {
+    options.block_cache->Release(cache_handle);
+  }
+}
+
+// Records the last index key and the average data block size, which tell
+// the filter counters whether a reject saved a data block read and how
+// many bytes it saved.  Only tables whose filters are counted need them.
+void Table::Rep::SummarizeIndex(Block* index) {
+  last_index_key.clear();
+  average_block_bytes = 0;
+  if (stats == nullptr || options.filter_policy == nullptr) {
+    return;
+  }
+  uint64_t blocks = 0;
+  uint64_t bytes = 0;
+  Iterator* iter = index->NewIterator(options.comparator);
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    Slice input = iter->value();
+    BlockHandle handle;
+    if (handle.DecodeFrom(&input).ok()) {
+      blocks++;
+      bytes += handle.size() + kBlockTrailerSize;
+    }
+  }
+  iter->SeekToLast();
+  if (iter->Valid()) {
+    last_index_key = iter->key().ToString();
+  }
+  delete iter;
+  if (blocks > 0) {
+    average_block_bytes = bytes / blocks;
+  }
+}
+
+// Counts a probe of "key" that the filter answered with "may_match".
+// block_bytes is the size of the data block a reject saves reading, or 0
+// if the filter covers the whole table.
+void Table::Rep::RecordProbe(FilterStats* filter_stats, const Slice& key,
+                             bool may_match, uint64_t block_bytes) {
+  PerfCount(&PerfContext::filter_probe_count);
+  if (filter_stats == nullptr) {
+    return;
+  }
+  filter_stats->probes.fetch_add(1, std::memory_order_relaxed);
+  if (may_match) {
+    return;
+  }
+  filter_stats->rejects.fetch_add(1, std::memory_order_relaxed);
+  if (block_bytes == 0) {
+    // Keys past the last index entry would not have been searched
+    if (last_index_key.empty() ||
+        options.comparator->Compare(key, last_index_key) > 0) {
+      return;
+    }
+    block_bytes = average_block_bytes;
+  }
+  filter_stats->useful_rejects.fetch_add(1, std::memory_order_relaxed);
+  filter_stats->bytes_avoided.fetch_add(block_bytes,
+                                        std::memory_order_relaxed);
+}
+
+Iterator* Table::Rep::NewIndexIterator(const ReadOptions& options) {
+  Cache::Handle* cache_handle;
+  Status s;
+  MetaBlock* index = GetMetaBlock(options, kIndexBlockKind, &cache_handle, &s);
+  if (index == nullptr) {
+    return NewErrorIterator(s);
+  }
+  Iterator* iter = index->block->NewIterator(this->options.comparator);
+  if (cache_handle != nullptr) {
+    iter->RegisterCleanup(&ReleaseBlock, this->options.block_cache,
+                          cache_handle);
+  }
+  return iter;
+}
+
 Status Table::Open(const Options& options, RandomAccessFile* file,
-                   uint64_t size, Table** table) {
+                   uint64_t size, Table** table,
+                   const std::string& filter_file) {
+  return Open(options, file, size, table, filter_file, -1, nullptr);
+}
+
+Status Table::Open(const Options& options, RandomAccessFile* file,
+                   uint64_t size, Table** table,
+                   const std::string& filter_file, int level,
+                   TableStats* stats) {
   *table = nullptr;
   if (size < Footer::kEncodedLength) {
     return Status::Corruption("file is too short to be an sstable");
@@ -63,15 +343,27 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
   if (s.ok()) {
     // We've successfully read the footer and the index block: we're
     // ready to serve requests.
-    Block* index_block = new Block(index_block_contents);
     Rep* rep = new Table::Rep;
     rep->options = options;
     rep->file = file;
     rep->metaindex_handle = footer.metaindex_handle();
-    rep->index_block = index_block;
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
-    rep->filter_data = nullptr;
-    rep->filter = nullptr;
+    rep->stats = stats;
+    rep->filter_fname = filter_file;
+    rep->filter_file = nullptr;
+    rep->full_filter = false;
+    rep->prefix_filter = nullptr;
+    rep->average_block_bytes = 0;
+    rep->cache_meta_blocks = options.cache_index_and_filter_blocks &&
+                             options.block_cache != nullptr;
+    rep->pin_meta_blocks = rep->cache_meta_blocks && level == 0 &&
+                           options.pin_l0_filter_and_index_blocks_in_cache;
+    for (int i = 0; i < kNumMetaBlockKinds; i++) {
+      rep->meta[i] = nullptr;
+      rep->pinned[i] = nullptr;
+    }
+    rep->InstallMetaBlock(kIndexBlockKind, footer.index_handle(),
+                          index_block_contents, rep->pin_meta_blocks);
     *table = new Table(rep);
     (*table)->ReadMeta(footer);
   }
@@ -80,7 +372,8 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
 }
 
 void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == nullptr) {
+  if (rep_->options.filter_policy == nullptr &&
+      rep_->options.prefix_extractor == nullptr) {
     return;  // Do not need any metadata
   }
 
@@ -98,16 +391,163 @@ void Table::ReadMeta(const Footer& footer) {
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  if (rep_->options.filter_policy != nullptr) {
+    std::string key = "fullfilter.";
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFullFilter(iter->value());
+    } else {
+      key = "partitionedfilter.";
+      key.append(rep_->options.filter_policy->Name());
+      iter->Seek(key);
+      if (iter->Valid() && iter->key() == Slice(key)) {
+        ReadFilterIndex(iter->value());
+      } else {
+        key = "filter.";
+        key.append(rep_->options.filter_policy->Name());
+        iter->Seek(key);
+        if (iter->Valid() && iter->key() == Slice(key)) {
+          ReadFilter(iter->value());
+        }
+      }
+    }
+  }
+  if (rep_->options.prefix_extractor != nullptr) {
+    std::string key = "prefixfilter.";
+    key.append(rep_->options.prefix_extractor->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadPrefixFilter(iter->value());
+    }
   }
   delete iter;
   delete meta;
 }
 
+namespace {
+
+// A filter file holds the filter block followed by
+//    offset of the filter block in the table : fixed64
+//    size of the filter block                : fixed64
+//    masked crc32c of the filter block       : fixed32
+// so that a file left over from another table is never used.
+const size_t kFilterFileTrailerSize = 20;
+
+Status WriteFilterFile(Env* env, const std::string& fname,
+                       const BlockHandle& handle, const Slice& contents) {
+  std::string trailer;
+  PutFixed64(&trailer, handle.offset());
+  PutFixed64(&trailer, contents.size());
+  PutFixed32(&trailer,
+             crc32c::Mask(crc32c::Value(contents.data(), contents.size())));
+
+  // Write to a temporary name first so that a crash never leaves a
+  // truncated filter file behind.
+  const std::string tmp = fname + ".tmp";
+  WritableFile* file;
+  Status s = env->NewWritableFile(tmp, &file);
+  if (!s.ok()) {
+    return s;
+  }
+  s = file->Append(contents);
+  if (s.ok()) {
+    s = file->Append(trailer);
+  }
+  if (s.ok()) {
+    s = file->Sync();
+  }
+  if (s.ok()) {
+    s = file->Close();
+  }
+  delete file;
+  if (s.ok()) {
+    s = env->RenameFile(tmp, fname);
+  }
+  if (!s.ok()) {
+    env->RemoveFile(tmp);
+  }
+  return s;
+}
+
+}  // namespace
+
+// Fills *contents with the filter block at "handle".  With a filter file,
+// the block is mapped from it, and the file is written from the table
+// first if it is missing or belongs to another table.
+bool Table::ReadFilterBlock(const BlockHandle& handle,
+                            BlockContents* contents) {
+  if (!rep_->filter_fname.empty() && MapFilterFile(handle, contents)) {
+    return true;
+  }
+
+  // We might want to unify with ReadBlock() if we start
+  // requiring checksum verification in Table::Open.
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  if (!ReadBlock(rep_->file, opt, handle, contents).ok()) {
+    return false;
+  }
+  if (!rep_->filter_fname.empty() &&
+      WriteFilterFile(rep_->options.env, rep_->filter_fname, handle,
+                      contents->data)
+          .ok()) {
+    BlockContents mapped;
+    if (MapFilterFile(handle, &mapped)) {
+      delete contents->read_buffer;
+      *contents = mapped;
+    }
+  }
+  return true;
+}
+
+bool Table::MapFilterFile(const BlockHandle& handle, BlockContents* contents) {
+  Env* env = rep_->options.env;
+  const std::string& fname = rep_->filter_fname;
+  uint64_t file_size;
+  if (!env->GetFileSize(fname, &file_size).ok() ||
+      file_size != handle.size() + kFilterFileTrailerSize) {
+    return false;
+  }
+
+  RandomAccessFile* file;
+  if (!env->NewRandomAccessFile(fname, &file).ok()) {
+    return false;
+  }
+  ReadBuffer* buffer = new ReadBuffer;
+  Slice data;
+  Status s = file->Read(0, file_size, &data, buffer);
+  if (s.ok() && data.size() == file_size) {
+    const char* trailer = data.data() + handle.size();
+    if (DecodeFixed64(trailer) != handle.offset() ||
+        DecodeFixed64(trailer + 8) != handle.size()) {
+      s = Status::Corruption("filter file does not match table", fname);
+    } else if (rep_->options.paranoid_checks &&
+               crc32c::Unmask(DecodeFixed32(trailer + 16)) !=
+                   crc32c::Value(data.data(), handle.size())) {
+      s = Status::Corruption("filter file checksum mismatch", fname);
+    }
+  } else if (s.ok()) {
+    s = Status::Corruption("truncated filter file", fname);
+  }
+  if (!s.ok()) {
+    delete buffer;
+    delete file;
+    return false;
+  }
+
+  // When env maps the file, the filter bytes stay in the mapping and
+  // buffer holds nothing; otherwise buffer owns a copy of them.
+  delete rep_->filter_file;
+  rep_->filter_file = file;
+  contents->data = Slice(data.data(), handle.size());
+  contents->read_buffer = buffer;
+  contents->cachable = false;
+  return true;
+}
+
 void Table::ReadFilter(const Slice& filter_handle_value) {
   Slice v = filter_handle_value;
   BlockHandle filter_handle;
@@ -115,8 +555,47 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
     return;
   }
 
-  // We might want to unify with ReadBlock() if we start
-  // requiring checksum verification in Table::Open.
+  BlockContents block;
+  if (!ReadFilterBlock(filter_handle, &block)) {
+    return;
+  }
+  rep_->InstallMetaBlock(kFilterBlockKind, filter_handle, block,
+                         rep_->pin_meta_blocks);
+}
+
+void Table::ReadFullFilter(const Slice& filter_handle_value) {
+  rep_->full_filter = true;
+  ReadFilter(filter_handle_value);
+}
+
+void Table::ReadFilterIndex(const Slice& filter_handle_value) {
+  Slice v = filter_handle_value;
+  BlockHandle filter_handle;
+  if (!filter_handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
+  // Only the index is read here; partitions are read on first use.
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents block;
+  if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
+    return;
+  }
+  rep_->InstallMetaBlock(
+      kFilterIndexBlockKind, filter_handle, block,
+      rep_->pin_meta_blocks || rep_->options.pin_top_level_index_and_filter);
+}
+
+void Table::ReadPrefixFilter(const Slice& filter_handle_value) {
+  Slice v = filter_handle_value;
+  BlockHandle filter_handle;
+  if (!filter_handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
   ReadOptions opt;
   if (rep_->options.paranoid_checks) {
     opt.verify_checksums = true;
@@ -125,11 +604,16 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
     return;
   }
-  /*
-  if (block.heap_allocated) {
-    rep_->filter_data = block.data.data();  // Will need to delete later
-  }*/
-  rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
+  MetaBlock* prefix_filter = new MetaBlock;
+  prefix_filter->buffer = block.read_buffer;
+  prefix_filter->full_filter =
+      new FullFilterBlockReader(PrefixFilterPolicy(), block.data);
+  rep_->prefix_filter = prefix_filter;
+}
+
+bool Table::PrefixMayMatch(const Slice& prefix) const {
+  return rep_->prefix_filter == nullptr ||
+         rep_->prefix_filter->full_filter->KeyMayMatch(prefix);
 }
 
 Table::~Table() { delete rep_; }
@@ -143,12 +627,6 @@ static void DeleteCachedBlock(const Slice& key, void* value) {
   delete block;
 }
 
-static void ReleaseBlock(void* arg, void* h) {
-  Cache* cache = reinterpret_cast<Cache*>(arg);
-  Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
-  cache->Release(handle);
-}
-
 // Convert an index iterator value (i.e., an encoded BlockHandle)
 // into an iterator over the contents of the corresponding block.
 Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
@@ -168,11 +646,11 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
     BlockContents contents;
     if (block_cache != nullptr) {
       char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
-      EncodeFixed64(cache_key_buffer + 8, handle.offset());
-      Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+      Slice key = table->rep_->CacheKey(handle.offset(), cache_key_buffer);
       cache_handle = block_cache->Lookup(key);
+      table->rep_->RecordCacheLookup(kDataBlockKind, cache_handle != nullptr);
       if (cache_handle != nullptr) {
+        PerfCount(&PerfContext::block_cache_hit_count);
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
       } else {
         s = ReadBlock(table->rep_->file, options, handle, &contents);
@@ -207,31 +685,133 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
 }
 
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+  return NewTwoLevelIterator(rep_->NewIndexIterator(options),
+                             &Table::BlockReader, const_cast<Table*>(this),
+                             options);
+}
+
+bool Table::PartitionMayMatch(const ReadOptions& options, const Slice& k) {
+  Cache::Handle* index_handle;
+  MetaBlock* filter_index =
+      rep_->GetMetaBlock(options, kFilterIndexBlockKind, &index_handle,
+                         nullptr);
+  if (filter_index == nullptr) {
+    return true;
+  }
+  Iterator* iter = filter_index->block->NewIterator(rep_->options.comparator);
+  iter->Seek(k);
+  if (!iter->Valid()) {
+    // Past the last key of the table, unless the index itself is unreadable
+    bool may_match = !iter->status().ok();
+    delete iter;
+    rep_->ReleaseMetaBlock(index_handle);
+    return may_match;
+  }
+
+  BlockHandle handle;
+  Slice input = iter->value();
+  Status s = handle.DecodeFrom(&input);
+  delete iter;
+  rep_->ReleaseMetaBlock(index_handle);
+  if (!s.ok()) {
+    return true;
+  }
+
+  Cache* block_cache = rep_->options.block_cache;
+  Cache::Handle* cache_handle = nullptr;
+  MetaBlock* partition = nullptr;
+  char cache_key_buffer[16];
+  Slice key = rep_->CacheKey(handle.offset(), cache_key_buffer);
+  if (block_cache != nullptr) {
+    cache_handle = block_cache->Lookup(key);
+    rep_->RecordCacheLookup(kFilterBlockKind, cache_handle != nullptr);
+  }
+  if (cache_handle != nullptr) {
+    partition = reinterpret_cast<MetaBlock*>(block_cache->Value(cache_handle));
+  } else {
+    BlockContents contents;
+    if (!ReadBlock(rep_->file, options, handle, &contents).ok()) {
+      // Fall back to the index and data blocks
+      return true;
+    }
+    partition = rep_->NewMetaBlock(kFilterBlockKind, contents,
+                                   /*full_filter=*/true);
+    if (block_cache != nullptr && contents.cachable && options.fill_cache) {
+      cache_handle = block_cache->Insert(key, partition, partition->charge,
+                                         &DeleteCachedMetaBlock);
+    }
+  }
+
+  bool may_match = partition->full_filter->KeyMayMatch(k);
+  if (cache_handle != nullptr) {
+    block_cache->Release(cache_handle);
+  } else {
+    delete partition;
+  }
+  return may_match;
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
-                          void (*handle_result)(void*, const Slice&,
-                                                const Slice&)) {
+                          bool (*handle_result)(void*, const Slice&,
+                                                const Slice&),
+                          int level) {
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  FilterStats* filter_stats = rep_->LevelFilterStats(level);
+  bool filtered = false;  // A filter let k through
+  PerfTimer filter_timer(&PerfContext::filter_probe_nanos);
+  Cache::Handle* filter_handle;
+  MetaBlock* filter =
+      rep_->GetMetaBlock(options, kFilterBlockKind, &filter_handle, nullptr);
+  if (filter != nullptr && filter->full_filter != nullptr) {
+    filtered = filter->full_filter->KeyMayMatch(k);
+    rep_->RecordProbe(filter_stats, k, filtered, 0);
+    if (!filtered) {
+      // Not found; no need to search the index block
+      rep_->ReleaseMetaBlock(filter_handle);
+      return s;
+    }
+  }
+  if (rep_->HasMetaBlock(kFilterIndexBlockKind)) {
+    filtered = PartitionMayMatch(options, k);
+    rep_->RecordProbe(filter_stats, k, filtered, 0);
+    if (!filtered) {
+      rep_->ReleaseMetaBlock(filter_handle);
+      return s;
+    }
+  }
+  filter_timer.Stop();
+
+  PerfTimer index_timer(&PerfContext::index_seek_nanos);
+  Iterator* iiter = rep_->NewIndexIterator(options);
   iiter->Seek(k);
+  index_timer.Stop();
   if (iiter->Valid()) {
     Slice handle_value = iiter->value();
-    FilterBlockReader* filter = rep_->filter;
     BlockHandle handle;
-    if (filter != nullptr && handle.DecodeFrom(&handle_value).ok() &&
-        !filter->KeyMayMatch(handle.offset(), k)) {
+    bool may_match = true;
+    if (filter != nullptr && filter->filter != nullptr &&
+        handle.DecodeFrom(&handle_value).ok()) {
+      PerfTimer block_filter_timer(&PerfContext::filter_probe_nanos);
+      may_match = filter->filter->KeyMayMatch(handle.offset(), k);
+      rep_->RecordProbe(filter_stats, k, may_match,
+                        handle.size() + kBlockTrailerSize);
+      filtered = may_match;
+    }
+    if (!may_match) {
       // Not found
     } else {
       Iterator* block_iter = BlockReader(this, options, iiter->value());
+      PerfTimer seek_timer(&PerfContext::block_seek_nanos);
       block_iter->Seek(k);
+      seek_timer.Stop();
+      bool found = false;
       if (block_iter->Valid()) {
-        (*handle_result)(arg, block_iter->key(), block_iter->value());
+        found = (*handle_result)(arg, block_iter->key(), block_iter->value());
       }
       s = block_iter->status();
+      if (filtered && !found && s.ok() && filter_stats != nullptr) {
+        filter_stats->false_positives.fetch_add(1, std::memory_order_relaxed);
+      }
       delete block_iter;
     }
   }
@@ -239,12 +819,107 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
     s = iiter->status();
   }
   delete iiter;
+  rep_->ReleaseMetaBlock(filter_handle);
+  return s;
+}
+
+Status Table::InternalMultiGet(const ReadOptions& options, const Slice* keys,
+                               int n, void* const* args,
+                               bool (*handle_result)(void*, const Slice&,
+                                                     const Slice&),
+                               int level) {
+  FilterStats* filter_stats = rep_->LevelFilterStats(level);
+  bool filtered = false;  // Keys searched in a data block passed a filter
+  std::unique_ptr<bool[]> may_match(new bool[n]);
+  Cache::Handle* filter_handle;
+  MetaBlock* filter =
+      rep_->GetMetaBlock(options, kFilterBlockKind, &filter_handle, nullptr);
+  if (filter != nullptr && filter->full_filter != nullptr) {
+    filter->full_filter->KeysMayMatch(keys, n, may_match.get());
+    for (int i = 0; i < n; i++) {
+      rep_->RecordProbe(filter_stats, keys[i], may_match[i], 0);
+    }
+    filtered = true;
+  } else {
+    std::fill(may_match.get(), may_match.get() + n, true);
+  }
+  if (rep_->HasMetaBlock(kFilterIndexBlockKind)) {
+    for (int i = 0; i < n; i++) {
+      if (may_match[i]) {
+        may_match[i] = PartitionMayMatch(options, keys[i]);
+        rep_->RecordProbe(filter_stats, keys[i], may_match[i], 0);
+      }
+    }
+    filtered = true;
+  }
+
+  // Find the data block of every key that passed the filters
+  Status s;
+  std::vector<std::pair<uint64_t, int>> probes;  // (block offset, key)
+  std::vector<std::string> handle_values(n);
+  Iterator* iiter = rep_->NewIndexIterator(options);
+  for (int i = 0; i < n; i++) {
+    if (!may_match[i]) continue;
+    iiter->Seek(keys[i]);
+    if (!iiter->Valid()) continue;
+    Slice handle_value = iiter->value();
+    BlockHandle handle;
+    if (!handle.DecodeFrom(&handle_value).ok()) {
+      // Let BlockReader() report the corrupt handle
+    } else if (filter != nullptr && filter->filter != nullptr) {
+      const bool block_may_match =
+          filter->filter->KeyMayMatch(handle.offset(), keys[i]);
+      rep_->RecordProbe(filter_stats, keys[i], block_may_match,
+                        handle.size() + kBlockTrailerSize);
+      filtered = true;
+      if (!block_may_match) {
+        continue;  // Not found
+      }
+    }
+    handle_values[i] = iiter->value().ToString();
+    probes.push_back(std::make_pair(handle.offset(), i));
+  }
+  s = iiter->status();
+  delete iiter;
+  rep_->ReleaseMetaBlock(filter_handle);
+
+  // Read every block once and search it for all of its keys
+  std::stable_sort(probes.begin(), probes.end(),
+                   [](const std::pair<uint64_t, int>& a,
+                      const std::pair<uint64_t, int>& b) {
+                     return a.first < b.first;
+                   });
+  uint64_t false_positives = 0;
+  for (size_t i = 0; i < probes.size() && s.ok();) {
+    Iterator* block_iter =
+        BlockReader(this, options, handle_values[probes[i].second]);
+    size_t end = i;
+    while (end < probes.size() && probes[end].first == probes[i].first) {
+      int k = probes[end].second;
+      block_iter->Seek(keys[k]);
+      bool found = false;
+      if (block_iter->Valid()) {
+        found = (*handle_result)(args[k], block_iter->key(),
+                                 block_iter->value());
+      }
+      if (!found && block_iter->status().ok()) {
+        false_positives++;
+      }
+      end++;
+    }
+    s = block_iter->status();
+    delete block_iter;
+    i = end;
+  }
+  if (filtered && filter_stats != nullptr) {
+    filter_stats->false_positives.fetch_add(false_positives,
+                                            std::memory_order_relaxed);
+  }
   return s;
 }
 
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = rep_->NewIndexIterator(ReadOptions());
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
@@ -269,4 +944,50 @@ uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
   return result;
 }
 
+void TableStats::AppendFilterStats(std::string* out) const {
+  char buf[200];
+  std::snprintf(buf, sizeof(buf),
+                "Level     Probes    Rejects     Useful  FP reads  FP rate"
+                "  Avoided(MB)\n"
+                "-------------------------------------------------------"
+                "-------------\n");
+  out->append(buf);
+  for (int level = 0; level < kNumFilterStatsLevels; level++) {
+    const FilterStats& f = filter[level];
+    uint64_t probes = f.probes.load(std::memory_order_relaxed);
+    if (probes == 0) continue;
+    uint64_t rejects = f.rejects.load(std::memory_order_relaxed);
+    uint64_t fp = f.false_positives.load(std::memory_order_relaxed);
+    std::snprintf(
+        buf, sizeof(buf), "%5d %10llu %10llu %10llu %9llu %7.2f%% %12.1f\n",
+        level, static_cast<unsigned long long>(probes),
+        static_cast<unsigned long long>(rejects),
+        static_cast<unsigned long long>(
+            f.useful_rejects.load(std::memory_order_relaxed)),
+        static_cast<unsigned long long>(fp),
+        rejects + fp == 0 ? 0.0 : 100.0 * fp / (rejects + fp),
+        f.bytes_avoided.load(std::memory_order_relaxed) / 1048576.0);
+    out->append(buf);
+  }
+}
+
+void TableStats::AppendCacheStats(std::string* out) const {
+  static const char* const kNames[kNumBlockKinds] = {"index", "filter",
+                                                     "filter-index", "data"};
+  char buf[200];
+  std::snprintf(buf, sizeof(buf),
+                "Block           Hits     Misses  Hit rate\n"
+                "-----------------------------------------\n");
+  out->append(buf);
+  for (int i = 0; i < kNumBlockKinds; i++) {
+    uint64_t hits = cache_hits[i].load(std::memory_order_relaxed);
+    uint64_t misses = cache_misses[i].load(std::memory_order_relaxed);
+    std::snprintf(buf, sizeof(buf), "%-12s %10llu %10llu %8.1f%%\n",
+                  kNames[i], static_cast<unsigned long long>(hits),
+                  static_cast<unsigned long long>(misses),
+                  hits + misses == 0 ? 0.0 : 100.0 * hits / (hits + misses));
+    out->append(buf);
+  }
+}
+
 }  // namespace leveldb
@@ -10,6 +10,7 @@
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
 #include "table/block_builder.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -18,6 +19,9 @@
 
 namespace leveldb {
 
+// Filter partitions of tables read with direct I/O start on this boundary.
+static const size_t kFilterPartitionAlignment = 4096;
+
 struct TableBuilder::Rep {
   Rep(const Options& opt, WritableFile* f)
       : options(opt),
@@ -28,9 +32,29 @@ struct TableBuilder::Rep {
         index_block(&index_block_options),
         num_entries(0),
         closed(false),
-        filter_block(opt.filter_policy == nullptr
+        filter_block(opt.filter_policy == nullptr || opt.full_filter
                          ? nullptr
-                         : new FilterBlockBuilder(opt.filter_policy)),
+                         : new FilterBlockBuilder(
+                               opt.filter_policy, opt.background_filter_build)),
+        full_filter_block(opt.filter_policy == nullptr || !opt.full_filter ||
+                                  opt.filter_partition_keys > 0
+                              ? nullptr
+                              : new FullFilterBlockBuilder(
+                                    opt.filter_policy,
+                                    opt.background_filter_build)),
+        partitioned_filter_block(
+            opt.filter_policy == nullptr || !opt.full_filter ||
+                    opt.filter_partition_keys <= 0
+                ? nullptr
+                : new PartitionedFilterBlockBuilder(
+                      opt.filter_policy, opt.filter_partition_keys,
+                      opt.background_filter_build)),
+        filter_index_block(&index_block_options),
+        prefix_filter_block(opt.prefix_extractor == nullptr
+                                ? nullptr
+                                : new FullFilterBlockBuilder(
+                                      PrefixFilterPolicy(),
+                                      opt.background_filter_build)),
         pending_index_entry(false) {
     index_block_options.block_restart_interval = 1;
   }
@@ -46,6 +70,10 @@ struct TableBuilder::Rep {
   int64_t num_entries;
   bool closed;  // Either Finish() or Abandon() has been called.
   FilterBlockBuilder* filter_block;
+  FullFilterBlockBuilder* full_filter_block;
+  PartitionedFilterBlockBuilder* partitioned_filter_block;
+  BlockBuilder filter_index_block;  // Last key -> handle of each partition
+  FullFilterBlockBuilder* prefix_filter_block;  // Options::prefix_extractor
 
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
@@ -72,6 +100,9 @@ TableBuilder::TableBuilder(const Options& options, WritableFile* file)
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
   delete rep_->filter_block;
+  delete rep_->full_filter_block;
+  delete rep_->partitioned_filter_block;
+  delete rep_->prefix_filter_block;
   delete rep_;
 }
 
@@ -82,6 +113,12 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   if (options.comparator != rep_->options.comparator) {
     return Status::InvalidArgument("changing comparator while building table");
   }
+  if (options.full_filter != rep_->options.full_filter ||
+      options.filter_partition_keys != rep_->options.filter_partition_keys ||
+      options.prefix_extractor != rep_->options.prefix_extractor) {
+    return Status::InvalidArgument(
+        "changing filter format while building table");
+  }
 
   // Note that any live BlockBuilders point to rep_->options and therefore
   // will automatically pick up the updated options.
@@ -111,6 +148,17 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   if (r->filter_block != nullptr) {
     r->filter_block->AddKey(key);
   }
+  if (r->full_filter_block != nullptr) {
+    r->full_filter_block->AddKey(key);
+  }
+  if (r->partitioned_filter_block != nullptr) {
+    r->partitioned_filter_block->AddKey(key);
+  }
+  if (r->prefix_filter_block != nullptr &&
+      r->options.prefix_extractor->InDomain(key)) {
+    // Keys sharing a prefix are adjacent, so the builder keeps one copy
+    r->prefix_filter_block->AddKey(r->options.prefix_extractor->Transform(key));
+  }
 
   r->last_key.assign(key.data(), key.size());
   r->num_entries++;
@@ -122,6 +170,14 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   }
 }
 
+void TableBuilder::SetFullFilter(const Slice& filter) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  if (r->full_filter_block != nullptr) {
+    r->full_filter_block->SetFilter(filter);
+  }
+}
+
 void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
@@ -136,6 +192,9 @@ void TableBuilder::Flush() {
   if (r->filter_block != nullptr) {
     r->filter_block->StartBlock(r->offset);
   }
+  if (r->partitioned_filter_block != nullptr) {
+    r->partitioned_filter_block->MaybeCutPartition(r->last_key);
+  }
 }
 
 void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
@@ -208,21 +267,68 @@ void TableBuilder::WriteRawBlock(const Slice& block_contents,
   }
 }
 
+void TableBuilder::PadTo(size_t alignment) {
+  Rep* r = rep_;
+  const size_t pad = (alignment - r->offset % alignment) % alignment;
+  if (pad > 0) {
+    r->status = r->file->Append(std::string(pad, '\0'));
+    if (r->status.ok()) {
+      r->offset += pad;
+    }
+  }
+}
+
 Status TableBuilder::status() const { return rep_->status; }
 
 Status TableBuilder::Finish() {
   Rep* r = rep_;
+  // Full filters built in the background start here, while the last data
+  // block is written
+  if (r->full_filter_block != nullptr) {
+    r->full_filter_block->EndKeys();
+  }
+  if (r->prefix_filter_block != nullptr) {
+    r->prefix_filter_block->EndKeys();
+  }
   Flush();
   assert(!r->closed);
   r->closed = true;
 
   BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle prefix_filter_block_handle;
 
   // Write filter block
   if (ok() && r->filter_block != nullptr) {
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
   }
+  if (ok() && r->full_filter_block != nullptr) {
+    WriteRawBlock(r->full_filter_block->Finish(), kNoCompression,
+                  &filter_block_handle);
+  }
+  if (ok() && r->partitioned_filter_block != nullptr) {
+    PartitionedFilterBlockBuilder* partitioned = r->partitioned_filter_block;
+    partitioned->Finish(r->last_key);
+    for (size_t i = 0; ok() && i < partitioned->num_partitions(); i++) {
+      if (r->options.using_direct_io) {
+        PadTo(kFilterPartitionAlignment);
+      }
+      BlockHandle partition_handle;
+      WriteRawBlock(partitioned->partition(i), kNoCompression,
+                    &partition_handle);
+      std::string handle_encoding;
+      partition_handle.EncodeTo(&handle_encoding);
+      r->filter_index_block.Add(partitioned->partition_key(i),
+                                handle_encoding);
+    }
+    if (ok()) {
+      WriteBlock(&r->filter_index_block, &filter_block_handle);
+    }
+  }
+  if (ok() && r->prefix_filter_block != nullptr) {
+    WriteRawBlock(r->prefix_filter_block->Finish(), kNoCompression,
+                  &prefix_filter_block_handle);
+  }
 
   // Write metaindex block
   if (ok()) {
@@ -235,6 +341,32 @@ Status TableBuilder::Finish() {
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
     }
+    if (r->full_filter_block != nullptr) {
+      // Add mapping from "fullfilter.Name" to location of filter data
+      std::string key = "fullfilter.";
+      key.append(r->options.filter_policy->Name());
+      std::string handle_encoding;
+      filter_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(key, handle_encoding);
+    }
+    if (r->partitioned_filter_block != nullptr) {
+      // Add mapping from "partitionedfilter.Name" to location of the
+      // partition index
+      std::string key = "partitionedfilter.";
+      key.append(r->options.filter_policy->Name());
+      std::string handle_encoding;
+      filter_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(key, handle_encoding);
+    }
+    if (r->prefix_filter_block != nullptr) {
+      // Add mapping from "prefixfilter.Name" to location of the prefix
+      // filter, named after the extractor that its keys came from
+      std::string key = "prefixfilter.";
+      key.append(r->options.prefix_extractor->Name());
+      std::string handle_encoding;
+      prefix_filter_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(key, handle_encoding);
+    }
 
     // TODO(postrelease): Add stats and other meta blocks
     WriteBlock(&meta_index_block, &metaindex_block_handle);
@@ -0,0 +1,88 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Thread-safe (provides internal synchronization)
+
+#ifndef STORAGE_LEVELDB_TABLE_TABLE_STATS_H_
+#define STORAGE_LEVELDB_TABLE_TABLE_STATS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace leveldb {
+
+// Kinds of blocks a table looks up in the block cache.
+enum BlockKind {
+  kIndexBlockKind,
+  kFilterBlockKind,     // Filter, full filter or filter partition
+  kFilterIndexBlockKind,  // Top-level index of a partitioned filter
+  kDataBlockKind,
+  kNumBlockKinds
+};
+
+// Number of levels filter counters are kept for.  At least
+// config::kNumLevels; probes of tables at other levels are not counted.
+static const int kNumFilterStatsLevels = 7;
+
+// How the filters of the tables at one level did on point lookups.  A key
+// is probed once per table, whatever kind of filter the table has.
+struct FilterStats {
+  FilterStats()
+      : probes(0),
+        rejects(0),
+        useful_rejects(0),
+        false_positives(0),
+        bytes_avoided(0) {}
+
+  std::atomic<uint64_t> probes;
+  std::atomic<uint64_t> rejects;  // Probes the filter ruled out
+  // Rejects of keys that would have been searched in a data block, i.e.
+  // that were not past the last key of the table.
+  std::atomic<uint64_t> useful_rejects;
+  // Probes that passed the filter but whose data block lacked the key
+  std::atomic<uint64_t> false_positives;
+  // Data block bytes the useful rejects did not read.  Rejects by a whole
+  // table filter are charged the table's average data block size.
+  std::atomic<uint64_t> bytes_avoided;
+};
+
+// Counters shared by all tables of one TableCache.
+struct TableStats {
+  TableStats() {
+    for (int i = 0; i < kNumBlockKinds; i++) {
+      cache_hits[i] = 0;
+      cache_misses[i] = 0;
+    }
+  }
+
+  TableStats(const TableStats&) = delete;
+  TableStats& operator=(const TableStats&) = delete;
+
+  void RecordCacheLookup(BlockKind kind, bool hit) {
+    (hit ? cache_hits : cache_misses)[kind].fetch_add(
+        1, std::memory_order_relaxed);
+  }
+
+  // Returns the filter counters of "level", or null if they are not kept.
+  FilterStats* filter_stats(int level) {
+    return (level >= 0 && level < kNumFilterStatsLevels) ? &filter[level]
+                                                         : nullptr;
+  }
+
+  // Appends one line of block cache hits and misses per block kind.
+  void AppendCacheStats(std::string* out) const;
+
+  // Appends one line of filter counters per level whose filters were
+  // probed.
+  void AppendFilterStats(std::string* out) const;
+
+  std::atomic<uint64_t> cache_hits[kNumBlockKinds];
+  std::atomic<uint64_t> cache_misses[kNumBlockKinds];
+  FilterStats filter[kNumFilterStatsLevels];
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_TABLE_STATS_H_
@@ -5,6 +5,7 @@
 #include "leveldb/filter_policy.h"
 
 #include <iostream>
+#include <vector>
 
 #include "leveldb/slice.h"
 #include "util/hash.h"
@@ -28,8 +29,20 @@ class BloomFilterPolicy : public FilterPolicy {
   const char* Name() const override { return "leveldb.BuiltinBloomFilter2"; }
 
   void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    std::vector<uint64_t> hashes(n);
+    for (int i = 0; i < n; i++) {
+      hashes[i] = BloomHash(keys[i]);
+    }
+    CreateFilterFromHashes(hashes.data(), n, dst);
+  }
+
+  bool SupportsHashing() const override { return true; }
+
+  uint64_t HashKey(const Slice& key) const override { return BloomHash(key); }
+
+  void CreateFilterFromHashes(const uint64_t* hashes, int n,
+                              std::string* dst) const override {
     // Compute bloom filter size (in both bits and bytes)
-    //std::cout<<n<<std::endl;
     size_t bits = n * bits_per_key_;
 
     // For small n, we can see a very high false positive rate.  Fix it
@@ -46,7 +59,7 @@ class BloomFilterPolicy : public FilterPolicy {
     for (int i = 0; i < n; i++) {
       // Use double-hashing to generate a sequence of hash values.
       // See analysis in [Kirsch,Mitzenmacher 2006].
-      uint32_t h = BloomHash(keys[i]);
+      uint32_t h = static_cast<uint32_t>(hashes[i]);
       const uint32_t delta = (h >> 17) | (h << 15);  // Rotate right 17 bits
       for (size_t j = 0; j < k_; j++) {
         const uint32_t bitpos = h % bits;
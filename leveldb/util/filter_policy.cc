@@ -4,8 +4,31 @@
 
 #include "leveldb/filter_policy.h"
 
+#include <cassert>
+
+#include "leveldb/slice.h"
+
 namespace leveldb {
 
 FilterPolicy::~FilterPolicy() {}
 
+void FilterPolicy::KeysMayMatch(const Slice* keys, int n, const Slice& filter,
+                                bool* out) const {
+  for (int i = 0; i < n; i++) {
+    out[i] = KeyMayMatch(keys[i], filter);
+  }
+}
+
+bool FilterPolicy::SupportsHashing() const { return false; }
+
+uint64_t FilterPolicy::HashKey(const Slice& key) const {
+  assert(false);
+  return 0;
+}
+
+void FilterPolicy::CreateFilterFromHashes(const uint64_t* hashes, int n,
+                                          std::string* dst) const {
+  assert(false);
+}
+
 }  // namespace leveldb
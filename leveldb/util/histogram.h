@@ -20,14 +20,14 @@ class Histogram {
 
   std::string ToString() const;
 
- private:
-  enum { kNumBuckets = 154 };
-
   double Median() const;
   double Percentile(double p) const;
   double Average() const;
   double StandardDeviation() const;
 
+ private:
+  enum { kNumBuckets = 154 };
+
   static const double kBucketLimit[kNumBuckets];
 
   double min_;
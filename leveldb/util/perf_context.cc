@@ -0,0 +1,100 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/perf_context.h"
+
+#include <chrono>
+#include <cstdio>
+
+#include "util/perf_context_imp.h"
+
+namespace leveldb {
+
+thread_local PerfLevel perf_level = kPerfDisable;
+thread_local PerfContext perf_context;
+
+namespace {
+
+struct PerfField {
+  const char* name;
+  uint64_t PerfContext::*metric;
+};
+
+const PerfField kPerfFields[] = {
+    {"get_nanos", &PerfContext::get_nanos},
+    {"mutex_wait_nanos", &PerfContext::mutex_wait_nanos},
+    {"memtable_get_nanos", &PerfContext::memtable_get_nanos},
+    {"imm_get_nanos", &PerfContext::imm_get_nanos},
+    {"version_get_nanos", &PerfContext::version_get_nanos},
+    {"find_table_nanos", &PerfContext::find_table_nanos},
+    {"filter_probe_nanos", &PerfContext::filter_probe_nanos},
+    {"index_seek_nanos", &PerfContext::index_seek_nanos},
+    {"block_read_nanos", &PerfContext::block_read_nanos},
+    {"block_seek_nanos", &PerfContext::block_seek_nanos},
+    {"table_lookup_count", &PerfContext::table_lookup_count},
+    {"filter_probe_count", &PerfContext::filter_probe_count},
+    {"block_cache_hit_count", &PerfContext::block_cache_hit_count},
+    {"block_read_count", &PerfContext::block_read_count},
+    {"block_read_bytes", &PerfContext::block_read_bytes},
+};
+
+// Compares the ticks of PerfNowTicks() with the steady clock over a
+// millisecond.  The cycle counters of current CPUs tick at a constant rate
+// whatever the frequency of the core.
+double MeasureNanosPerTick() {
+  using Clock = std::chrono::steady_clock;
+  const Clock::time_point start = Clock::now();
+  const uint64_t start_ticks = PerfNowTicks();
+  Clock::time_point now;
+  do {
+    now = Clock::now();
+  } while (now - start < std::chrono::milliseconds(1));
+  const uint64_t ticks = PerfNowTicks() - start_ticks;
+  const double nanos =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(now - start)
+          .count();
+  return ticks == 0 ? 1.0 : nanos / ticks;
+}
+
+}  // namespace
+
+double PerfNanosPerTick() {
+  static const double nanos_per_tick = MeasureNanosPerTick();
+  return nanos_per_tick;
+}
+
+void SetPerfLevel(PerfLevel level) {
+  if (level >= kPerfEnableTime) {
+    PerfNanosPerTick();  // Calibrate outside of the first timed call
+  }
+  perf_level = level;
+}
+
+PerfLevel GetPerfLevel() { return perf_level; }
+
+void PerfMerge(const PerfContext& other) {
+  for (const PerfField& field : kPerfFields) {
+    perf_context.*field.metric += other.*field.metric;
+  }
+}
+
+PerfContext* GetPerfContext() { return &perf_context; }
+
+void PerfContext::Reset() { *this = PerfContext(); }
+
+std::string PerfContext::ToString() const {
+  std::string result;
+  char buf[100];
+  for (const PerfField& field : kPerfFields) {
+    const uint64_t value = this->*field.metric;
+    if (value != 0) {
+      std::snprintf(buf, sizeof(buf), "%s%s = %llu", result.empty() ? "" : ", ",
+                    field.name, static_cast<unsigned long long>(value));
+      result.append(buf);
+    }
+  }
+  return result;
+}
+
+}  // namespace leveldb
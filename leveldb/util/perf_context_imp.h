@@ -0,0 +1,78 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Collection side of leveldb/perf_context.h.  Code on the read path counts
+// with PerfCount() and times its stages with a PerfTimer; both only test
+// the thread's perf level when collection is off.
+
+#ifndef STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
+#define STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
+
+#include <chrono>
+#include <cstdint>
+
+#include "leveldb/perf_context.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace leveldb {
+
+extern thread_local PerfLevel perf_level;
+extern thread_local PerfContext perf_context;
+
+// Reads the cycle counter, or a clock in nanoseconds where there is none.
+inline uint64_t PerfNowTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+// Nanoseconds per PerfNowTicks() tick, measured the first time it is called.
+double PerfNanosPerTick();
+
+inline void PerfCount(uint64_t PerfContext::*metric, uint64_t n = 1) {
+  if (perf_level >= kPerfEnableCount) {
+    perf_context.*metric += n;
+  }
+}
+
+// Adds every count and timing of "other" to the thread's perf context, e.g.
+// those of threads that did part of the thread's work.
+void PerfMerge(const PerfContext& other);
+
+// Adds the time from its construction to Stop() or its destruction,
+// whichever comes first, to a timing of the thread's perf context.
+class PerfTimer {
+ public:
+  explicit PerfTimer(uint64_t PerfContext::*metric)
+      : metric_(metric),
+        start_(perf_level >= kPerfEnableTime ? PerfNowTicks() : 0) {}
+
+  PerfTimer(const PerfTimer&) = delete;
+  PerfTimer& operator=(const PerfTimer&) = delete;
+
+  ~PerfTimer() { Stop(); }
+
+  void Stop() {
+    if (start_ != 0) {
+      perf_context.*metric_ += static_cast<uint64_t>(
+          (PerfNowTicks() - start_) * PerfNanosPerTick());
+      start_ = 0;
+    }
+  }
+
+ private:
+  uint64_t PerfContext::*const metric_;
+  uint64_t start_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
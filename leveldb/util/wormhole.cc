@@ -2,192 +2,433 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
+#include <algorithm>
 #include <iostream>
 #include <random>
 #include <bitset>
+#include <cstring>
+#include <vector>
 
 #include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
 
+#include "util/coding.h"
 #include "util/hash.h"
+#include "util/wormhole.h"
+#include "util/wormhole_kernel.h"
 
-#define BIT_PER_TAG 16
-#define BIT_PER_FPT 12
-#define TAG_PER_BUK 4
+// Highest fraction of slots CreateFilter() fills.  Keys that find no slot
+// within their probe window go to the stash instead.
+#define MAX_LOAD 0.95
 
-#define TAG_MASK (0xFFFFULL)
-#define DIS_MASK (0x000FULL)
-#define FPT_MASK (0xFFF0ULL)
+namespace leveldb {
 
-#define MAX_PROB 16
+uint64_t WormholeHash(const Slice& key) {
+  return Hash64(key.data(), key.size(), 0xbc9f1d34bc9f1d34);
+}
 
-#define MOD(idx, num_buckets_) ((idx) & (num_buckets_ - 1))
+namespace {
 
-#define haszero16(x) \
-  (((x)-0x0001000100010001ULL) & (~(x)) & 0x8000800080008000ULL)
-#define hasvalue16(x, n) (haszero16((x) ^ (0x0001000100010001ULL * (n))))
+using wormhole::SlotLayout;
+using wormhole::WrapIndex;
 
-namespace leveldb {
+// Maps hv onto [0, num_buckets_) with a multiply-shift instead of a modulo,
+// so any number of buckets can be used.
+inline uint32_t IndexHash(uint32_t hv, uint64_t num_buckets_) {
+  return (static_cast<uint64_t>(hv) * num_buckets_) >> 32;
+}
 
-namespace {
+// Buckets of a filter being built in a string.
+class PlainBuckets {
+ public:
+  PlainBuckets(char* array, uint64_t num_buckets)
+      : array_(array), num_buckets_(num_buckets) {}
 
-static uint64_t WormholeHash(const Slice& key) {
-  return Hash64(key.data(), key.size(), 0xbc9f1d34bc9f1d34);
+  uint64_t num_buckets() const { return num_buckets_; }
+
+  uint32_t ReadTag(uint64_t i, uint32_t j) const {
+    const char* p = array_ + WrapIndex(i, num_buckets_) * 8;
+    return reinterpret_cast<const uint16_t*>(p)[j];
+  }
+
+  void WriteTag(uint64_t i, uint32_t j, uint32_t t) {
+    char* p = array_ + WrapIndex(i, num_buckets_) * 8;
+    reinterpret_cast<uint16_t*>(p)[j] = t;
+  }
+
+  void MoveTag(uint64_t i, uint32_t j, uint32_t t) { WriteTag(i, j, t); }
+
+ private:
+  char* const array_;
+  const uint64_t num_buckets_;
+};
+
+// Buckets of a WormholeTable.  Slot j of a bucket is bits [16j, 16j + 16)
+// of its word, which is where PlainBuckets puts it on a little-endian
+// machine, and every write replaces a whole word so that concurrent
+// readers never see a torn slot.
+class AtomicBuckets {
+ public:
+  AtomicBuckets(std::atomic<uint64_t>* words, uint64_t num_buckets)
+      : words_(words), num_buckets_(num_buckets) {}
+
+  uint64_t num_buckets() const { return num_buckets_; }
+
+  uint32_t ReadTag(uint64_t i, uint32_t j) const {
+    uint64_t word =
+        words_[WrapIndex(i, num_buckets_)].load(std::memory_order_relaxed);
+    return (word >> (16 * j)) & 0xffff;
+  }
+
+  void WriteTag(uint64_t i, uint32_t j, uint32_t t) {
+    std::atomic<uint64_t>& word = words_[WrapIndex(i, num_buckets_)];
+    uint64_t w = word.load(std::memory_order_relaxed);
+    w = (w & ~(0xffffULL << (16 * j))) | (static_cast<uint64_t>(t) << (16 * j));
+    word.store(w, std::memory_order_relaxed);
+  }
+
+  void MoveTag(uint64_t i, uint32_t j, uint32_t t) { WriteTag(i, j, t); }
+
+ private:
+  std::atomic<uint64_t>* const words_;
+  const uint64_t num_buckets_;
+};
+
+// Places the tag of hashcode in its probe window.
+template <typename Buckets>
+bool InsertItem(uint64_t hashcode, Buckets* buckets, const SlotLayout& layout) {
+  return wormhole::InsertTag(buckets, layout,
+                             IndexHash(hashcode, buckets->num_buckets()),
+                             layout.Tag(hashcode >> 32));
 }
 
-inline uint32_t IndexHash(uint32_t hv, uint64_t num_buckets_) {
-  return hv & (num_buckets_ - 1);
-}
-
-inline uint32_t TagHash(uint32_t hv) {
-  uint32_t tag;
-  tag = hv & ((1ULL << BIT_PER_FPT) - 1);
-  tag += (tag == 0);
-  return tag;
-}
-
-inline uint64_t upperpower2(uint64_t x) {
-  x--;
-  x |= x >> 1;
-  x |= x >> 2;
-  x |= x >> 4;
-  x |= x >> 8;
-  x |= x >> 16;
-  x |= x >> 32;
-  x++;
-  return x;
-}
-
-inline uint32_t ReadTag(const uint32_t i, const uint32_t j,const char* array,
-                        uint64_t num_buckets_, uint32_t kTagMask) {
-  uint32_t i_m = MOD(i, num_buckets_);
-  const char* p = array + i_m * 8;
-  uint32_t tag;
-  p += (j << 1);
-  tag = *((uint16_t*)p);
-  return tag & kTagMask;
-}
-
-inline void WriteTag(const uint32_t i, const uint32_t j, const uint32_t t,
-                     char* array, uint64_t num_buckets_, uint32_t kTagMask) {
-  uint32_t i_m = MOD(i, num_buckets_);
-  char* p = array + i_m * 8;
-  uint32_t tag = t & kTagMask;
-  ((uint16_t*)p)[j] = tag;
-}
-
-bool InsertItem(uint64_t hashcode, char* array, uint64_t num_buckets_,
-                uint32_t kTagMask) {
-  uint64_t init_buck_idx = IndexHash(hashcode, num_buckets_);
-  uint64_t tag = TagHash(hashcode >> 32);
-
-  for (uint32_t curr_buck_idx = init_buck_idx;
-       curr_buck_idx < init_buck_idx + num_buckets_; curr_buck_idx++) {
-    for (uint32_t curr_tag_idx = 0; curr_tag_idx < TAG_PER_BUK;
-         curr_tag_idx++) {
-      if (ReadTag(curr_buck_idx, curr_tag_idx, array, num_buckets_, kTagMask) ==
-          0) {
-        while ((curr_buck_idx - init_buck_idx) >= MAX_PROB) {
-          bool has_cadi = false;
-          for (uint32_t prob = MAX_PROB - 1; prob > 0; prob--) {
-            uint32_t cadi_buck_idx = curr_buck_idx - prob;
-            bool find_cadi = false;
-            for (uint32_t cadi_tag_idx = 0; cadi_tag_idx < TAG_PER_BUK;
-                 cadi_tag_idx++) {
-              uint32_t cadi_tag = ReadTag(cadi_buck_idx, cadi_tag_idx, array,
-                                          num_buckets_, kTagMask);
-              if ((cadi_tag & DIS_MASK) + prob < MAX_PROB) {
-                WriteTag(curr_buck_idx, curr_tag_idx,
-                         (cadi_tag & FPT_MASK) | ((cadi_tag & DIS_MASK) + prob),
-                         array, num_buckets_, kTagMask);
-                curr_buck_idx = cadi_buck_idx;
-                curr_tag_idx = cadi_tag_idx;
-                find_cadi = true;
-                break;
-              }
-            }
-            if (find_cadi) {
-              has_cadi = true;
-              break;
-            }
-          }
-          if (!has_cadi) {
-            return false;
-          }
-        }
-        WriteTag(curr_buck_idx, curr_tag_idx,
-                 ((tag << 4) | (curr_buck_idx - init_buck_idx)), array,
-                 num_buckets_, kTagMask);
-        return true;
-      }
+// Returns true if the stash, a sorted array of num_stash fixed32 entries,
+// contains the upper half of hashcode.
+bool StashMayMatch(uint64_t hashcode, const char* stash, uint32_t num_stash) {
+  const uint32_t target = hashcode >> 32;
+  uint32_t left = 0, right = num_stash;
+  while (left < right) {
+    uint32_t mid = left + (right - left) / 2;
+    uint32_t entry = DecodeFixed32(stash + mid * 4);
+    if (entry == target) {
+      return true;
+    } else if (entry < target) {
+      left = mid + 1;
+    } else {
+      right = mid;
     }
   }
   return false;
 }
 
+// A filter whose trailer has been decoded.
+struct FilterView {
+  const char* array;
+  uint64_t num_buckets_;
+  const char* stash;
+  uint32_t num_stash;
+  int fingerprint_bits;
+};
+
+// Decodes the trailer of a non-empty filter.  Returns false if the filter
+// was not produced by this version.
+bool DecodeFilter(const Slice& filter, FilterView* view) {
+  const size_t len = filter.size();
+  if (len < 13) return false;
+
+  const char* array = filter.data();
+  const uint64_t num_buckets_ = DecodeFixed64(array + len - 8);
+  const int fingerprint_bits = static_cast<unsigned char>(array[len - 9]);
+  const uint32_t num_stash = DecodeFixed32(array + len - 13);
+  if (num_stash > (len - 13) / 4 || fingerprint_bits < 8 ||
+      fingerprint_bits > 14) {
+    return false;
+  }
+  const size_t bucket_bytes = len - 13 - 4 * num_stash;
+  if (num_buckets_ == 0 || bucket_bytes % 8 != 0 ||
+      bucket_bytes / 8 != num_buckets_) {
+    return false;
+  }
+
+  view->array = array;
+  view->num_buckets_ = num_buckets_;
+  view->stash = array + bucket_bytes;
+  view->num_stash = num_stash;
+  view->fingerprint_bits = fingerprint_bits;
+  return true;
+}
+
+bool HashMayMatch(const FilterView& view, const SlotLayout& layout,
+                  uint64_t hashcode, uint64_t init_buck_idx) {
+  if (wormhole::ProbeWindow(view.array, view.num_buckets_, layout,
+                            init_buck_idx, layout.Tag(hashcode >> 32))) {
+    return true;
+  }
+  return view.num_stash != 0 &&
+         StashMayMatch(hashcode, view.stash, view.num_stash);
+}
+
+// The filter is encoded as
+//
+//    [bucket 0 .. bucket num_buckets_-1]  : 8 bytes each
+//    [stash entry 0 .. num_stash-1]       : fixed32 each, sorted
+//    num_stash                            : fixed32
+//    fingerprint bits                     : 1 byte
+//    num_buckets_                         : fixed64
+//
+// The stash holds the upper hash half of every key InsertItem() could not
+// place, so a failed displacement never turns into a false negative.
 class WormholeFilterPolicy : public FilterPolicy {
  public:
-  explicit WormholeFilterPolicy() {}
+  WormholeFilterPolicy(int bits_per_key, int fingerprint_bits)
+      : bits_per_key_(bits_per_key),
+        fingerprint_bits_(std::min(std::max(fingerprint_bits, 8), 14)) {}
 
-  const char* Name() const override { return "leveldb.BuiltinWormholeFilter2"; }
+  const char* Name() const override { return "leveldb.BuiltinWormholeFilter4"; }
 
   void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
-    // Compute Wormhole filter size
-    const uint32_t kBytesPerBucket = (BIT_PER_TAG * TAG_PER_BUK + 7) >> 3;
-    const uint32_t kTagMask = (1ULL << BIT_PER_TAG) - 1;
-    uint64_t num_buckets_ = upperpower2(std::max<uint64_t>(1, n / TAG_PER_BUK));
-    double frac = (double)n / num_buckets_ / TAG_PER_BUK;
-    if (frac > 0.8) {
-      num_buckets_ <<= 1;
+    std::vector<uint64_t> hashes(n);
+    for (int i = 0; i < n; i++) {
+      hashes[i] = WormholeHash(keys[i]);
     }
+    CreateFilterFromHashes(hashes.data(), n, dst);
+  }
 
-    size_t bytes = kBytesPerBucket * num_buckets_;
+  bool SupportsHashing() const override { return true; }
+
+  uint64_t HashKey(const Slice& key) const override {
+    return WormholeHash(key);
+  }
+
+  void CreateFilterFromHashes(const uint64_t* hashes, int n,
+                              std::string* dst) const override {
+    // Compute Wormhole filter size
+    const uint32_t kBytesPerBucket =
+        (wormhole::kBitsPerSlot * wormhole::kSlotsPerBucket + 7) >> 3;
+    const SlotLayout layout(fingerprint_bits_);
+    uint64_t num_buckets_ = std::max<uint64_t>(
+        (static_cast<uint64_t>(n) * bits_per_key_ + kBytesPerBucket * 8 - 1) /
+            (kBytesPerBucket * 8),
+        static_cast<uint64_t>(n / (wormhole::kSlotsPerBucket * MAX_LOAD)) + 1);
 
     const size_t init_size = dst->size();
-    dst->resize(init_size + bytes, 0);
-    char* array = &(*dst)[init_size];
+    std::vector<uint32_t> stash;
+    while (true) {
+      size_t bytes = kBytesPerBucket * num_buckets_;
+      dst->resize(init_size);
+      dst->resize(init_size + bytes, 0);
+      PlainBuckets buckets(&(*dst)[init_size], num_buckets_);
 
-    for (int i = 0; i < n; i++) {
-      uint64_t hashcode = WormholeHash(keys[i]);
-      InsertItem(hashcode, array, num_buckets_, kTagMask);
+      stash.clear();
+      for (int i = 0; i < n; i++) {
+        uint64_t hashcode = hashes[i];
+        if (!InsertItem(hashcode, &buckets, layout)) {
+          stash.push_back(hashcode >> 32);
+        }
+      }
+      // The stash is searched on every negative lookup, so a table that
+      // overflows badly is rebuilt with more buckets instead.
+      if (stash.size() <= std::max<size_t>(16, n / 256)) {
+        break;
+      }
+      num_buckets_ += num_buckets_ / 8 + 1;
     }
 
-    dst->resize(init_size + bytes + 8, 0);
-    array = &(*dst)[init_size + bytes];
-    for (int i = 0; i < 8; i++) {
-      array[i] = ((char*)&num_buckets_)[i];
+    std::sort(stash.begin(), stash.end());
+    for (size_t i = 0; i < stash.size(); i++) {
+      PutFixed32(dst, stash[i]);
     }
+    PutFixed32(dst, static_cast<uint32_t>(stash.size()));
+    dst->push_back(static_cast<char>(fingerprint_bits_));
+    PutFixed64(dst, num_buckets_);
   }
 
   bool KeyMayMatch(const Slice& key,
                    const Slice& Wormhole_filter) const override {
-    const size_t len = Wormhole_filter.size();
-    if (len < 2) return false;
+    if (Wormhole_filter.size() < 2) return false;
+    FilterView view;
+    if (!DecodeFilter(Wormhole_filter, &view)) {
+      return true;  // Not produced by this version
+    }
 
-    const char* array = Wormhole_filter.data();
+    const SlotLayout layout(view.fingerprint_bits);
+    uint64_t hashcode = WormholeHash(key);
+    return HashMayMatch(view, layout, hashcode,
+                        IndexHash(hashcode, view.num_buckets_));
+  }
 
-    uint64_t num_buckets_;
-    for (int i = 0; i < 8; i++) {
-      ((char*)&num_buckets_)[i] = array[len - 8 + i];
+  void KeysMayMatch(const Slice* keys, int n, const Slice& Wormhole_filter,
+                    bool* out) const override {
+    FilterView view;
+    if (Wormhole_filter.size() < 2 || !DecodeFilter(Wormhole_filter, &view)) {
+      // Empty filters match nothing, unknown ones everything.
+      std::fill(out, out + n, Wormhole_filter.size() >= 2);
+      return;
     }
 
-    uint64_t hashcode = WormholeHash(key);
-    uint64_t init_buck_idx = IndexHash(hashcode, num_buckets_);
-    uint64_t tag = TagHash(hashcode >> 32);
-    for (uint32_t prob = 0; prob < MAX_PROB; prob++) {
-      uint32_t curr_buck_idx_mod = MOD(init_buck_idx + prob, num_buckets_);
-      const char* p = array + curr_buck_idx_mod * 8;
-      if (hasvalue16(*((uint64_t*)p), (tag << 4) | (prob))) {
-        return true;
+    // Keys are hashed a group at a time so that the kernel can overlap the
+    // cache misses of their probe windows.
+    const int kGroup = wormhole::kProbeGroup;
+    const SlotLayout layout(view.fingerprint_bits);
+    uint64_t hashes[kGroup];
+    uint64_t homes[kGroup];
+    uint32_t tags[kGroup];
+    for (int start = 0; start < n; start += kGroup) {
+      const int m = std::min(kGroup, n - start);
+      for (int i = 0; i < m; i++) {
+        hashes[i] = WormholeHash(keys[start + i]);
+        homes[i] = IndexHash(hashes[i], view.num_buckets_);
+        tags[i] = layout.Tag(hashes[i] >> 32);
+      }
+      wormhole::ProbeBatch(view.array, view.num_buckets_, layout, homes, tags,
+                           m, out + start);
+      if (view.num_stash != 0) {
+        for (int i = 0; i < m; i++) {
+          out[start + i] = out[start + i] ||
+                           StashMayMatch(hashes[i], view.stash, view.num_stash);
+        }
       }
     }
-    return false;
   }
+
+  int fingerprint_bits() const { return fingerprint_bits_; }
+
+ private:
+  const int bits_per_key_;
+  const int fingerprint_bits_;
 };
 }  // namespace
 
-const FilterPolicy* NewWormholeFilterPolicy() {
-  return new WormholeFilterPolicy();
+const FilterPolicy* NewWormholeFilterPolicy(int bits_per_key,
+                                            int fingerprint_bits) {
+  return new WormholeFilterPolicy(bits_per_key, fingerprint_bits);
+}
+
+int WormholeFingerprintBits(const FilterPolicy* policy) {
+  // Without RTTI, the name tells whether policy is a WormholeFilterPolicy
+  static const char* const kName = "leveldb.BuiltinWormholeFilter4";
+  if (policy == nullptr || std::strcmp(policy->Name(), kName) != 0) {
+    return 0;
+  }
+  return static_cast<const WormholeFilterPolicy*>(policy)->fingerprint_bits();
+}
+
+bool GetWormholeOccupancy(const Slice& filter, WormholeOccupancy* occupancy) {
+  FilterView view;
+  if (filter.size() < 2 || !DecodeFilter(filter, &view)) {
+    return false;
+  }
+  const SlotLayout layout(view.fingerprint_bits);
+  occupancy->fingerprint_bits = view.fingerprint_bits;
+  occupancy->slots = view.num_buckets_ * wormhole::kSlotsPerBucket;
+  occupancy->used_slots = 0;
+  occupancy->stashed = view.num_stash;
+  occupancy->wrapped = 0;
+  occupancy->distances.assign(layout.max_prob, 0);
+  for (uint64_t i = 0; i < view.num_buckets_; i++) {
+    const uint64_t bucket = DecodeFixed64(view.array + i * 8);
+    for (uint32_t j = 0; j < wormhole::kSlotsPerBucket; j++) {
+      const uint32_t tag = (bucket >> (wormhole::kBitsPerSlot * j)) & 0xffff;
+      if (tag == 0) {
+        continue;
+      }
+      const uint32_t distance = tag & layout.dis_mask;
+      occupancy->used_slots++;
+      occupancy->distances[distance]++;
+      if (i < distance) {
+        occupancy->wrapped++;
+      }
+    }
+  }
+  return true;
+}
+
+WormholeTable::WormholeTable(size_t bytes, int fingerprint_bits)
+    : num_buckets_(std::max<size_t>(bytes / 8, 1)),
+      fingerprint_bits_(std::min(std::max(fingerprint_bits, 8), 14)),
+      buckets_(new std::atomic<uint64_t>[num_buckets_]),
+      full_(false) {
+  for (uint64_t i = 0; i < num_buckets_; i++) {
+    buckets_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+WormholeTable::~WormholeTable() { delete[] buckets_; }
+
+void WormholeTable::Add(uint64_t hash) {
+  // Duplicates, e.g. from overwrites, would fill the table for nothing
+  if (!MayMatch(hash)) {
+    Insert(hash);
+  }
+}
+
+bool WormholeTable::Insert(uint64_t hash) {
+  if (full()) {
+    return false;
+  }
+  AtomicBuckets buckets(buckets_, num_buckets_);
+  if (!InsertItem(hash, &buckets, SlotLayout(fingerprint_bits_))) {
+    full_.store(true, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+bool WormholeTable::Remove(uint64_t hash) {
+  if (full()) {
+    return false;
+  }
+  const SlotLayout layout(fingerprint_bits_);
+  AtomicBuckets buckets(buckets_, num_buckets_);
+  return wormhole::DeleteTag(&buckets, layout, IndexHash(hash, num_buckets_),
+                             layout.Tag(hash >> 32));
+}
+
+bool WormholeTable::MayMatch(uint64_t hash) const {
+  if (full()) {
+    return true;
+  }
+  const SlotLayout layout(fingerprint_bits_);
+  const uint64_t init_buck_idx = IndexHash(hash, num_buckets_);
+  const uint32_t tag = layout.Tag(hash >> 32);
+  for (uint32_t prob = 0; prob < layout.max_prob; prob++) {
+    uint64_t bucket = buckets_[WrapIndex(init_buck_idx + prob, num_buckets_)]
+                          .load(std::memory_order_relaxed);
+    if (wormhole::HasValue16(bucket, tag | prob)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool WormholeTable::EncodeTo(std::string* dst) const {
+  if (full()) {
+    return false;
+  }
+  dst->reserve(dst->size() + num_buckets_ * 8 + 13);
+  for (uint64_t i = 0; i < num_buckets_; i++) {
+    PutFixed64(dst, buckets_[i].load(std::memory_order_relaxed));
+  }
+  PutFixed32(dst, 0);  // No stash
+  dst->push_back(static_cast<char>(fingerprint_bits_));
+  PutFixed64(dst, num_buckets_);
+  return true;
+}
+
+bool WormholeTable::DecodeFrom(const Slice& filter) {
+  FilterView view;
+  if (!DecodeFilter(filter, &view) || view.num_stash != 0 ||
+      view.num_buckets_ != num_buckets_ ||
+      view.fingerprint_bits != fingerprint_bits_) {
+    return false;
+  }
+  for (uint64_t i = 0; i < num_buckets_; i++) {
+    buckets_[i].store(DecodeFixed64(view.array + i * 8),
+                      std::memory_order_relaxed);
+  }
+  // Readers that see the table is no longer full see every bucket
+  full_.store(false, std::memory_order_release);
+  return true;
 }
 
 }  // namespace leveldb
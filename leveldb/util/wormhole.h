@@ -0,0 +1,100 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_WORMHOLE_H_
+#define STORAGE_LEVELDB_UTIL_WORMHOLE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class FilterPolicy;
+
+// Hash of "key" as used by the filters of NewWormholeFilterPolicy().
+uint64_t WormholeHash(const Slice& key);
+
+// Returns the fingerprint bits of "policy" if it was returned by
+// NewWormholeFilterPolicy(), and 0 otherwise.
+int WormholeFingerprintBits(const FilterPolicy* policy);
+
+// How full one filter of NewWormholeFilterPolicy() is.
+struct WormholeOccupancy {
+  int fingerprint_bits;
+  uint64_t slots;       // Slots of the bucket array
+  uint64_t used_slots;  // Slots holding a tag
+  uint64_t stashed;     // Keys that found no slot, kept in the stash
+  // Tags whose probe window ran past the end of the array and that sit at
+  // its start
+  uint64_t wrapped;
+  // distances[d] is the number of tags d buckets past their home bucket,
+  // i.e. whose distance bits hold d, for d < 2^(16 - fingerprint_bits).
+  std::vector<uint64_t> distances;
+};
+
+// Fills *occupancy from "filter".  Returns false if filter is empty or was
+// not produced by NewWormholeFilterPolicy().
+bool GetWormholeOccupancy(const Slice& filter, WormholeOccupancy* occupancy);
+
+// A wormhole filter that keys are added to one at a time, for example as
+// they are written to a memtable.  One thread at a time may change the
+// table while any number of threads call MayMatch().
+class WormholeTable {
+ public:
+  // Creates an empty table of about "bytes" bytes.
+  WormholeTable(size_t bytes, int fingerprint_bits);
+
+  WormholeTable(const WormholeTable&) = delete;
+  WormholeTable& operator=(const WormholeTable&) = delete;
+
+  ~WormholeTable();
+
+  // Adds the key whose WormholeHash() is "hash".  Keys that already match
+  // take no slot.  Once a key finds no free slot within its probe window,
+  // the table is full and matches every key.
+  void Add(uint64_t hash);
+
+  // Like Add(), but every call takes a slot of its own, so that the table
+  // holds a multiset of keys that Remove() can take keys out of.  Returns
+  // false if the table is full.
+  bool Insert(uint64_t hash);
+
+  // Frees one slot taken by Insert(hash).  Returns false if none is found,
+  // which happens only if the table is full.
+  // REQUIRES: Every key was added with Insert(), not Add().
+  bool Remove(uint64_t hash);
+
+  bool MayMatch(uint64_t hash) const;
+
+  bool full() const { return full_.load(std::memory_order_acquire); }
+
+  // Appends the table to *dst as a filter of NewWormholeFilterPolicy(),
+  // matching every key added.  Returns false and appends nothing if the
+  // table is full.
+  bool EncodeTo(std::string* dst) const;
+
+  // Replaces the contents of the table with "filter", as produced by
+  // EncodeTo() for a table of the same size and fingerprint bits.
+  // Returns false and leaves the table unchanged if filter does not fit.
+  // A full table keeps matching every key until the new contents are all
+  // in place.
+  bool DecodeFrom(const Slice& filter);
+
+  size_t ApproximateMemoryUsage() const { return num_buckets_ * 8; }
+
+ private:
+  const uint64_t num_buckets_;
+  const int fingerprint_bits_;
+  std::atomic<uint64_t>* const buckets_;
+  std::atomic<bool> full_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_WORMHOLE_H_
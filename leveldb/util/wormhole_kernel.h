@@ -0,0 +1,244 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// The probe, insert and delete kernels of the wormhole filter.  They are
+// shared by the filters of util/wormhole.cc and by the persistent memory
+// filter of src/pm_wf, so this header depends on the standard library only.
+//
+// A table is an array of 8-byte buckets of four 16-bit slots.  Every used
+// slot holds a fingerprint above the distance of its bucket from the key's
+// home bucket; a zero slot is free.  Front-ends map a hash to its home
+// bucket and to its tag, the fingerprint already shifted above the distance
+// bits, so the kernels never see hashes and any index mapping can be used.
+//
+// Insertion and deletion go through a Buckets type of the front-end:
+//
+//    uint64_t num_buckets() const;
+//    uint32_t ReadTag(uint64_t i, uint32_t j) const;
+//    void WriteTag(uint64_t i, uint32_t j, uint32_t t);  // Fills/frees slot
+//    void MoveTag(uint64_t i, uint32_t j, uint32_t t);   // Displaced tag
+//
+// where bucket i may run past the end of the table by less than one probe
+// window.  Lookups read the bucket array directly so they can be vectorized.
+
+#ifndef STORAGE_LEVELDB_UTIL_WORMHOLE_KERNEL_H_
+#define STORAGE_LEVELDB_UTIL_WORMHOLE_KERNEL_H_
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace leveldb {
+namespace wormhole {
+
+static const uint32_t kBitsPerSlot = 16;
+static const uint32_t kSlotsPerBucket = 4;
+
+// Number of lookups ProbeBatch() overlaps.  Their windows, two cache lines
+// at most each, have to stay in L1 until they are compared.
+static const int kProbeGroup = 16;
+
+// Bucket indexes inside a probe window run past the end of the table by
+// less than one window.
+inline uint64_t WrapIndex(uint64_t idx, uint64_t num_buckets) {
+  return idx < num_buckets ? idx : idx % num_buckets;
+}
+
+// Every slot holds a fingerprint of fpt_bits bits above the distance of the
+// slot from the key's home bucket.  More fingerprint bits lower the false
+// positive rate; more distance bits widen the probe window, which lets the
+// table fill further before an insertion fails.
+struct SlotLayout {
+  explicit SlotLayout(int fingerprint_bits)
+      : fpt_bits(fingerprint_bits),
+        dis_bits(kBitsPerSlot - fingerprint_bits),
+        dis_mask((1u << dis_bits) - 1),
+        max_prob(1u << dis_bits) {}
+
+  // Fingerprint of hv.  Never zero, which marks a free slot.
+  uint32_t TagHash(uint32_t hv) const {
+    uint32_t tag = hv & ((1u << fpt_bits) - 1);
+    tag += (tag == 0);
+    return tag;
+  }
+
+  // TagHash(hv) shifted above the distance bits, as the kernels take it.
+  uint32_t Tag(uint32_t hv) const { return TagHash(hv) << dis_bits; }
+
+  const uint32_t fpt_bits;
+  const uint32_t dis_bits;
+  const uint32_t dis_mask;
+  const uint32_t max_prob;
+};
+
+// Returns true if one of the four slots of bucket equals v.
+inline bool HasValue16(uint64_t bucket, uint32_t v) {
+  const uint64_t x = bucket ^ (0x0001000100010001ULL * v);
+  return ((x - 0x0001000100010001ULL) & ~x & 0x8000800080008000ULL) != 0;
+}
+
+inline uint64_t LoadBucket(const char* p) {
+  uint64_t bucket;
+  std::memcpy(&bucket, p, sizeof(bucket));
+  return bucket;
+}
+
+// Places tag in the probe window starting at init_buck_idx, displacing tags
+// towards their home buckets to make room if needed.  A displaced tag is
+// written to its new slot before its old slot is reused, so a concurrent
+// lookup always finds it in one of them.  If last_buck_idx is not null it
+// receives the unwrapped index of the furthest bucket written.  Returns
+// false if there is no room, in which case displaced tags may have been
+// copied but none was lost.
+template <typename Buckets>
+bool InsertTag(Buckets* buckets, const SlotLayout& layout,
+               uint64_t init_buck_idx, uint32_t tag,
+               uint64_t* last_buck_idx = nullptr) {
+  const uint64_t num_buckets = buckets->num_buckets();
+  for (uint64_t curr_buck_idx = init_buck_idx;
+       curr_buck_idx < init_buck_idx + num_buckets; curr_buck_idx++) {
+    for (uint32_t curr_tag_idx = 0; curr_tag_idx < kSlotsPerBucket;
+         curr_tag_idx++) {
+      if (buckets->ReadTag(curr_buck_idx, curr_tag_idx) != 0) {
+        continue;
+      }
+      if (last_buck_idx != nullptr) {
+        *last_buck_idx = curr_buck_idx;
+      }
+      while ((curr_buck_idx - init_buck_idx) >= layout.max_prob) {
+        bool has_cadi = false;
+        for (uint32_t prob = layout.max_prob - 1; prob > 0 && !has_cadi;
+             prob--) {
+          const uint64_t cadi_buck_idx = curr_buck_idx - prob;
+          for (uint32_t cadi_tag_idx = 0; cadi_tag_idx < kSlotsPerBucket;
+               cadi_tag_idx++) {
+            uint32_t cadi_tag = buckets->ReadTag(cadi_buck_idx, cadi_tag_idx);
+            if ((cadi_tag & layout.dis_mask) + prob < layout.max_prob) {
+              buckets->MoveTag(curr_buck_idx, curr_tag_idx, cadi_tag + prob);
+              curr_buck_idx = cadi_buck_idx;
+              curr_tag_idx = cadi_tag_idx;
+              has_cadi = true;
+              break;
+            }
+          }
+        }
+        if (!has_cadi) {
+          return false;
+        }
+      }
+      buckets->WriteTag(curr_buck_idx, curr_tag_idx,
+                        tag | static_cast<uint32_t>(curr_buck_idx -
+                                                    init_buck_idx));
+      return true;
+    }
+  }
+  return false;
+}
+
+// Frees one slot of the window starting at init_buck_idx that holds tag.
+// Returns false if there is none.
+template <typename Buckets>
+bool DeleteTag(Buckets* buckets, const SlotLayout& layout,
+               uint64_t init_buck_idx, uint32_t tag) {
+  for (uint32_t prob = 0; prob < layout.max_prob; prob++) {
+    for (uint32_t j = 0; j < kSlotsPerBucket; j++) {
+      if (buckets->ReadTag(init_buck_idx + prob, j) == (tag | prob)) {
+        buckets->WriteTag(init_buck_idx + prob, j, 0);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Returns true if a slot of the window starting at init_buck_idx of the
+// num_buckets buckets at array holds tag.  Windows that do not wrap around
+// the end of the table are compared several buckets at a time: since the
+// distance bits of tag are zero, the expected lane value for bucket prob
+// is tag + prob.
+inline bool ProbeWindow(const char* array, uint64_t num_buckets,
+                        const SlotLayout& layout, uint64_t init_buck_idx,
+                        uint32_t tag) {
+#if defined(__AVX2__)
+  if (init_buck_idx + layout.max_prob <= num_buckets) {
+    const char* p = array + init_buck_idx * 8;
+    __m256i expect =
+        _mm256_add_epi16(_mm256_set1_epi16(static_cast<short>(tag)),
+                         _mm256_setr_epi16(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                           2, 3, 3, 3, 3));
+    const __m256i step = _mm256_set1_epi16(4);
+    for (uint32_t prob = 0; prob < layout.max_prob; prob += 4) {
+      __m256i window =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + prob * 8));
+      if (_mm256_movemask_epi8(_mm256_cmpeq_epi16(window, expect)) != 0) {
+        return true;
+      }
+      expect = _mm256_add_epi16(expect, step);
+    }
+    return false;
+  }
+#elif defined(__SSE2__)
+  if (init_buck_idx + layout.max_prob <= num_buckets) {
+    const char* p = array + init_buck_idx * 8;
+    __m128i expect = _mm_add_epi16(_mm_set1_epi16(static_cast<short>(tag)),
+                                   _mm_setr_epi16(0, 0, 0, 0, 1, 1, 1, 1));
+    const __m128i step = _mm_set1_epi16(2);
+    for (uint32_t prob = 0; prob < layout.max_prob; prob += 2) {
+      __m128i window =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + prob * 8));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi16(window, expect)) != 0) {
+        return true;
+      }
+      expect = _mm_add_epi16(expect, step);
+    }
+    return false;
+  }
+#endif
+  for (uint32_t prob = 0; prob < layout.max_prob; prob++) {
+    const char* p = array + WrapIndex(init_buck_idx + prob, num_buckets) * 8;
+    if (HasValue16(LoadBucket(p), tag | prob)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Starts loading the window starting at init_buck_idx into the cache.
+inline void PrefetchWindow(const char* array, uint64_t num_buckets,
+                           const SlotLayout& layout, uint64_t init_buck_idx) {
+#if defined(__GNUC__) || defined(__clang__)
+  const char* p = array + init_buck_idx * 8;
+  __builtin_prefetch(p);
+  if (init_buck_idx + layout.max_prob <= num_buckets) {
+    __builtin_prefetch(p + (layout.max_prob - 1) * 8);
+  }
+#endif
+}
+
+// Sets out[i] to ProbeWindow(..., homes[i], tags[i]) for i in [0, n).
+// The windows are prefetched kProbeGroup at a time, so the cache misses of
+// a group overlap instead of being paid one after the other.
+inline void ProbeBatch(const char* array, uint64_t num_buckets,
+                       const SlotLayout& layout, const uint64_t* homes,
+                       const uint32_t* tags, int n, bool* out) {
+  for (int start = 0; start < n; start += kProbeGroup) {
+    const int end = n - start < kProbeGroup ? n : start + kProbeGroup;
+    for (int i = start; i < end; i++) {
+      PrefetchWindow(array, num_buckets, layout, homes[i]);
+    }
+    for (int i = start; i < end; i++) {
+      out[i] = ProbeWindow(array, num_buckets, layout, homes[i], tags[i]);
+    }
+  }
+}
+
+}  // namespace wormhole
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_WORMHOLE_KERNEL_H_
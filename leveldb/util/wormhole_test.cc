@@ -0,0 +1,367 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <memory>
+
+#include "gtest/gtest.h"
+#include "leveldb/filter_policy.h"
+#include "util/coding.h"
+#include "util/logging.h"
+#include "util/testutil.h"
+#include "util/wormhole.h"
+#include "util/wormhole_kernel.h"
+
+namespace leveldb {
+
+static const int kVerbose = 1;
+
+static Slice Key(int i, char* buffer) {
+  EncodeFixed32(buffer, i);
+  return Slice(buffer, sizeof(uint32_t));
+}
+
+class WormholeTest : public testing::Test {
+ public:
+  WormholeTest() : policy_(NewWormholeFilterPolicy()) {}
+
+  ~WormholeTest() { delete policy_; }
+
+  void SetPolicy(int bits_per_key, int fingerprint_bits) {
+    delete policy_;
+    policy_ = NewWormholeFilterPolicy(bits_per_key, fingerprint_bits);
+  }
+
+  void Reset() {
+    keys_.clear();
+    filter_.clear();
+  }
+
+  void Add(const Slice& s) { keys_.push_back(s.ToString()); }
+
+  void Build() {
+    std::vector<Slice> key_slices;
+    for (size_t i = 0; i < keys_.size(); i++) {
+      key_slices.push_back(Slice(keys_[i]));
+    }
+    filter_.clear();
+    policy_->CreateFilter(key_slices.data(),
+                          static_cast<int>(key_slices.size()), &filter_);
+    keys_.clear();
+  }
+
+  size_t FilterSize() const { return filter_.size(); }
+  const std::string& filter() const { return filter_; }
+
+  // Number of keys that overflowed into the stash.
+  uint32_t StashSize() const {
+    return DecodeFixed32(filter_.data() + filter_.size() - 13);
+  }
+
+  bool Matches(const Slice& s) {
+    if (!keys_.empty()) {
+      Build();
+    }
+    return policy_->KeyMayMatch(s, filter_);
+  }
+
+  // Probes all of "probes" with a single KeysMayMatch() call.
+  std::vector<bool> BatchMatches(const std::vector<std::string>& probes) {
+    if (!keys_.empty()) {
+      Build();
+    }
+    const int n = static_cast<int>(probes.size());
+    std::vector<Slice> probe_slices(probes.begin(), probes.end());
+    std::unique_ptr<bool[]> out(new bool[n]);
+    policy_->KeysMayMatch(probe_slices.data(), n, filter_, out.get());
+    return std::vector<bool>(out.get(), out.get() + n);
+  }
+
+  double FalsePositiveRate() {
+    char buffer[sizeof(int)];
+    int result = 0;
+    for (int i = 0; i < 10000; i++) {
+      if (Matches(Key(i + 1000000000, buffer))) {
+        result++;
+      }
+    }
+    return result / 10000.0;
+  }
+
+ private:
+  const FilterPolicy* policy_;
+  std::string filter_;
+  std::vector<std::string> keys_;
+};
+
+TEST_F(WormholeTest, EmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_F(WormholeTest, Small) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+static int NextLength(int length) {
+  if (length < 10) {
+    length += 1;
+  } else if (length < 100) {
+    length += 10;
+  } else if (length < 1000) {
+    length += 100;
+  } else {
+    length += 1000;
+  }
+  return length;
+}
+
+TEST_F(WormholeTest, VaryingLengths) {
+  char buffer[sizeof(int)];
+
+  for (int length = 1; length <= 10000; length = NextLength(length)) {
+    Reset();
+    for (int i = 0; i < length; i++) {
+      Add(Key(i, buffer));
+    }
+    Build();
+
+    // 17 bits per key, rounded up to whole buckets, plus the stash
+    ASSERT_LE(FilterSize() - StashSize() * 4,
+              static_cast<size_t>((length * 17 / 8) + 8 + 13))
+        << length;
+
+    // All added keys must match
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(Matches(Key(i, buffer)))
+          << "Length " << length << "; key " << i;
+    }
+
+    double rate = FalsePositiveRate();
+    if (kVerbose >= 1) {
+      std::fprintf(stderr,
+                   "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+                   rate * 100.0, length, static_cast<int>(FilterSize()));
+    }
+    ASSERT_LE(rate, 0.02);  // Must not be over 2%
+  }
+}
+
+// Keys whose displacement fails must still match through the stash.
+TEST_F(WormholeTest, FullTable) {
+  char buffer[sizeof(int)];
+  SetPolicy(1, 12);  // As full as the table may get
+  const int length = 250000;
+  for (int i = 0; i < length; i++) {
+    Add(Key(i, buffer));
+  }
+  Build();
+
+  const int buckets = static_cast<int>(length / (4 * 0.95)) + 1;
+  ASSERT_EQ(FilterSize(), buckets * 8 + StashSize() * 4 + 13);
+  if (kVerbose >= 1) {
+    std::fprintf(stderr, "Stash: %u of %d keys; %.2f bits/key\n", StashSize(),
+                 length, FilterSize() * 8.0 / length);
+  }
+  for (int i = 0; i < length; i++) {
+    ASSERT_TRUE(Matches(Key(i, buffer))) << "key " << i;
+  }
+  ASSERT_LE(FalsePositiveRate(), 0.02);
+}
+
+TEST_F(WormholeTest, FingerprintBits) {
+  char buffer[sizeof(int)];
+  const int length = 10000;
+  double last_rate = 1.0;
+  for (int fingerprint_bits = 8; fingerprint_bits <= 14; fingerprint_bits++) {
+    SetPolicy(20, fingerprint_bits);
+    Reset();
+    for (int i = 0; i < length; i++) {
+      Add(Key(i, buffer));
+    }
+    Build();
+    ASSERT_EQ(FilterSize(), (length * 20 / 64) * 8 + StashSize() * 4 + 13);
+
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(Matches(Key(i, buffer)))
+          << "Fingerprint bits " << fingerprint_bits << "; key " << i;
+    }
+
+    double rate = FalsePositiveRate();
+    if (kVerbose >= 1) {
+      std::fprintf(stderr, "False positives: %5.2f%% @ fingerprint bits = %d\n",
+                   rate * 100.0, fingerprint_bits);
+    }
+    ASSERT_LE(rate, last_rate * 1.5);
+    last_rate = std::max(rate, 0.0005);
+  }
+}
+
+TEST_F(WormholeTest, Occupancy) {
+  WormholeOccupancy occupancy;
+  ASSERT_TRUE(!GetWormholeOccupancy(Slice(), &occupancy));
+
+  char buffer[sizeof(int)];
+  const int length = 20000;
+  SetPolicy(1, 12);  // As full as the builder goes
+  for (int i = 0; i < length; i++) {
+    Add(Key(i, buffer));
+  }
+  Build();
+  ASSERT_TRUE(GetWormholeOccupancy(filter(), &occupancy));
+  ASSERT_EQ(12, occupancy.fingerprint_bits);
+  ASSERT_EQ(StashSize(), occupancy.stashed);
+  ASSERT_EQ((FilterSize() - 13 - 4 * StashSize()) / 2, occupancy.slots);
+  ASSERT_EQ(length, occupancy.used_slots + occupancy.stashed);
+  ASSERT_GT(occupancy.used_slots, occupancy.slots * 9 / 10);
+
+  // Every tag has one distance, and only tags homed near the end of the
+  // table can wrap
+  ASSERT_EQ(16, occupancy.distances.size());
+  uint64_t tags = 0;
+  for (uint64_t count : occupancy.distances) {
+    tags += count;
+  }
+  ASSERT_EQ(occupancy.used_slots, tags);
+  ASSERT_GT(occupancy.distances[0], occupancy.distances[1]);
+  ASSERT_LT(occupancy.wrapped, occupancy.used_slots / 100);
+}
+
+// The batched probe must agree with KeyMayMatch() on every key, including
+// keys whose probe window wraps around the end of the table and keys that
+// only match through the stash.
+TEST_F(WormholeTest, BatchedProbe) {
+  ASSERT_EQ(BatchMatches({"hello", "world"}), std::vector<bool>(2, false));
+
+  char buffer[sizeof(int)];
+  const int length = 20000;
+  for (int fingerprint_bits : {8, 12, 14}) {
+    SetPolicy(1, fingerprint_bits);
+    Reset();
+    std::vector<std::string> probes;
+    for (int i = 0; i < length; i++) {
+      Add(Key(i, buffer));
+      probes.push_back(Key(i, buffer).ToString());
+    }
+    for (int i = 0; i < length / 2 + 1; i++) {
+      probes.push_back(Key(i + 1000000000, buffer).ToString());
+    }
+
+    std::vector<bool> batched = BatchMatches(probes);
+    ASSERT_EQ(batched.size(), probes.size());
+    for (size_t i = 0; i < probes.size(); i++) {
+      ASSERT_EQ(batched[i], Matches(probes[i]))
+          << "Fingerprint bits " << fingerprint_bits << "; probe " << i;
+      if (i < length) {
+        ASSERT_TRUE(batched[i]);
+      }
+    }
+  }
+}
+
+// Table builders pass key hashes instead of keys; the filter must not change.
+TEST(WormholeHashingTest, SameFilterAsKeys) {
+  const FilterPolicy* policy = NewWormholeFilterPolicy();
+  ASSERT_TRUE(policy->SupportsHashing());
+
+  char buffer[sizeof(int)];
+  std::vector<std::string> keys;
+  std::vector<Slice> key_slices;
+  std::vector<uint64_t> hashes;
+  for (int i = 0; i < 5000; i++) {
+    keys.push_back(Key(i, buffer).ToString());
+  }
+  for (size_t i = 0; i < keys.size(); i++) {
+    key_slices.push_back(keys[i]);
+    hashes.push_back(policy->HashKey(keys[i]));
+  }
+
+  std::string from_keys, from_hashes;
+  policy->CreateFilter(key_slices.data(), static_cast<int>(keys.size()),
+                       &from_keys);
+  policy->CreateFilterFromHashes(hashes.data(), static_cast<int>(keys.size()),
+                                 &from_hashes);
+  ASSERT_EQ(from_keys, from_hashes);
+  delete policy;
+}
+
+// Buckets of the persistent memory front-end's shape: bucket indexes are
+// wrapped with a modulo, and displacements are counted.
+class ModuloBuckets {
+ public:
+  explicit ModuloBuckets(uint64_t num_buckets)
+      : words_(num_buckets, 0), moves_(0) {}
+
+  uint64_t num_buckets() const { return words_.size(); }
+  const char* array() const {
+    return reinterpret_cast<const char*>(words_.data());
+  }
+  int moves() const { return moves_; }
+
+  uint32_t ReadTag(uint64_t i, uint32_t j) const {
+    return (words_[i % words_.size()] >> (16 * j)) & 0xffff;
+  }
+
+  void WriteTag(uint64_t i, uint32_t j, uint32_t t) {
+    uint64_t& w = words_[i % words_.size()];
+    w = (w & ~(0xffffULL << (16 * j))) | (static_cast<uint64_t>(t) << (16 * j));
+  }
+
+  void MoveTag(uint64_t i, uint32_t j, uint32_t t) {
+    moves_++;
+    WriteTag(i, j, t);
+  }
+
+ private:
+  std::vector<uint64_t> words_;
+  int moves_;
+};
+
+// The kernel works for any index mapping a front-end chooses, including
+// windows that wrap around the end of the table and inserts that need
+// displacements.
+TEST(WormholeKernelTest, InsertProbeDelete) {
+  const wormhole::SlotLayout layout(12);
+  ModuloBuckets buckets(101);
+  Random rnd(301);
+  std::vector<uint64_t> homes;
+  std::vector<uint32_t> tags;
+  while (homes.size() < 380) {
+    homes.push_back(rnd.Next() % buckets.num_buckets());
+    tags.push_back(layout.Tag(rnd.Next()));
+    ASSERT_TRUE(wormhole::InsertTag(&buckets, layout, homes.back(),
+                                    tags.back()));
+  }
+  ASSERT_GT(buckets.moves(), 0);
+
+  const int n = static_cast<int>(homes.size());
+  std::unique_ptr<bool[]> out(new bool[n]);
+  wormhole::ProbeBatch(buckets.array(), buckets.num_buckets(), layout,
+                       homes.data(), tags.data(), n, out.get());
+  for (int i = 0; i < n; i++) {
+    ASSERT_TRUE(out[i]) << i;
+    ASSERT_TRUE(wormhole::ProbeWindow(buckets.array(), buckets.num_buckets(),
+                                      layout, homes[i], tags[i]));
+  }
+
+  for (int i = 0; i < n; i++) {
+    ASSERT_TRUE(wormhole::DeleteTag(&buckets, layout, homes[i], tags[i]));
+  }
+  for (uint64_t b = 0; b < buckets.num_buckets(); b++) {
+    for (uint32_t j = 0; j < wormhole::kSlotsPerBucket; j++) {
+      ASSERT_EQ(0, buckets.ReadTag(b, j));
+    }
+  }
+  wormhole::ProbeBatch(buckets.array(), buckets.num_buckets(), layout,
+                       homes.data(), tags.data(), n, out.get());
+  for (int i = 0; i < n; i++) {
+    ASSERT_FALSE(out[i]) << i;
+  }
+}
+
+}  // namespace leveldb
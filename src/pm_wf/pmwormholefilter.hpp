@@ -1,6 +1,9 @@
 #ifndef PMWORMHOLE_FILTER_HPP_
 #define PMWORMHOLE_FILTER_HPP_
 
+#include "util/wormhole_kernel.h"
+
+#include <algorithm>
 #include <iostream>
 #include <libpmemobj.h>
 #include <random>
@@ -73,6 +76,8 @@ struct pmwormholefilter_root
 
 void pmwormholefilter_init(PMEMobjpool *pop, TOID(struct pmwormholefilter_root) pmwormholefilter_root, uint32_t max_num_keys);
 
+void pmwormholefilter_init_load(PMEMobjpool *pop, TOID(struct pmwormholefilter_root) pmwormholefilter_root, uint32_t max_num_keys, double max_load);
+
 void pmwormholefilter_destroy(PMEMobjpool *pop, TOID(struct pmwormholefilter_root) pmwormholefilter_root);
 
 int pmwormholefilter_insert(PMEMobjpool *pop, TOID(struct pmwormholefilter_root) pmwormholefilter_root, uint64_t key_);
@@ -86,17 +91,23 @@ int pmwormholefilter_bytes(PMEMobjpool *pop, TOID(struct pmwormholefilter_root)
 void pmwormholefilter_info(PMEMobjpool *pop, TOID(struct pmwormholefilter_root) pmwormholefilter_root);
 
 void pmwormholefilter_init(PMEMobjpool *pop, TOID(struct pmwormholefilter_root) pmwormholefilter_root, uint32_t max_num_keys)
+{
+    pmwormholefilter_init_load(pop, pmwormholefilter_root, max_num_keys, 0.8);
+}
+
+// Sizes the table so that max_num_keys fill max_load of its slots.
+void pmwormholefilter_init_load(PMEMobjpool *pop, TOID(struct pmwormholefilter_root) pmwormholefilter_root, uint32_t max_num_keys, double max_load)
 {
     TX_BEGIN(pop)
     {
         pmemobj_tx_add_range_direct(D_RW(pmwormholefilter_root), sizeof(*D_RW(pmwormholefilter_root)));
         struct pmwormholefilter_root *p_pmwormholefilter_root = D_RW(pmwormholefilter_root);
-        p_pmwormholefilter_root->pmwormholefilter = TX_ZALLOC(struct pmwormholefilter, sizeof(struct pmwormholefilter) + (sizeof(uint64_t) * int((max_num_keys / SLOT_PER_BUK) / 0.8)));
+        p_pmwormholefilter_root->pmwormholefilter = TX_ZALLOC(struct pmwormholefilter, sizeof(struct pmwormholefilter) + (sizeof(uint64_t) * int((max_num_keys / SLOT_PER_BUK) / max_load)));
 
         struct pmwormholefilter *p_pmwormholefilter = D_RW(p_pmwormholefilter_root->pmwormholefilter);
         pmemobj_tx_add_range_direct(p_pmwormholefilter, sizeof(struct pmwormholefilter));
 
-        p_pmwormholefilter->num_buckets_ = int((max_num_keys / SLOT_PER_BUK) / 0.8);
+        p_pmwormholefilter->num_buckets_ = int((max_num_keys / SLOT_PER_BUK) / max_load);
 
         PMWF_TwoIndependentMultiplyShift hash_;
         p_pmwormholefilter->hasher_ = hash_;
@@ -122,11 +133,17 @@ inline uint32_t index_hash(uint32_t hv, uint32_t num_buckets_)
     return hv % num_buckets_;
 }
 
+// Slot geometry of the shared wormhole kernel: BITS_PER_FPT fingerprint bits
+// above BITS_PER_DIS distance bits, hence a MAX_PROB bucket window.
+inline const leveldb::wormhole::SlotLayout &pmwormholefilter_layout()
+{
+    static const leveldb::wormhole::SlotLayout layout(BITS_PER_FPT);
+    return layout;
+}
+
 inline uint32_t tag_hash(uint32_t hv)
 {
-    uint32_t tag = hv & (((1ULL << BITS_PER_FPT) - 1));
-    tag += (tag == 0);
-    return (tag << BITS_PER_DIS);
+    return pmwormholefilter_layout().Tag(hv);
 }
 
 inline uint32_t ReadTag(struct pmwormholefilter *pmwormholefilter, const uint32_t i, const uint32_t j)
@@ -149,99 +166,118 @@ inline void PMWriteTag(PMEMobjpool *pop, struct pmwormholefilter *pmwormholefilt
     pmemobj_persist(pop, &pmwormholefilter->buckets_[i_m], sizeof(uint64_t));
 }
 
-int pmwormholefilter_insert(PMEMobjpool *pop, TOID(struct pmwormholefilter_root) pmwormholefilter_root, uint64_t key_)
+// The buckets of a filter as the kernel sees them. When persist is set, every
+// displaced tag is persisted before the kernel reuses its old slot, so a crash
+// in the middle of a displacement chain never loses a tag.
+struct pmwormholefilter_buckets
 {
-    struct pmwormholefilter *p_pmwormholefilter = D_RW(D_RW(pmwormholefilter_root)->pmwormholefilter);
+    PMEMobjpool *pop_;
+    struct pmwormholefilter *filter_;
+    bool persist_;
 
-    const uint64_t hash = p_pmwormholefilter->hasher_(key_);
-    uint64_t init_buck_idx = index_hash(hash, p_pmwormholefilter->num_buckets_);
-    uint64_t tag = tag_hash(hash >> 32);
+    uint64_t num_buckets() const { return filter_->num_buckets_; }
+
+    uint32_t ReadTag(uint64_t i, uint32_t j) const { return ::ReadTag(filter_, i, j); }
+
+    void WriteTag(uint64_t i, uint32_t j, uint32_t t) { ::WriteTag(filter_, i, j, t); }
 
-    for (uint32_t curr_buck_idx = init_buck_idx; curr_buck_idx < init_buck_idx + p_pmwormholefilter->num_buckets_; curr_buck_idx++)
+    void MoveTag(uint64_t i, uint32_t j, uint32_t t)
     {
-        for (uint32_t curr_tag_idx = 0; curr_tag_idx < SLOT_PER_BUK; curr_tag_idx++)
+        if (persist_)
         {
-            if (ReadTag(p_pmwormholefilter, curr_buck_idx, curr_tag_idx) == 0)
-            {
-                while ((curr_buck_idx - init_buck_idx) >= MAX_PROB)
-                {
-                    bool has_cadi = false;
-                    for (uint32_t prob = MAX_PROB - 1; prob > 0; prob--)
-                    {
-                        uint32_t cadi_buck_idx = curr_buck_idx - prob;
-                        bool find_cadi = false;
-                        for (uint32_t cadi_tag_idx = 0; cadi_tag_idx < SLOT_PER_BUK; cadi_tag_idx++)
-                        {
-                            uint32_t cadi_tag = ReadTag(p_pmwormholefilter, cadi_buck_idx, cadi_tag_idx);
-
-                            if ((cadi_tag & DIS_MASK) + prob < MAX_PROB)
-                            {
-                                PMWriteTag(pop, p_pmwormholefilter, curr_buck_idx, curr_tag_idx, ((cadi_tag & FPT_MASK) | ((cadi_tag & DIS_MASK) + prob)));
-                                curr_buck_idx = cadi_buck_idx;
-                                curr_tag_idx = cadi_tag_idx;
-                                find_cadi = true;
-                                break;
-                            }
-                        }
-                        if (find_cadi)
-                        {
-                            has_cadi = true;
-                            break;
-                        }
-                    }
-                    if (!has_cadi)
-                    {
-                        return false;
-                    }
-                }
-                WriteTag(p_pmwormholefilter, curr_buck_idx, curr_tag_idx, (tag | (curr_buck_idx - init_buck_idx)));
-                return true;
-            }
+            PMWriteTag(pop_, filter_, i, j, t);
+        }
+        else
+        {
+            ::WriteTag(filter_, i, j, t);
         }
     }
-    return false;
+};
+
+// Inserts tag into the window starting at init_buck_idx. When persist is false
+// every tag write is a plain store and the caller is responsible for flushing
+// the touched buckets; if last_buck_idx is not NULL it receives the (unwrapped)
+// index of the furthest bucket written, so the dirty range is
+// [init_buck_idx, *last_buck_idx].
+inline int pmwormholefilter_insert_at(PMEMobjpool *pop, struct pmwormholefilter *p_pmwormholefilter, uint64_t init_buck_idx, uint64_t tag, bool persist, uint64_t *last_buck_idx)
+{
+    struct pmwormholefilter_buckets buckets = {pop, p_pmwormholefilter, persist};
+    return leveldb::wormhole::InsertTag(&buckets, pmwormholefilter_layout(), init_buck_idx, tag, last_buck_idx);
 }
 
-int pmwormholefilter_lookup(PMEMobjpool *pop, TOID(struct pmwormholefilter_root) pmwormholefilter_root, uint64_t key_)
+inline int pmwormholefilter_insert_hash(PMEMobjpool *pop, struct pmwormholefilter *p_pmwormholefilter, uint64_t hash, bool persist, uint64_t *last_buck_idx)
+{
+    uint64_t init_buck_idx = index_hash(hash, p_pmwormholefilter->num_buckets_);
+    uint64_t tag = tag_hash(hash >> 32);
+    return pmwormholefilter_insert_at(pop, p_pmwormholefilter, init_buck_idx, tag, persist, last_buck_idx);
+}
+
+int pmwormholefilter_insert(PMEMobjpool *pop, TOID(struct pmwormholefilter_root) pmwormholefilter_root, uint64_t key_)
 {
     struct pmwormholefilter *p_pmwormholefilter = D_RW(D_RW(pmwormholefilter_root)->pmwormholefilter);
+
     const uint64_t hash = p_pmwormholefilter->hasher_(key_);
+    return pmwormholefilter_insert_hash(pop, p_pmwormholefilter, hash, true, NULL);
+}
+
+inline int pmwormholefilter_lookup_at(const struct pmwormholefilter *p_pmwormholefilter, uint64_t init_buck_idx, uint64_t tag)
+{
+    return leveldb::wormhole::ProbeWindow((const char *)p_pmwormholefilter->buckets_, p_pmwormholefilter->num_buckets_, pmwormholefilter_layout(), init_buck_idx, tag);
+}
 
+inline int pmwormholefilter_lookup_hash(const struct pmwormholefilter *p_pmwormholefilter, uint64_t hash)
+{
     uint64_t init_buck_idx = index_hash(hash, p_pmwormholefilter->num_buckets_);
     uint64_t tag = tag_hash(hash >> 32);
+    return pmwormholefilter_lookup_at(p_pmwormholefilter, init_buck_idx, tag);
+}
 
-    for (uint32_t prob = 0; prob < MAX_PROB; prob++)
+// Sets out[i] to pmwormholefilter_lookup_hash(p_pmwormholefilter, hashes[i]).
+// The windows of a group of lookups are prefetched together, so their cache
+// misses overlap.
+inline void pmwormholefilter_lookup_batch_hash(const struct pmwormholefilter *p_pmwormholefilter, const uint64_t *hashes, int n, bool *out)
+{
+    uint64_t homes[leveldb::wormhole::kProbeGroup];
+    uint32_t tags[leveldb::wormhole::kProbeGroup];
+    for (int start = 0; start < n; start += leveldb::wormhole::kProbeGroup)
     {
-        uint32_t curr_buck_idx_mod = MOD(init_buck_idx + prob, p_pmwormholefilter->num_buckets_);
-        if (hasvalue16(p_pmwormholefilter->buckets_[curr_buck_idx_mod], (tag | prob)))
+        const int m = min(leveldb::wormhole::kProbeGroup, n - start);
+        for (int i = 0; i < m; i++)
         {
-            return true;
+            homes[i] = index_hash(hashes[start + i], p_pmwormholefilter->num_buckets_);
+            tags[i] = tag_hash(hashes[start + i] >> 32);
         }
+        leveldb::wormhole::ProbeBatch((const char *)p_pmwormholefilter->buckets_, p_pmwormholefilter->num_buckets_, pmwormholefilter_layout(), homes, tags, m, out + start);
     }
-
-    return false;
 }
 
-int pmwormholefilter_delete(PMEMobjpool *pop, TOID(struct pmwormholefilter_root) pmwormholefilter_root, uint64_t key_)
+int pmwormholefilter_lookup(PMEMobjpool *pop, TOID(struct pmwormholefilter_root) pmwormholefilter_root, uint64_t key_)
 {
     struct pmwormholefilter *p_pmwormholefilter = D_RW(D_RW(pmwormholefilter_root)->pmwormholefilter);
 
     const uint64_t hash = p_pmwormholefilter->hasher_(key_);
+    return pmwormholefilter_lookup_hash(p_pmwormholefilter, hash);
+}
+
+inline int pmwormholefilter_delete_at(struct pmwormholefilter *p_pmwormholefilter, uint64_t init_buck_idx, uint64_t tag)
+{
+    struct pmwormholefilter_buckets buckets = {NULL, p_pmwormholefilter, false};
+    return leveldb::wormhole::DeleteTag(&buckets, pmwormholefilter_layout(), init_buck_idx, tag);
+}
+
+inline int pmwormholefilter_delete_hash(struct pmwormholefilter *p_pmwormholefilter, uint64_t hash)
+{
     uint64_t init_buck_idx = index_hash(hash, p_pmwormholefilter->num_buckets_);
     uint64_t tag = tag_hash(hash >> 32);
+    return pmwormholefilter_delete_at(p_pmwormholefilter, init_buck_idx, tag);
+}
 
-    for (uint32_t prob = 0; prob < MAX_PROB; prob++)
-    {
-        for (size_t curr_tag_idx = 0; curr_tag_idx < SLOT_PER_BUK; curr_tag_idx++)
-        {
-            if (ReadTag(p_pmwormholefilter, init_buck_idx + prob, curr_tag_idx) == (tag | prob))
-            {
-                WriteTag(p_pmwormholefilter, init_buck_idx + prob, curr_tag_idx, 0);
-                return true;
-            }
-        }
-    }
-    return false;
+int pmwormholefilter_delete(PMEMobjpool *pop, TOID(struct pmwormholefilter_root) pmwormholefilter_root, uint64_t key_)
+{
+    struct pmwormholefilter *p_pmwormholefilter = D_RW(D_RW(pmwormholefilter_root)->pmwormholefilter);
+
+    const uint64_t hash = p_pmwormholefilter->hasher_(key_);
+    return pmwormholefilter_delete_hash(p_pmwormholefilter, hash);
 }
 
 int pmwormholefilter_bytes(PMEMobjpool *pop, TOID(struct pmwormholefilter_root) pmwormholefilter_root)
@@ -0,0 +1,316 @@
+#ifndef PMWORMHOLE_FILTER_ASYNC_HPP_
+#define PMWORMHOLE_FILTER_ASYNC_HPP_
+
+#include "pm_wf/pmwormholefilter.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Write-behind insertion for the PM wormhole filter.
+//
+// Every producer thread owns one lock-free SPSC queue and only pays for an
+// enqueue into DRAM. A single persister thread drains all queues, applies the
+// keys in home-bucket order with plain stores, then flushes the dirty cache
+// lines of the batch and issues one drain. A key is visible to lookups as soon
+// as the persister has applied it, and durable once pmwormholefilter_async_sync()
+// covering its enqueue has returned.
+//
+// When every queue stays empty for ASYNC_IDLE_POLLS polls the persister parks
+// on a condition variable; inserts and syncs wake it up again.
+//
+// Displacement always writes the moved tag to its new slot before the old slot
+// is reused, so lookups running concurrently with the persister never miss a
+// key that was already applied.
+
+#define ASYNC_CACHE_LINE 64
+#define ASYNC_BUCKETS_PER_LINE (ASYNC_CACHE_LINE / sizeof(uint64_t))
+#define ASYNC_MAX_BATCH 4096
+#define ASYNC_IDLE_POLLS 64
+
+struct alignas(ASYNC_CACHE_LINE) pmwormholefilter_spsc
+{
+    // Written by the producer only.
+    alignas(ASYNC_CACHE_LINE) std::atomic<uint64_t> tail_;
+    // Written by the persister only: next slot to dequeue.
+    alignas(ASYNC_CACHE_LINE) std::atomic<uint64_t> head_;
+    // Written by the persister only: number of keys applied and flushed.
+    alignas(ASYNC_CACHE_LINE) std::atomic<uint64_t> persisted_;
+
+    alignas(ASYNC_CACHE_LINE) uint64_t mask_;
+    uint64_t *slots_;
+};
+
+struct pmwormholefilter_async
+{
+    PMEMobjpool *pop_;
+    struct pmwormholefilter *filter_;
+
+    std::vector<struct pmwormholefilter_spsc *> queues_;
+    std::thread persister_;
+    std::atomic<bool> stop_;
+
+    // The persister sets sleeping_ before it parks on wakeup_; whoever finds
+    // it set clears it under mutex_ and notifies.
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    std::atomic<bool> sleeping_;
+
+    // Incremented after each batch has been flushed and drained.
+    std::atomic<uint64_t> epoch_;
+    // Number of keys the persister could not place ("Full").
+    std::atomic<uint64_t> failed_;
+    uint64_t failed_at_sync_;
+};
+
+void pmwormholefilter_async_init(struct pmwormholefilter_async *async, PMEMobjpool *pop, TOID(struct pmwormholefilter_root) pmwormholefilter_root, uint32_t num_producers, uint32_t queue_capacity);
+
+void pmwormholefilter_async_destroy(struct pmwormholefilter_async *async);
+
+int pmwormholefilter_async_insert(struct pmwormholefilter_async *async, uint32_t producer, uint64_t key_);
+
+int pmwormholefilter_async_sync(struct pmwormholefilter_async *async);
+
+uint64_t pmwormholefilter_async_epoch(struct pmwormholefilter_async *async);
+
+inline void pmwormholefilter_async_wake(struct pmwormholefilter_async *async)
+{
+    // Pairs with the fence in pmwormholefilter_async_park(): either the
+    // persister sees the new work or this sees sleeping_.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (async->sleeping_.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(async->mutex_);
+        async->sleeping_.store(false, std::memory_order_relaxed);
+        async->wakeup_.notify_one();
+    }
+}
+
+// Waits until pmwormholefilter_async_wake() unless a queue already has keys or
+// the filter is being destroyed.
+inline void pmwormholefilter_async_park(struct pmwormholefilter_async *async)
+{
+    std::unique_lock<std::mutex> lock(async->mutex_);
+    async->sleeping_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    bool idle = !async->stop_.load(std::memory_order_acquire);
+    for (size_t q = 0; q < async->queues_.size() && idle; q++)
+    {
+        struct pmwormholefilter_spsc *queue = async->queues_[q];
+        idle = queue->tail_.load(std::memory_order_acquire) == queue->head_.load(std::memory_order_relaxed);
+    }
+    if (idle)
+    {
+        async->wakeup_.wait(lock, [async]
+                            { return !async->sleeping_.load(std::memory_order_relaxed); });
+    }
+    async->sleeping_.store(false, std::memory_order_relaxed);
+}
+
+inline void pmwormholefilter_async_flush_lines(struct pmwormholefilter_async *async, std::vector<uint32_t> &lines)
+{
+    struct pmwormholefilter *p_pmwormholefilter = async->filter_;
+    if (lines.empty())
+    {
+        return;
+    }
+
+    std::sort(lines.begin(), lines.end());
+    lines.erase(std::unique(lines.begin(), lines.end()), lines.end());
+
+    // Coalesce runs of adjacent lines into a single flush.
+    size_t run_start = 0;
+    for (size_t i = 1; i <= lines.size(); i++)
+    {
+        if (i == lines.size() || lines[i] != lines[i - 1] + 1)
+        {
+            uint64_t first_buck = (uint64_t)lines[run_start] * ASYNC_BUCKETS_PER_LINE;
+            uint64_t last_buck = std::min<uint64_t>((uint64_t)(lines[i - 1] + 1) * ASYNC_BUCKETS_PER_LINE, p_pmwormholefilter->num_buckets_);
+            pmemobj_flush(async->pop_, &p_pmwormholefilter->buckets_[first_buck], sizeof(uint64_t) * (last_buck - first_buck));
+            run_start = i;
+        }
+    }
+    pmemobj_drain(async->pop_);
+    lines.clear();
+}
+
+inline void pmwormholefilter_async_persister(struct pmwormholefilter_async *async)
+{
+    struct pmwormholefilter *p_pmwormholefilter = async->filter_;
+    const size_t num_queues = async->queues_.size();
+
+    std::vector<std::pair<uint32_t, uint64_t>> batch;
+    std::vector<uint64_t> limits(num_queues);
+    std::vector<uint32_t> lines;
+    batch.reserve(ASYNC_MAX_BATCH);
+    uint32_t idle_polls = 0;
+
+    while (true)
+    {
+        // Stop is only honoured once every queue is empty.
+        bool stopping = async->stop_.load(std::memory_order_acquire);
+
+        batch.clear();
+        size_t quota = ASYNC_MAX_BATCH / num_queues + 1;
+        for (size_t q = 0; q < num_queues; q++)
+        {
+            struct pmwormholefilter_spsc *queue = async->queues_[q];
+            uint64_t head = queue->head_.load(std::memory_order_relaxed);
+            uint64_t tail = queue->tail_.load(std::memory_order_acquire);
+            uint64_t limit = std::min<uint64_t>(tail, head + quota);
+            for (uint64_t i = head; i < limit; i++)
+            {
+                const uint64_t hash = p_pmwormholefilter->hasher_(queue->slots_[i & queue->mask_]);
+                batch.push_back(std::make_pair(index_hash(hash, p_pmwormholefilter->num_buckets_), hash));
+            }
+            queue->head_.store(limit, std::memory_order_release);
+            limits[q] = limit;
+        }
+
+        if (batch.empty())
+        {
+            if (stopping)
+            {
+                return;
+            }
+            if (++idle_polls < ASYNC_IDLE_POLLS)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                pmwormholefilter_async_park(async);
+                idle_polls = 0;
+            }
+            continue;
+        }
+        idle_polls = 0;
+
+        // Apply in bucket order so that neighbouring inserts share cache lines.
+        std::sort(batch.begin(), batch.end());
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            uint64_t init_buck_idx = batch[i].first;
+            uint64_t last_buck_idx = init_buck_idx;
+            if (pmwormholefilter_insert_hash(async->pop_, p_pmwormholefilter, batch[i].second, false, &last_buck_idx) == false)
+            {
+                async->failed_.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            for (uint64_t b = init_buck_idx; b <= last_buck_idx; b += ASYNC_BUCKETS_PER_LINE)
+            {
+                lines.push_back(MOD(b, p_pmwormholefilter->num_buckets_) / ASYNC_BUCKETS_PER_LINE);
+            }
+            lines.push_back(MOD(last_buck_idx, p_pmwormholefilter->num_buckets_) / ASYNC_BUCKETS_PER_LINE);
+        }
+        pmwormholefilter_async_flush_lines(async, lines);
+
+        for (size_t q = 0; q < num_queues; q++)
+        {
+            async->queues_[q]->persisted_.store(limits[q], std::memory_order_release);
+        }
+        async->epoch_.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void pmwormholefilter_async_init(struct pmwormholefilter_async *async, PMEMobjpool *pop, TOID(struct pmwormholefilter_root) pmwormholefilter_root, uint32_t num_producers, uint32_t queue_capacity)
+{
+    async->pop_ = pop;
+    async->filter_ = D_RW(D_RW(pmwormholefilter_root)->pmwormholefilter);
+    async->stop_.store(false);
+    async->sleeping_.store(false);
+    async->epoch_.store(0);
+    async->failed_.store(0);
+    async->failed_at_sync_ = 0;
+
+    uint64_t capacity = 1;
+    while (capacity < queue_capacity)
+    {
+        capacity <<= 1;
+    }
+
+    for (uint32_t i = 0; i < num_producers; i++)
+    {
+        struct pmwormholefilter_spsc *queue = new pmwormholefilter_spsc;
+        queue->tail_.store(0);
+        queue->head_.store(0);
+        queue->persisted_.store(0);
+        queue->mask_ = capacity - 1;
+        queue->slots_ = new uint64_t[capacity];
+        async->queues_.push_back(queue);
+    }
+
+    async->persister_ = std::thread(pmwormholefilter_async_persister, async);
+}
+
+void pmwormholefilter_async_destroy(struct pmwormholefilter_async *async)
+{
+    async->stop_.store(true, std::memory_order_release);
+    pmwormholefilter_async_wake(async);
+    if (async->persister_.joinable())
+    {
+        async->persister_.join();
+    }
+
+    for (size_t i = 0; i < async->queues_.size(); i++)
+    {
+        delete[] async->queues_[i]->slots_;
+        delete async->queues_[i];
+    }
+    async->queues_.clear();
+}
+
+// Must only be called from the thread that owns queue "producer". Spins while
+// the queue is full, which throttles producers to the persister's pace.
+int pmwormholefilter_async_insert(struct pmwormholefilter_async *async, uint32_t producer, uint64_t key_)
+{
+    struct pmwormholefilter_spsc *queue = async->queues_[producer];
+    uint64_t tail = queue->tail_.load(std::memory_order_relaxed);
+
+    while (tail - queue->head_.load(std::memory_order_acquire) > queue->mask_)
+    {
+        std::this_thread::yield();
+    }
+
+    queue->slots_[tail & queue->mask_] = key_;
+    queue->tail_.store(tail + 1, std::memory_order_release);
+    pmwormholefilter_async_wake(async);
+    return true;
+}
+
+// Ack barrier: returns once every key enqueued before the call is applied and
+// persisted. Returns false if any key since the previous sync did not fit.
+int pmwormholefilter_async_sync(struct pmwormholefilter_async *async)
+{
+    std::vector<uint64_t> targets(async->queues_.size());
+    for (size_t q = 0; q < async->queues_.size(); q++)
+    {
+        targets[q] = async->queues_[q]->tail_.load(std::memory_order_acquire);
+    }
+    pmwormholefilter_async_wake(async);
+
+    for (size_t q = 0; q < async->queues_.size(); q++)
+    {
+        while (async->queues_[q]->persisted_.load(std::memory_order_acquire) < targets[q])
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    uint64_t failed = async->failed_.load(std::memory_order_relaxed);
+    int ok = (failed == async->failed_at_sync_);
+    async->failed_at_sync_ = failed;
+    return ok;
+}
+
+uint64_t pmwormholefilter_async_epoch(struct pmwormholefilter_async *async)
+{
+    return async->epoch_.load(std::memory_order_acquire);
+}
+
+#endif // PMWORMHOLE_FILTER_ASYNC_HPP_
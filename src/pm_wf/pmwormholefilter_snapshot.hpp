@@ -0,0 +1,346 @@
+#ifndef PMWORMHOLE_FILTER_SNAPSHOT_HPP_
+#define PMWORMHOLE_FILTER_SNAPSHOT_HPP_
+
+#include "pm_wf/pmwormholefilter.hpp"
+
+#include <atomic>
+#include <emmintrin.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+// Read-only snapshots of a PM wormhole filter for multi-process lookup.
+//
+// A pmemobj pool can only be opened by one process at a time, so the writer
+// freezes the filter into an immutable image that any number of readers map
+// with PROT_READ/MAP_SHARED and query in place through
+// pmwormholefilter_lookup_hash(); nothing is copied on the read side.
+//
+// The mapping starts with a control header followed by one or two image slots:
+//
+//   [header, 4 KB][slot 0: struct pmwormholefilter image][slot 1 (devdax)]
+//
+// current_ packs (epoch << 1 | slot) into one word, so a reader always sees a
+// consistent epoch/slot pair.
+//
+// * Regular file: the writer builds a complete new file next to the target and
+//   rename()s it over the old one, then fsync()s the directory before the
+//   epoch counts as published. Readers keep the old inode mapped until
+//   pmwormholefilter_snapshot_refresh() notices the replacement and remaps.
+// * Device DAX: the device cannot be replaced, so the writer fills the inactive
+//   slot, persists it, then flips current_. Readers pick the slot on every
+//   acquire. A reader must not hold an image across two publishes, since the
+//   second one reuses its slot.
+
+#define SNAPSHOT_MAGIC 0x504e535f46574d50ULL
+#define SNAPSHOT_HEADER_SIZE 4096
+#define SNAPSHOT_CACHE_LINE 64
+
+struct pmwormholefilter_snapshot_header
+{
+    uint64_t magic_;
+    std::atomic<uint64_t> current_;
+    uint64_t slot_size_;
+    uint64_t num_slots_;
+};
+
+struct pmwormholefilter_snapshot
+{
+    int fd_;
+    char *base_;
+    size_t size_;
+    bool devdax_;
+    dev_t dev_;
+    ino_t ino_;
+};
+
+int pmwormholefilter_snapshot_publish(PMEMobjpool *pop, TOID(struct pmwormholefilter_root) pmwormholefilter_root, const char *path, uint64_t epoch);
+
+int pmwormholefilter_snapshot_open(struct pmwormholefilter_snapshot *snapshot, const char *path);
+
+int pmwormholefilter_snapshot_refresh(struct pmwormholefilter_snapshot *snapshot, const char *path);
+
+const struct pmwormholefilter *pmwormholefilter_snapshot_acquire(const struct pmwormholefilter_snapshot *snapshot, uint64_t *epoch);
+
+int pmwormholefilter_snapshot_lookup(const struct pmwormholefilter_snapshot *snapshot, uint64_t key_);
+
+void pmwormholefilter_snapshot_close(struct pmwormholefilter_snapshot *snapshot);
+
+inline size_t pmwormholefilter_image_bytes(const struct pmwormholefilter *p_pmwormholefilter)
+{
+    return sizeof(struct pmwormholefilter) + sizeof(uint64_t) * p_pmwormholefilter->num_buckets_;
+}
+
+// Device DAX mappings bypass the page cache, so msync() does not write back
+// the CPU caches; flush the lines explicitly instead.
+inline void pmwormholefilter_snapshot_persist(const void *addr, size_t len)
+{
+    uintptr_t p = (uintptr_t)addr & ~(uintptr_t)(SNAPSHOT_CACHE_LINE - 1);
+    for (; p < (uintptr_t)addr + len; p += SNAPSHOT_CACHE_LINE)
+    {
+        _mm_clflush((const void *)p);
+    }
+    _mm_sfence();
+}
+
+inline size_t pmwormholefilter_devdax_size(const struct stat &st)
+{
+    char sys_path[128];
+    snprintf(sys_path, sizeof(sys_path), "/sys/dev/char/%u:%u/size", major(st.st_rdev), minor(st.st_rdev));
+    FILE *f = fopen(sys_path, "r");
+    if (f == NULL)
+    {
+        return 0;
+    }
+    unsigned long long size = 0;
+    if (fscanf(f, "%llu", &size) != 1)
+    {
+        size = 0;
+    }
+    fclose(f);
+    return size;
+}
+
+inline int pmwormholefilter_snapshot_publish_devdax(const struct pmwormholefilter *p_pmwormholefilter, int fd, size_t dev_size, uint64_t epoch)
+{
+    const size_t image_bytes = pmwormholefilter_image_bytes(p_pmwormholefilter);
+    char *base = (char *)mmap(NULL, dev_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+    {
+        return false;
+    }
+
+    struct pmwormholefilter_snapshot_header *header = (struct pmwormholefilter_snapshot_header *)base;
+    uint64_t slot = 0;
+    if (header->magic_ == SNAPSHOT_MAGIC)
+    {
+        if (header->slot_size_ < image_bytes || SNAPSHOT_HEADER_SIZE + 2 * header->slot_size_ > dev_size)
+        {
+            munmap(base, dev_size);
+            return false;
+        }
+        slot = (header->current_.load(std::memory_order_acquire) & 1) ^ 1;
+    }
+    else
+    {
+        // First publish: split the device into two equal slots.
+        header->slot_size_ = ((dev_size - SNAPSHOT_HEADER_SIZE) / 2) & ~(uint64_t)(SNAPSHOT_HEADER_SIZE - 1);
+        header->num_slots_ = 2;
+        if (header->slot_size_ < image_bytes)
+        {
+            munmap(base, dev_size);
+            return false;
+        }
+    }
+
+    char *image = base + SNAPSHOT_HEADER_SIZE + slot * header->slot_size_;
+    memcpy(image, p_pmwormholefilter, image_bytes);
+    pmwormholefilter_snapshot_persist(image, image_bytes);
+
+    // Publish the slot only after its contents are durable.
+    header->magic_ = SNAPSHOT_MAGIC;
+    header->current_.store((epoch << 1) | slot, std::memory_order_release);
+    pmwormholefilter_snapshot_persist(header, sizeof(*header));
+
+    munmap(base, dev_size);
+    return true;
+}
+
+// Makes a rename() into the directory of path durable.
+inline int pmwormholefilter_sync_parent_dir(const char *path)
+{
+    std::string dir(path);
+    size_t slash = dir.find_last_of('/');
+    if (slash == std::string::npos)
+    {
+        dir = ".";
+    }
+    else
+    {
+        dir.resize(slash == 0 ? 1 : slash);
+    }
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+inline int pmwormholefilter_snapshot_publish_file(const struct pmwormholefilter *p_pmwormholefilter, const char *path, uint64_t epoch)
+{
+    const size_t image_bytes = pmwormholefilter_image_bytes(p_pmwormholefilter);
+    std::string tmp_path = std::string(path) + ".tmp";
+    int fd = open(tmp_path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    char header_page[SNAPSHOT_HEADER_SIZE];
+    memset(header_page, 0, sizeof(header_page));
+    struct pmwormholefilter_snapshot_header *header = (struct pmwormholefilter_snapshot_header *)header_page;
+    header->magic_ = SNAPSHOT_MAGIC;
+    header->current_.store(epoch << 1);
+    header->slot_size_ = image_bytes;
+    header->num_slots_ = 1;
+
+    bool ok = pwrite(fd, header_page, sizeof(header_page), 0) == (ssize_t)sizeof(header_page);
+    size_t written = 0;
+    while (ok && written < image_bytes)
+    {
+        ssize_t n = pwrite(fd, (const char *)p_pmwormholefilter + written, image_bytes - written, SNAPSHOT_HEADER_SIZE + written);
+        ok = n > 0;
+        written += ok ? n : 0;
+    }
+    ok = ok && fsync(fd) == 0;
+    close(fd);
+
+    // rename() atomically swaps the new image in for every later open().
+    if (!ok || rename(tmp_path.c_str(), path) != 0)
+    {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    // Until the directory is synced a crash may still bring back the previous
+    // snapshot, or no file at all, so the epoch is not published yet.
+    return pmwormholefilter_sync_parent_dir(path);
+}
+
+int pmwormholefilter_snapshot_publish(PMEMobjpool *pop, TOID(struct pmwormholefilter_root) pmwormholefilter_root, const char *path, uint64_t epoch)
+{
+    const struct pmwormholefilter *p_pmwormholefilter = D_RO(D_RO(pmwormholefilter_root)->pmwormholefilter);
+
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISCHR(st.st_mode))
+    {
+        int fd = open(path, O_RDWR);
+        if (fd < 0)
+        {
+            return false;
+        }
+        int ok = pmwormholefilter_snapshot_publish_devdax(p_pmwormholefilter, fd, pmwormholefilter_devdax_size(st), epoch);
+        close(fd);
+        return ok;
+    }
+    return pmwormholefilter_snapshot_publish_file(p_pmwormholefilter, path, epoch);
+}
+
+int pmwormholefilter_snapshot_open(struct pmwormholefilter_snapshot *snapshot, const char *path)
+{
+    snapshot->fd_ = -1;
+    snapshot->base_ = NULL;
+    snapshot->size_ = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    snapshot->devdax_ = S_ISCHR(st.st_mode);
+    snapshot->dev_ = st.st_dev;
+    snapshot->ino_ = st.st_ino;
+    size_t size = snapshot->devdax_ ? pmwormholefilter_devdax_size(st) : (size_t)st.st_size;
+    if (size < SNAPSHOT_HEADER_SIZE)
+    {
+        close(fd);
+        return false;
+    }
+
+    char *base = (char *)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+    {
+        close(fd);
+        return false;
+    }
+
+    const struct pmwormholefilter_snapshot_header *header = (const struct pmwormholefilter_snapshot_header *)base;
+    if (header->magic_ != SNAPSHOT_MAGIC || SNAPSHOT_HEADER_SIZE + header->num_slots_ * header->slot_size_ > size)
+    {
+        munmap(base, size);
+        close(fd);
+        return false;
+    }
+
+    snapshot->fd_ = fd;
+    snapshot->base_ = base;
+    snapshot->size_ = size;
+    return true;
+}
+
+// For file snapshots, switches to the newest published file if the path has
+// been replaced since the snapshot was opened. Must not run concurrently with
+// lookups on the same snapshot object. Device DAX snapshots switch on every
+// acquire and need no refresh.
+int pmwormholefilter_snapshot_refresh(struct pmwormholefilter_snapshot *snapshot, const char *path)
+{
+    if (snapshot->devdax_)
+    {
+        return true;
+    }
+
+    struct stat st;
+    if (stat(path, &st) != 0)
+    {
+        return false;
+    }
+    if (st.st_dev == snapshot->dev_ && st.st_ino == snapshot->ino_)
+    {
+        return true;
+    }
+
+    struct pmwormholefilter_snapshot fresh;
+    if (!pmwormholefilter_snapshot_open(&fresh, path))
+    {
+        return false;
+    }
+    pmwormholefilter_snapshot_close(snapshot);
+    *snapshot = fresh;
+    return true;
+}
+
+const struct pmwormholefilter *pmwormholefilter_snapshot_acquire(const struct pmwormholefilter_snapshot *snapshot, uint64_t *epoch)
+{
+    const struct pmwormholefilter_snapshot_header *header = (const struct pmwormholefilter_snapshot_header *)snapshot->base_;
+    uint64_t current = header->current_.load(std::memory_order_acquire);
+    if (epoch != NULL)
+    {
+        *epoch = current >> 1;
+    }
+    return (const struct pmwormholefilter *)(snapshot->base_ + SNAPSHOT_HEADER_SIZE + (current & 1) * header->slot_size_);
+}
+
+int pmwormholefilter_snapshot_lookup(const struct pmwormholefilter_snapshot *snapshot, uint64_t key_)
+{
+    const struct pmwormholefilter *p_pmwormholefilter = pmwormholefilter_snapshot_acquire(snapshot, NULL);
+
+    const uint64_t hash = p_pmwormholefilter->hasher_(key_);
+    return pmwormholefilter_lookup_hash(p_pmwormholefilter, hash);
+}
+
+void pmwormholefilter_snapshot_close(struct pmwormholefilter_snapshot *snapshot)
+{
+    if (snapshot->base_ != NULL)
+    {
+        munmap(snapshot->base_, snapshot->size_);
+        close(snapshot->fd_);
+    }
+    snapshot->base_ = NULL;
+    snapshot->fd_ = -1;
+}
+
+#endif // PMWORMHOLE_FILTER_SNAPSHOT_HPP_
@@ -0,0 +1,120 @@
+#ifndef PMWORMHOLE_FILTER_TWOCHOICE_HPP_
+#define PMWORMHOLE_FILTER_TWOCHOICE_HPP_
+
+#include "pm_wf/pmwormholefilter.hpp"
+
+// Two-choice variant of the PM wormhole filter.
+//
+// A key has two home buckets and may live in either 16-bucket window. Insert
+// picks the window with more empty slots and falls back to the other one, so
+// local clustering no longer ends the fill long before the table is full.
+// Lookup prefetches both windows and probes each with one vector compare per
+// four buckets. The bucket layout is unchanged: a tag's distance field stays
+// relative to whichever home it was placed from, so wormhole displacement works
+// as-is. The price is a second window per lookup and about twice the false
+// positive rate of the single-home filter at the same load.
+//
+// As in partial-key cuckoo filters, the alternate home is derived from the home
+// and the tag only, never from the rest of the hash. Keys whose entries look
+// the same therefore share both windows, and a delete that frees the entry of
+// another such key leaves that key's entry for it in their common windows.
+// Tables filled before this change used another alternate home and must be
+// rebuilt.
+//
+// A table must be used exclusively through either these functions or the
+// single-home ones.
+
+// (offset(tag) - home) mod n, so the alternate of the alternate is the home.
+inline uint32_t alt_index_hash(uint64_t home, uint64_t tag, uint32_t num_buckets_)
+{
+    const uint64_t offset = ((tag * 0x9E3779B97F4A7C15ULL) >> 32) % num_buckets_;
+    return (offset + num_buckets_ - home) % num_buckets_;
+}
+
+// High bit of every 16-bit lane of x that is zero, without borrows between lanes.
+#define zerolanes16(x) (~((((x)&0x7FFF7FFF7FFF7FFFULL) + 0x7FFF7FFF7FFF7FFFULL) | (x) | 0x7FFF7FFF7FFF7FFFULL))
+
+inline uint32_t pmwormholefilter_window_free(const struct pmwormholefilter *p_pmwormholefilter, uint64_t init_buck_idx)
+{
+    uint32_t free_slots = 0;
+    for (uint32_t prob = 0; prob < MAX_PROB; prob++)
+    {
+        uint64_t bucket = p_pmwormholefilter->buckets_[MOD(init_buck_idx + prob, p_pmwormholefilter->num_buckets_)];
+        free_slots += __builtin_popcountll(zerolanes16(bucket));
+    }
+    return free_slots;
+}
+
+inline void pmwormholefilter_prefetch_window(const struct pmwormholefilter *p_pmwormholefilter, uint64_t init_buck_idx)
+{
+    leveldb::wormhole::PrefetchWindow((const char *)p_pmwormholefilter->buckets_, p_pmwormholefilter->num_buckets_, pmwormholefilter_layout(), init_buck_idx);
+}
+
+inline int pmwormholefilter_insert_twochoice_hash(PMEMobjpool *pop, struct pmwormholefilter *p_pmwormholefilter, uint64_t hash, bool persist)
+{
+    uint64_t home = index_hash(hash, p_pmwormholefilter->num_buckets_);
+    uint64_t tag = tag_hash(hash >> 32);
+    uint64_t alt_home = alt_index_hash(home, tag, p_pmwormholefilter->num_buckets_);
+
+    if (pmwormholefilter_window_free(p_pmwormholefilter, alt_home) > pmwormholefilter_window_free(p_pmwormholefilter, home))
+    {
+        std::swap(home, alt_home);
+    }
+
+    // A failed attempt only leaves duplicated tags behind, so the other window
+    // can still be tried.
+    if (pmwormholefilter_insert_at(pop, p_pmwormholefilter, home, tag, persist, NULL))
+    {
+        return true;
+    }
+    return pmwormholefilter_insert_at(pop, p_pmwormholefilter, alt_home, tag, persist, NULL);
+}
+
+inline int pmwormholefilter_lookup_twochoice_hash(const struct pmwormholefilter *p_pmwormholefilter, uint64_t hash)
+{
+    uint64_t home = index_hash(hash, p_pmwormholefilter->num_buckets_);
+    uint64_t tag = tag_hash(hash >> 32);
+    uint64_t alt_home = alt_index_hash(home, tag, p_pmwormholefilter->num_buckets_);
+
+    pmwormholefilter_prefetch_window(p_pmwormholefilter, home);
+    pmwormholefilter_prefetch_window(p_pmwormholefilter, alt_home);
+
+    return pmwormholefilter_lookup_at(p_pmwormholefilter, home, tag) || pmwormholefilter_lookup_at(p_pmwormholefilter, alt_home, tag);
+}
+
+inline int pmwormholefilter_delete_twochoice_hash(struct pmwormholefilter *p_pmwormholefilter, uint64_t hash)
+{
+    uint64_t home = index_hash(hash, p_pmwormholefilter->num_buckets_);
+    uint64_t tag = tag_hash(hash >> 32);
+    if (pmwormholefilter_delete_at(p_pmwormholefilter, home, tag))
+    {
+        return true;
+    }
+    return pmwormholefilter_delete_at(p_pmwormholefilter, alt_index_hash(home, tag, p_pmwormholefilter->num_buckets_), tag);
+}
+
+int pmwormholefilter_insert_twochoice(PMEMobjpool *pop, TOID(struct pmwormholefilter_root) pmwormholefilter_root, uint64_t key_)
+{
+    struct pmwormholefilter *p_pmwormholefilter = D_RW(D_RW(pmwormholefilter_root)->pmwormholefilter);
+
+    const uint64_t hash = p_pmwormholefilter->hasher_(key_);
+    return pmwormholefilter_insert_twochoice_hash(pop, p_pmwormholefilter, hash, true);
+}
+
+int pmwormholefilter_lookup_twochoice(PMEMobjpool *pop, TOID(struct pmwormholefilter_root) pmwormholefilter_root, uint64_t key_)
+{
+    struct pmwormholefilter *p_pmwormholefilter = D_RW(D_RW(pmwormholefilter_root)->pmwormholefilter);
+
+    const uint64_t hash = p_pmwormholefilter->hasher_(key_);
+    return pmwormholefilter_lookup_twochoice_hash(p_pmwormholefilter, hash);
+}
+
+int pmwormholefilter_delete_twochoice(PMEMobjpool *pop, TOID(struct pmwormholefilter_root) pmwormholefilter_root, uint64_t key_)
+{
+    struct pmwormholefilter *p_pmwormholefilter = D_RW(D_RW(pmwormholefilter_root)->pmwormholefilter);
+
+    const uint64_t hash = p_pmwormholefilter->hasher_(key_);
+    return pmwormholefilter_delete_twochoice_hash(p_pmwormholefilter, hash);
+}
+
+#endif // PMWORMHOLE_FILTER_TWOCHOICE_HPP_
@@ -1,5 +1,9 @@
 #include "assert.h"
 #include "pm_wf/pmwormholefilter.hpp"
+#include "pm_wf/pmwormholefilter_async.hpp"
+#include "pm_wf/pmwormholefilter_snapshot.hpp"
+#include "pm_wf/pmwormholefilter_twochoice.hpp"
+#include "perf_counters.hpp"
 
 #include <chrono>
 #include <cstdint>
@@ -11,6 +15,7 @@
 #include <set>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <vector>
 
@@ -25,8 +30,39 @@ using namespace std;
         .count();
 }
 
-int main()
+void PrintSpace(PMEMobjpool *pop, TOID(struct pmwormholefilter_root) pmwormholefilter_root, uint64_t added)
 {
+    int bytes = pmwormholefilter_bytes(pop, pmwormholefilter_root);
+    cout << "Load factor: " << (double)added / (bytes / sizeof(uint64_t) * SLOT_PER_BUK)
+         << ", bits per key: " << 8.0 * bytes / added << endl;
+}
+
+int main(int argc, char **argv)
+{
+    // --perf wraps every phase with hardware performance counters.
+    // --snapshot=<file or /dev/daxX.Y> also queries a read-only snapshot.
+    PerfCounters perf;
+    const char *snapshot_path = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--snapshot=", 11) == 0)
+        {
+            snapshot_path = argv[i] + 11;
+        }
+        else if (strcmp(argv[i], "--perf") == 0)
+        {
+            if (!perf.Open())
+            {
+                cout << "perf_event_open unavailable, counters disabled" << endl;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+            exit(1);
+        }
+    }
+
     uint64_t *vals;
     uint64_t nvals = 1024 * 1024 * 8;
 
@@ -64,6 +100,7 @@ int main()
     pmwormholefilter_init(pop, pmwormholefilter_root, nvals);
 
     uint64_t added = 0;
+    perf.Start();
     auto start_time = NowNanos();
     for (added = 0; added < nvals; added++)
     {
@@ -73,17 +110,118 @@ int main()
             break;
         }
     }
-    cout << "Insertion throughput: " << 1000.0 * added / static_cast<double>(NowNanos() - start_time) << " MOPS" << endl;
+    auto end_time = NowNanos();
+    perf.Stop();
+    cout << "Insertion throughput: " << 1000.0 * added / static_cast<double>(end_time - start_time) << " MOPS" << endl;
+    perf.Report("Insertion", added);
+    PrintSpace(pop, pmwormholefilter_root, added);
+
+    perf.Start();
+    start_time = NowNanos();
+    for (int looked = 0; looked < added; looked++)
+    {
+        if (pmwormholefilter_lookup(pop, pmwormholefilter_root, vals[looked]) == false)
+        {
+            cout << "ERROR" << endl;
+        }
+    }
+    end_time = NowNanos();
+    perf.Stop();
+    cout << "Lookup throughput: " << 1000.0 * added / static_cast<double>(end_time - start_time) << " MOPS" << endl;
+    perf.Report("Lookup", added);
+
+    if (snapshot_path != NULL)
+    {
+        struct pmwormholefilter_snapshot snapshot;
+        if (!pmwormholefilter_snapshot_publish(pop, pmwormholefilter_root, snapshot_path, 1) || !pmwormholefilter_snapshot_open(&snapshot, snapshot_path))
+        {
+            fprintf(stderr, "cannot publish snapshot to %s\n", snapshot_path);
+            exit(1);
+        }
+
+        perf.Start();
+        start_time = NowNanos();
+        for (int looked = 0; looked < added; looked++)
+        {
+            if (pmwormholefilter_snapshot_lookup(&snapshot, vals[looked]) == false)
+            {
+                cout << "ERROR" << endl;
+            }
+        }
+        end_time = NowNanos();
+        perf.Stop();
+        cout << "Snapshot lookup throughput: " << 1000.0 * added / static_cast<double>(end_time - start_time) << " MOPS" << endl;
+        perf.Report("Snapshot lookup", added);
+        pmwormholefilter_snapshot_close(&snapshot);
+    }
 
+    pmwormholefilter_destroy(pop, pmwormholefilter_root);
+    pmwormholefilter_init(pop, pmwormholefilter_root, nvals);
+
+    struct pmwormholefilter_async async;
+    pmwormholefilter_async_init(&async, pop, pmwormholefilter_root, 1, 1 << 16);
+
+    perf.Start();
     start_time = NowNanos();
+    for (uint64_t i = 0; i < added; i++)
+    {
+        pmwormholefilter_async_insert(&async, 0, vals[i]);
+    }
+    auto enqueue_time = NowNanos();
+    if (pmwormholefilter_async_sync(&async) == false)
+    {
+        cout << "Full" << endl;
+    }
+    auto sync_time = NowNanos();
+    perf.Stop();
+    cout << "Async insertion throughput: " << 1000.0 * added / static_cast<double>(enqueue_time - start_time) << " MOPS (enqueue), "
+         << 1000.0 * added / static_cast<double>(sync_time - start_time) << " MOPS (durable)" << endl;
+    perf.Report("Async insertion", added);
+    pmwormholefilter_async_destroy(&async);
+
     for (int looked = 0; looked < added; looked++)
     {
         if (pmwormholefilter_lookup(pop, pmwormholefilter_root, vals[looked]) == false)
+        {
+            cout << "ERROR" << endl;
+            break;
+        }
+    }
+
+    // Two-choice homes, sized for 95% load.
+    pmwormholefilter_destroy(pop, pmwormholefilter_root);
+    pmwormholefilter_init_load(pop, pmwormholefilter_root, nvals, 0.95);
+
+    uint64_t added_twochoice = 0;
+    perf.Start();
+    start_time = NowNanos();
+    for (added_twochoice = 0; added_twochoice < nvals; added_twochoice++)
+    {
+        if (pmwormholefilter_insert_twochoice(pop, pmwormholefilter_root, vals[added_twochoice]) == false)
+        {
+            cout << "Full" << endl;
+            break;
+        }
+    }
+    end_time = NowNanos();
+    perf.Stop();
+    cout << "Two-choice insertion throughput: " << 1000.0 * added_twochoice / static_cast<double>(end_time - start_time) << " MOPS" << endl;
+    perf.Report("Two-choice insertion", added_twochoice);
+    PrintSpace(pop, pmwormholefilter_root, added_twochoice);
+
+    perf.Start();
+    start_time = NowNanos();
+    for (int looked = 0; looked < added_twochoice; looked++)
+    {
+        if (pmwormholefilter_lookup_twochoice(pop, pmwormholefilter_root, vals[looked]) == false)
         {
             cout << "ERROR" << endl;
         }
     }
-    cout << "Lookup throughput: " << 1000.0 * added / static_cast<double>(NowNanos() - start_time) << " MOPS" << endl;
+    end_time = NowNanos();
+    perf.Stop();
+    cout << "Two-choice lookup throughput: " << 1000.0 * added_twochoice / static_cast<double>(end_time - start_time) << " MOPS" << endl;
+    perf.Report("Two-choice lookup", added_twochoice);
 
     cout << "PASS" << endl;
 
@@ -0,0 +1,385 @@
+#include "pm_wf/pmwormholefilter.hpp"
+
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <cstring>
+#include <libpmemobj.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+using namespace std;
+
+// Microbenchmarks for the individual wormhole filter kernels. Every benchmark
+// takes the table level as its first argument so that a regression can be
+// attributed both to a kernel and to the memory tier the table lives in.
+//
+//   ./filter_bench --benchmark_filter='BM_NegativeLookup/[0-2]'
+
+#define BENCH_PMEM_POOL "/mnt/pmem00/filter_bench.pool"
+#define BENCH_POOL_SIZE (1024ULL * 1024 * 1024)
+
+#define BENCH_NUM_PROBES (1 << 16)
+#define BENCH_INSERT_CHUNK 1024
+
+enum TableLevel
+{
+    kL1,
+    kL2,
+    kLLC,
+    kDRAM,
+    kPMEM,
+};
+
+static const char *kLevelNames[] = {"L1", "L2", "LLC", "DRAM", "PMEM"};
+
+static const uint64_t kLevelBytes[] = {
+    32ULL * 1024,
+    1024ULL * 1024,
+    32ULL * 1024 * 1024,
+    512ULL * 1024 * 1024,
+    512ULL * 1024 * 1024,
+};
+
+// A filter whose bucket array is sized to kLevelBytes[level]. Tables below
+// kPMEM are plain DRAM allocations and are written without persisting; the
+// kPMEM table is allocated from a pmemobj pool and uses the persisting path.
+class BenchTable
+{
+public:
+    explicit BenchTable(int level) : pop_(NULL), filter_(NULL), added_(0)
+    {
+        uint64_t num_buckets = kLevelBytes[level] / sizeof(uint64_t);
+
+        if (level == kPMEM)
+        {
+            remove(BENCH_PMEM_POOL);
+            if ((pop_ = pmemobj_create(BENCH_PMEM_POOL, POBJ_LAYOUT_NAME(pmwormholefilter_root), BENCH_POOL_SIZE, 0666)) == NULL)
+            {
+                return;
+            }
+            root_ = POBJ_ROOT(pop_, struct pmwormholefilter_root);
+            pmwormholefilter_init(pop_, root_, (uint32_t)(num_buckets * SLOT_PER_BUK * 0.8));
+            filter_ = D_RW(D_RW(root_)->pmwormholefilter);
+        }
+        else
+        {
+            filter_ = (struct pmwormholefilter *)calloc(1, sizeof(struct pmwormholefilter) + sizeof(uint64_t) * num_buckets);
+            filter_->num_buckets_ = num_buckets;
+        }
+    }
+
+    ~BenchTable()
+    {
+        if (pop_ != NULL)
+        {
+            pmwormholefilter_destroy(pop_, root_);
+            pmemobj_close(pop_);
+            remove(BENCH_PMEM_POOL);
+        }
+        else
+        {
+            free(filter_);
+        }
+    }
+
+    bool ok() const { return filter_ != NULL; }
+
+    struct pmwormholefilter *filter() const { return filter_; }
+
+    uint64_t capacity() const { return (uint64_t)filter_->num_buckets_ * SLOT_PER_BUK; }
+
+    int Insert(uint64_t hash, uint64_t *last_buck_idx = NULL)
+    {
+        return pmwormholefilter_insert_hash(pop_, filter_, hash, pop_ != NULL, last_buck_idx);
+    }
+
+    // Copies of the bucket array, e.g. to start every round of a benchmark
+    // from the same table.
+    vector<uint64_t> Snapshot() const
+    {
+        return vector<uint64_t>(filter_->buckets_, filter_->buckets_ + filter_->num_buckets_);
+    }
+
+    void Restore(const vector<uint64_t> &snapshot)
+    {
+        if (pop_ != NULL)
+        {
+            pmemobj_memcpy_persist(pop_, filter_->buckets_, snapshot.data(), snapshot.size() * sizeof(uint64_t));
+        }
+        else
+        {
+            memcpy(filter_->buckets_, snapshot.data(), snapshot.size() * sizeof(uint64_t));
+        }
+    }
+
+    // Inserts random keys until the requested fraction of slots is used.
+    bool Fill(double load, mt19937_64 &rng)
+    {
+        uint64_t target = (uint64_t)(load * capacity());
+        for (; added_ < target; added_++)
+        {
+            if (Insert(filter_->hasher_(rng())) == false)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    PMEMobjpool *pop_;
+    TOID(struct pmwormholefilter_root)
+    root_;
+    struct pmwormholefilter *filter_;
+    uint64_t added_;
+};
+
+static vector<uint64_t> RandomHashes(size_t n, uint64_t seed)
+{
+    mt19937_64 rng(seed);
+    vector<uint64_t> hashes(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        hashes[i] = rng();
+    }
+    return hashes;
+}
+
+static void BM_IndexHash(benchmark::State &state)
+{
+    const uint32_t num_buckets = kLevelBytes[state.range(0)] / sizeof(uint64_t);
+    vector<uint64_t> hashes = RandomHashes(BENCH_NUM_PROBES, 1);
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        uint32_t idx = index_hash(hashes[i++ & (BENCH_NUM_PROBES - 1)], num_buckets);
+        benchmark::DoNotOptimize(idx);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(kLevelNames[state.range(0)]);
+}
+
+static void BM_TagHash(benchmark::State &state)
+{
+    vector<uint64_t> hashes = RandomHashes(BENCH_NUM_PROBES, 1);
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        uint32_t tag = tag_hash(hashes[i++ & (BENCH_NUM_PROBES - 1)] >> 32);
+        benchmark::DoNotOptimize(tag);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// One SWAR compare against a random bucket of an 80% full table.
+static void BM_HasValue16(benchmark::State &state)
+{
+    BenchTable table(state.range(0));
+    mt19937_64 rng(2);
+    if (!table.ok() || !table.Fill(0.8, rng))
+    {
+        state.SkipWithError("table setup failed");
+        return;
+    }
+
+    struct pmwormholefilter *filter = table.filter();
+    vector<uint64_t> hashes = RandomHashes(BENCH_NUM_PROBES, 3);
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        uint64_t hash = hashes[i++ & (BENCH_NUM_PROBES - 1)];
+        uint64_t match = hasvalue16(filter->buckets_[index_hash(hash, filter->num_buckets_)], tag_hash(hash >> 32));
+        benchmark::DoNotOptimize(match);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(kLevelNames[state.range(0)]);
+}
+
+// Lookups of absent keys walk the whole MAX_PROB window unless they hit a
+// false positive.
+static void BM_NegativeLookup(benchmark::State &state)
+{
+    BenchTable table(state.range(0));
+    mt19937_64 rng(2);
+    if (!table.ok() || !table.Fill(0.8, rng))
+    {
+        state.SkipWithError("table setup failed");
+        return;
+    }
+
+    struct pmwormholefilter *filter = table.filter();
+    vector<uint64_t> hashes = RandomHashes(BENCH_NUM_PROBES, 3);
+    size_t i = 0;
+    uint64_t positives = 0;
+    for (auto _ : state)
+    {
+        positives += pmwormholefilter_lookup_hash(filter, hashes[i++ & (BENCH_NUM_PROBES - 1)]);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["fpr"] = benchmark::Counter((double)positives / state.iterations());
+    state.SetLabel(kLevelNames[state.range(0)]);
+}
+
+// The same lookups issued through the batched kernel, which overlaps the
+// cache misses of a group of windows.
+static void BM_BatchedLookup(benchmark::State &state)
+{
+    BenchTable table(state.range(0));
+    mt19937_64 rng(2);
+    if (!table.ok() || !table.Fill(0.8, rng))
+    {
+        state.SkipWithError("table setup failed");
+        return;
+    }
+
+    struct pmwormholefilter *filter = table.filter();
+    vector<uint64_t> hashes = RandomHashes(BENCH_NUM_PROBES, 3);
+    const int batch = 64;
+    bool out[batch];
+    size_t i = 0;
+    uint64_t positives = 0;
+    for (auto _ : state)
+    {
+        pmwormholefilter_lookup_batch_hash(filter, &hashes[i], batch, out);
+        i = (i + batch) & (BENCH_NUM_PROBES - 1);
+        positives += count(out, out + batch, true);
+    }
+    state.SetItemsProcessed(state.iterations() * batch);
+    state.counters["fpr"] = benchmark::Counter((double)positives / (state.iterations() * batch));
+    state.SetLabel(kLevelNames[state.range(0)]);
+}
+
+// Inserts at a fixed load factor (second argument, in percent). Every chunk
+// of inserts is removed again outside the timed region so the load factor
+// stays put for the whole run.
+static void BM_Insert(benchmark::State &state)
+{
+    BenchTable table(state.range(0));
+    mt19937_64 rng(2);
+    if (!table.ok() || !table.Fill(state.range(1) / 100.0, rng))
+    {
+        state.SkipWithError("table setup failed");
+        return;
+    }
+
+    struct pmwormholefilter *filter = table.filter();
+    vector<uint64_t> chunk;
+    chunk.reserve(BENCH_INSERT_CHUNK);
+    uint64_t failed = 0;
+    for (auto _ : state)
+    {
+        uint64_t hash = filter->hasher_(rng());
+        if (table.Insert(hash))
+        {
+            chunk.push_back(hash);
+        }
+        else
+        {
+            failed++;
+        }
+
+        if (chunk.size() == BENCH_INSERT_CHUNK)
+        {
+            state.PauseTiming();
+            for (size_t i = 0; i < chunk.size(); i++)
+            {
+                pmwormholefilter_delete_hash(filter, chunk[i]);
+            }
+            chunk.clear();
+            state.ResumeTiming();
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["failed"] = failed;
+    state.SetLabel(kLevelNames[state.range(0)]);
+}
+
+// Inserts whose 16-bucket home window is already full, so every one of them
+// has to move at least one tag towards its home bucket. "displaced" counts the
+// inserts that did, which should be all of them but the failed ones.
+static void BM_Displacement(benchmark::State &state)
+{
+    BenchTable table(state.range(0));
+    mt19937_64 rng(2);
+    if (!table.ok() || !table.Fill(0.9, rng))
+    {
+        state.SkipWithError("table setup failed");
+        return;
+    }
+
+    struct pmwormholefilter *filter = table.filter();
+    // Keep a round small enough not to change the load factor noticeably.
+    const size_t round = min<uint64_t>(BENCH_INSERT_CHUNK, table.capacity() / 100);
+    vector<uint64_t> candidates;
+    for (uint64_t tries = 0; candidates.size() < round && tries < 64 * table.capacity(); tries++)
+    {
+        uint64_t hash = filter->hasher_(rng());
+        uint64_t init_buck_idx = index_hash(hash, filter->num_buckets_);
+        bool window_full = true;
+        for (uint32_t prob = 0; prob < MAX_PROB && window_full; prob++)
+        {
+            for (uint32_t j = 0; j < SLOT_PER_BUK; j++)
+            {
+                if (ReadTag(filter, init_buck_idx + prob, j) == 0)
+                {
+                    window_full = false;
+                    break;
+                }
+            }
+        }
+        if (window_full)
+        {
+            candidates.push_back(hash);
+        }
+    }
+    if (candidates.empty())
+    {
+        state.SkipWithError("no full windows at this load");
+        return;
+    }
+
+    // Deleting the candidates again would leave a free slot in their windows
+    // and the displaced tags out of them, so every round starts from a copy.
+    const vector<uint64_t> snapshot = table.Snapshot();
+    size_t i = 0;
+    uint64_t failed = 0;
+    uint64_t displaced = 0;
+    for (auto _ : state)
+    {
+        uint64_t last_buck_idx = 0;
+        if (!table.Insert(candidates[i], &last_buck_idx))
+        {
+            failed++;
+        }
+        else if (last_buck_idx - index_hash(candidates[i], filter->num_buckets_) >= MAX_PROB)
+        {
+            displaced++;
+        }
+
+        if (++i == candidates.size())
+        {
+            state.PauseTiming();
+            table.Restore(snapshot);
+            i = 0;
+            state.ResumeTiming();
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["failed"] = failed;
+    state.counters["displaced"] = displaced;
+    state.counters["candidates"] = candidates.size();
+    state.SetLabel(kLevelNames[state.range(0)]);
+}
+
+BENCHMARK(BM_IndexHash)->DenseRange(kL1, kDRAM);
+BENCHMARK(BM_TagHash);
+BENCHMARK(BM_HasValue16)->DenseRange(kL1, kPMEM);
+BENCHMARK(BM_NegativeLookup)->DenseRange(kL1, kPMEM);
+BENCHMARK(BM_BatchedLookup)->DenseRange(kL1, kPMEM);
+BENCHMARK(BM_Insert)->ArgsProduct({{kL1, kL2, kLLC, kDRAM, kPMEM}, {50, 80, 90}});
+BENCHMARK(BM_Displacement)->DenseRange(kL1, kPMEM);
+
+BENCHMARK_MAIN();
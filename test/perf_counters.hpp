@@ -0,0 +1,207 @@
+#ifndef PERF_COUNTERS_HPP_
+#define PERF_COUNTERS_HPP_
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <sstream>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Hardware counters around one phase of the evaluation harness. Each counter is
+// opened on its own, so an event the CPU or the container does not expose (for
+// example because perf_event_paranoid forbids it) is simply reported as "n/a"
+// while the others keep working. Threads created after Open() are counted as
+// well (attr.inherit), which covers the asynchronous persister; threads that
+// already exist when Open() is called are not.
+//
+// Cycles and instructions are opened as one group, so that the kernel always
+// schedules them together and IPC divides counts of the same window. When the
+// kernel multiplexes the counters, e.g. with the NMI watchdog or another perf
+// user, each count is scaled by time_enabled / time_running; a counter that
+// never ran is reported as "n/a".
+
+enum PerfCounter
+{
+    kCycles,
+    kInstructions,
+    kLLCMisses,
+    kDTLBMisses,
+    kBranchMisses,
+    kNumPerfCounters,
+};
+
+class PerfCounters
+{
+public:
+    PerfCounters() : enabled_(false), grouped_(false)
+    {
+        for (int i = 0; i < kNumPerfCounters; i++)
+        {
+            fds_[i] = -1;
+            values_[i] = 0;
+            valid_[i] = false;
+        }
+    }
+
+    ~PerfCounters()
+    {
+        for (int i = 0; i < kNumPerfCounters; i++)
+        {
+            if (fds_[i] >= 0)
+            {
+                close(fds_[i]);
+            }
+        }
+    }
+
+    // Opens the counters. Returns false if none of them is available.
+    bool Open()
+    {
+        Open(kCycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+        Open(kInstructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, fds_[kCycles]);
+        Open(kLLCMisses, PERF_TYPE_HW_CACHE, CacheConfig(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS), -1);
+        Open(kDTLBMisses, PERF_TYPE_HW_CACHE, CacheConfig(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS), -1);
+        Open(kBranchMisses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, -1);
+
+        for (int i = 0; i < kNumPerfCounters; i++)
+        {
+            if (fds_[i] >= 0)
+            {
+                enabled_ = true;
+            }
+        }
+        return enabled_;
+    }
+
+    bool enabled() const { return enabled_; }
+
+    void Start()
+    {
+        // Reset every counter before enabling any, so that the instructions
+        // of the group start from zero together with its cycles.
+        for (int i = 0; i < kNumPerfCounters; i++)
+        {
+            if (fds_[i] >= 0)
+            {
+                ioctl(fds_[i], PERF_EVENT_IOC_RESET, 0);
+            }
+        }
+        for (int i = 0; i < kNumPerfCounters; i++)
+        {
+            if (fds_[i] >= 0)
+            {
+                ioctl(fds_[i], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+
+    void Stop()
+    {
+        for (int i = 0; i < kNumPerfCounters; i++)
+        {
+            if (fds_[i] >= 0)
+            {
+                ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+        for (int i = 0; i < kNumPerfCounters; i++)
+        {
+            values_[i] = 0;
+            valid_[i] = false;
+            // value, time_enabled, time_running
+            uint64_t data[3];
+            if (fds_[i] >= 0 && read(fds_[i], data, sizeof(data)) == sizeof(data) && data[2] != 0)
+            {
+                values_[i] = data[2] == data[1] ? data[0] : (uint64_t)((double)data[0] * data[1] / data[2]);
+                valid_[i] = true;
+            }
+        }
+    }
+
+    // Prints the counts of the last Start()/Stop() window divided by ops.
+    void Report(const char *phase, uint64_t ops) const
+    {
+        if (!enabled_ || ops == 0)
+        {
+            return;
+        }
+
+        // Formatted on a stream of its own so that cout keeps its precision.
+        ostringstream out;
+        out << "  " << phase << " counters per op:";
+        Print(out, "cycles", kCycles, ops);
+        Print(out, "instructions", kInstructions, ops);
+        Print(out, "LLC-misses", kLLCMisses, ops);
+        Print(out, "dTLB-misses", kDTLBMisses, ops);
+        Print(out, "branch-misses", kBranchMisses, ops);
+        if (grouped_ && valid_[kCycles] && valid_[kInstructions] && values_[kCycles] != 0)
+        {
+            out << " IPC=" << setprecision(3) << (double)values_[kInstructions] / values_[kCycles];
+        }
+        cout << out.str() << endl;
+    }
+
+private:
+    static uint64_t CacheConfig(uint64_t cache, uint64_t op, uint64_t result)
+    {
+        return cache | (op << 8) | (result << 16);
+    }
+
+    // Opens counter in the group of group_fd, or as a group of its own if
+    // group_fd is -1.
+    void Open(PerfCounter counter, uint32_t type, uint64_t config, int group_fd)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        // Group members follow their leader, which Start() enables.
+        attr.disabled = group_fd < 0;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        fds_[counter] = syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+        if (fds_[counter] < 0 && group_fd >= 0)
+        {
+            // Counted on its own, so IPC is not reported.
+            Open(counter, type, config, -1);
+            return;
+        }
+        if (counter == kInstructions)
+        {
+            grouped_ = fds_[counter] >= 0 && group_fd >= 0;
+        }
+    }
+
+    void Print(ostream &out, const char *name, PerfCounter counter, uint64_t ops) const
+    {
+        out << " " << name << "=";
+        if (!valid_[counter])
+        {
+            out << "n/a";
+        }
+        else
+        {
+            out << setprecision(4) << (double)values_[counter] / ops;
+        }
+    }
+
+    bool enabled_;
+    // Whether instructions share the group of cycles
+    bool grouped_;
+    int fds_[kNumPerfCounters];
+    // Counts of the last window, scaled up if the counter was multiplexed
+    uint64_t values_[kNumPerfCounters];
+    bool valid_[kNumPerfCounters];
+};
+
+#endif // PERF_COUNTERS_HPP_
@@ -0,0 +1,101 @@
+#include "pm_wf/pmwormholefilter_twochoice.hpp"
+
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <stdlib.h>
+#include <vector>
+
+using namespace std;
+
+// Deletes from a two-choice table in DRAM must never take away the entry of
+// another key. Pairs of keys share their home bucket and tag but differ in the
+// rest of their hash, in a table full enough that many of them are placed in
+// their alternate window. Deleting one key of a pair must leave the other
+// matching, and no key that was not deleted may ever miss.
+//
+// The number of buckets is not a power of two, so that the whole hash, and not
+// only its low bits, would reach a home derived from it.
+
+#define TEST_NUM_BUCKETS 4099
+#define TEST_LOAD 0.85
+#define TEST_NUM_PAIRS 2000
+
+static int failures = 0;
+
+static void Check(bool ok, const char *what, uint64_t hash)
+{
+    if (!ok)
+    {
+        if (failures++ < 10)
+        {
+            cout << "FAILED: " << what << " for hash " << hex << hash << dec << endl;
+        }
+    }
+}
+
+int main()
+{
+    struct pmwormholefilter *filter = (struct pmwormholefilter *)calloc(1, sizeof(struct pmwormholefilter) + sizeof(uint64_t) * TEST_NUM_BUCKETS);
+    filter->num_buckets_ = TEST_NUM_BUCKETS;
+    mt19937_64 rng(301);
+
+    vector<uint64_t> fill;
+    const uint64_t target = (uint64_t)(TEST_LOAD * TEST_NUM_BUCKETS * SLOT_PER_BUK);
+    while (fill.size() < target)
+    {
+        uint64_t hash = rng();
+        if (!pmwormholefilter_insert_twochoice_hash(NULL, filter, hash, false))
+        {
+            break;
+        }
+        fill.push_back(hash);
+    }
+
+    // The upper 32 bits hold the tag in their low bits, so adding a multiple
+    // of 2^20 to them keeps the home and the tag but changes the hash.
+    uint64_t pairs = 0;
+    uint64_t in_alt = 0;
+    for (int i = 0; i < TEST_NUM_PAIRS; i++)
+    {
+        const uint64_t x = rng();
+        const uint64_t y = x + ((uint64_t)(1 + rng() % 4095) << 52);
+        if (!pmwormholefilter_insert_twochoice_hash(NULL, filter, x, false))
+        {
+            continue;
+        }
+        if (!pmwormholefilter_insert_twochoice_hash(NULL, filter, y, false))
+        {
+            pmwormholefilter_delete_twochoice_hash(filter, x);
+            continue;
+        }
+        pairs++;
+        const uint64_t home = index_hash(x, filter->num_buckets_);
+        const uint64_t tag = tag_hash(x >> 32);
+        in_alt += !pmwormholefilter_lookup_at(filter, home, tag);
+
+        Check(pmwormholefilter_delete_twochoice_hash(filter, x), "delete", x);
+        Check(pmwormholefilter_lookup_twochoice_hash(filter, y), "lookup after deleting its twin", y);
+        Check(pmwormholefilter_delete_twochoice_hash(filter, y), "delete", y);
+
+        // Re-inserting and re-probing after both deletes works as before.
+        Check(pmwormholefilter_insert_twochoice_hash(NULL, filter, y, false), "re-insert", y);
+        Check(pmwormholefilter_lookup_twochoice_hash(filter, y), "lookup after re-insert", y);
+        Check(pmwormholefilter_delete_twochoice_hash(filter, y), "delete", y);
+    }
+
+    // Deleting half of the fill keys leaves every other one matching.
+    for (size_t i = 0; i < fill.size(); i += 2)
+    {
+        Check(pmwormholefilter_delete_twochoice_hash(filter, fill[i]), "delete", fill[i]);
+    }
+    for (size_t i = 1; i < fill.size(); i += 2)
+    {
+        Check(pmwormholefilter_lookup_twochoice_hash(filter, fill[i]), "lookup of a kept key", fill[i]);
+    }
+
+    cout << "twochoice_test: " << fill.size() << " fill keys, " << pairs << " pairs (" << in_alt
+         << " with both in the alternate window), " << failures << " failures" << endl;
+    free(filter);
+    return failures == 0 ? 0 : 1;
+}